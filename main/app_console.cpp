@@ -0,0 +1,34 @@
+#include "app_console.h"
+
+#include <stdio.h>
+
+using namespace esp_matter::console;
+
+static engine purifier_console;
+
+
+static esp_err_t print_description(const command_t *command, void *arg) {
+    printf("\t%s: %s\n", command->name, command->description);
+    return ESP_OK;
+}
+
+static esp_err_t purifier_dispatch(int argc, char **argv) {
+    if (argc <= 0) {
+        purifier_console.for_each_command(print_description, NULL);
+        return ESP_OK;
+    }
+    return purifier_console.exec_command(argc, argv);
+}
+
+esp_err_t app_console_register(const command_t *commands, unsigned count) {
+    return purifier_console.register_commands(commands, count);
+}
+
+esp_err_t app_console_init() {
+    static const command_t command = {
+        .name = "purifier",
+        .description = "Air purifier commands. Usage: matter esp purifier <command>.",
+        .handler = purifier_dispatch,
+    };
+    return add_commands(&command, 1);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter_console.h>
+
+// Commands of all purifier modules are grouped under "matter esp purifier"
+esp_err_t app_console_init();
+
+// Add a set of subcommands to the purifier group
+esp_err_t app_console_register(const esp_matter::console::command_t *commands, unsigned count);
@@ -9,10 +9,24 @@
 #include <led_driver.h>
 #include <app_driver.h>
 #include <fan.h>
+#include "fan_cal.h"
 #include <led.h>
 #include "buttons.h"
 #include "buzzer.h"
 #include "pms.h"
+#include "diag.h"
+#include "pm_history.h"
+#include "auto_control.h"
+#include "app_console.h"
+#include "tasks.h"
+#include "attributes.h"
+#include "sequencer.h"
+#include "trace.h"
+#include "capture.h"
+#include "metrics_http.h"
+#include "energy.h"
+#include "ui_fsm.h"
+#include "driver_state.h"
 
 #include <esp_log.h>
 #include <stdlib.h>
@@ -24,6 +38,7 @@
 
 #include <esp_wifi.h>
 #include <esp_event.h>
+#include <esp_timer.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -45,53 +60,44 @@ extern bool device_commisioning;
 static QueueHandle_t air_quality_queue;
 
 
-// Things that are not handled by matter database
-struct State {
-    // legal values are 1, 2, 3
-    uint8_t brightness = 3;
-    // stores the previous state while the fan is off
-    FanControl::FanModeEnum prev_mode = FanControl::FanModeEnum::kHigh;
-    // Stores the previous percentage setting while the fan is off
-    // When turning on, percentage takes precedence over mode (except when 0)
-    uint8_t prev_percentage = 0;
-    uint8_t current_auto_percentage = 30;
-    bool auto_mode = false;
-};
+// Things that are not handled by matter database, see driver_state.h
 SemaphoreHandle_t state_mutex;
 
 
-static State state;
-
-
-void app_driver_update_fan_speed(uint8_t percentage);
+static driver_state_t state;
 
-void app_driver_report_fan_mode_from_percentage(uint8_t percentage);
+static auto_control_t auto_control;
 
+// Latest fan target written over Matter, waiting for fan_actuator_task
+struct FanTarget {
+    bool pending = false;
+    bool is_mode = false;
+    uint8_t value = 0;
+};
+static FanTarget fan_target;
+static portMUX_TYPE fan_target_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t fan_actuator_handle;
+
+// Time spent in the Matter callback for fan writes
+struct FanWriteStats {
+    uint32_t received = 0;
+    uint32_t applied = 0;
+    uint32_t callback_max_us = 0;
+    uint64_t callback_total_us = 0;
+};
+static FanWriteStats fan_write_stats;
+// Updated from the CHIP task and fan_actuator_task, read from the console
+static portMUX_TYPE fan_write_stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
 
-void app_driver_update_fan_speed(uint8_t percentage) {
-    // Hardware
-    fan_set_percentage(percentage);
+static_assert(UI_MODE_OFF == static_cast<uint8_t>(FanControl::FanModeEnum::kOff)
+    && UI_MODE_HIGH == static_cast<uint8_t>(FanControl::FanModeEnum::kHigh)
+    && UI_MODE_AUTO == static_cast<uint8_t>(FanControl::FanModeEnum::kAuto)
+    && UI_MODE_COUNT == static_cast<uint8_t>(FanControl::FanModeEnum::kUnknownEnumValue),
+    "ui_mode_t must match the Matter FanModeEnum");
 
-    // HW + matter DB (do not want slow display response)
-    app_driver_report_fan_mode_from_percentage(percentage);
+void app_driver_update_fan_speed(uint8_t percentage);
 
-    // Matter DB
-    using namespace FanControl::Attributes;
-    uint16_t endpoint_id = air_purifier_endpoint_id;
-    uint32_t cluster_id = FanControl::Id;
-    
-    esp_matter_attr_val_t val;
-    val = esp_matter_uint8(percentage);
-    attribute::report(endpoint_id, cluster_id, PercentCurrent::Id, &val);
-    attribute::report(endpoint_id, cluster_id, SpeedCurrent::Id, &val);
-
-    // State outside of matter db
-    if (percentage != 0) {
-        state.prev_percentage = percentage;
-    }
-    state.auto_mode = false;
-}
 
 
 void app_driver_show_mode(FanControl::FanModeEnum mode) {
@@ -112,143 +118,84 @@ void app_driver_show_mode(FanControl::FanModeEnum mode) {
 }
 
 
-void app_driver_report_fan_mode_from_percentage(uint8_t percentage) {
-    using namespace FanControl::Attributes;
+// Hardware and Matter DB side of a driver_state_t step
+static void app_driver_apply_fan(const driver_fan_t &fan) {
+    FanControl::FanModeEnum mode = static_cast<FanControl::FanModeEnum>(fan.mode);
 
-    uint16_t endpoint_id = air_purifier_endpoint_id;
-    uint32_t cluster_id = FanControl::Id;
+    // Hardware
+    fan_set_percentage(fan.percentage);
 
-    esp_matter_attr_val_t val;
-    FanControl::FanModeEnum mode;
-    
-    if (percentage == 0) {
-        mode = FanControl::FanModeEnum::kOff;
-    } else if (percentage <= 30) {
-        mode = FanControl::FanModeEnum::kLow;
-    } else {
-        mode = FanControl::FanModeEnum::kHigh;
-    }
-    
-    // HW
+    // HW + matter DB (do not want slow display response)
     app_driver_show_mode(mode);
+    if (fan.report_mode) {
+        attr_report_fan_mode(mode);
+    }
 
     // Matter DB
-    val = esp_matter_enum8(static_cast<uint8_t>(mode));
-    attribute::report(endpoint_id, cluster_id, FanMode::Id, &val);
+    attr_report_percent_current(fan.percentage);
+    attr_report_speed_current(fan.percentage);
 }
 
 
+void app_driver_update_fan_speed(uint8_t percentage) {
+    app_driver_apply_fan(driver_state_set_percentage(&state, percentage));
+}
+
 
 void app_driver_update_mode(uint8_t mode)
 {
-    using namespace FanControl::Attributes;
-
-    uint16_t endpoint_id = air_purifier_endpoint_id;
-    uint32_t cluster_id = FanControl::Id;
-
-    FanControl::FanModeEnum m = static_cast<FanControl::FanModeEnum>(mode);
-
-    uint8_t percentage = 0;
-
-    switch (m) {
-        case FanControl::FanModeEnum::kOff:
-            percentage = 0;
-            break;
-        case FanControl::FanModeEnum::kLow:
-            percentage = 20;
-            break;
-        case FanControl::FanModeEnum::kHigh:
-            percentage = 100;
-            break;
-        case FanControl::FanModeEnum::kAuto:
-            percentage = state.current_auto_percentage;
-            break;
-        default:
-            break;
-    }
-
-    if (m == FanControl::FanModeEnum::kAuto) {
-        // Set hardware
-        fan_set_percentage(percentage);
-        app_driver_show_mode(m);
+    app_driver_apply_fan(driver_state_set_mode(&state, static_cast<ui_mode_t>(mode)));
+}
 
-        // save to matter DB  
-        esp_matter_attr_val_t val = esp_matter_uint8(percentage);
-        attribute::report(endpoint_id, cluster_id, PercentCurrent::Id, &val);
-        attribute::report(endpoint_id, cluster_id, SpeedCurrent::Id, &val);
 
-        // save to state
-        state.prev_mode = FanControl::FanModeEnum::kAuto;
-        state.prev_percentage = 0;
-        state.auto_mode = true;
-    } else {
-        app_driver_update_fan_speed(percentage);
+// Side effects of a front panel transition, in the order documented in ui_fsm.h
+static void app_driver_run_ui_commands(const ui_transition_t &t) {
+    if (t.commands & UI_CMD_BEEP) {
+        buzzer_beep();
+    }
+    if (t.commands & UI_CMD_SET_BRIGHTNESS) {
+        state.brightness = t.brightness;
+        led_set_brightness(state.brightness);
+    }
+    if (t.commands & UI_CMD_RESTORE) {
+        if (state.prev_percentage == 0) {
+            attr_update_fan_mode(static_cast<FanControl::FanModeEnum>(state.prev_mode));
+        } else {
+            attr_update_speed_setting(state.prev_percentage);
+        }
+    }
+    if (t.commands & UI_CMD_SET_MODE) {
+        attr_update_fan_mode(static_cast<FanControl::FanModeEnum>(t.mode));
     }
 }
 
-
 void app_driver_buttons_callback(uint8_t button) {
-    using namespace FanControl::Attributes;
+    ui_event_t event;
+    if (button == BUTTON_POWER) {
+        event = UI_EVENT_POWER;
+    } else if (button == BUTTON_BRIGHTNESS) {
+        event = UI_EVENT_BRIGHTNESS;
+    } else if (button == BUTTON_MODE) {
+        event = UI_EVENT_MODE;
+    } else {
+        return;
+    }
 
-    uint16_t endpoint_id = air_purifier_endpoint_id;
-    uint32_t cluster_id = FanControl::Id;
-    uint32_t mode_attr_id = FanControl::Attributes::FanMode::Id;
-    uint32_t speed_attr_id = FanControl::Attributes::SpeedSetting::Id;
+    ui_mode_t mode = static_cast<ui_mode_t>(attr_get_fan_mode());
+    ui_transition_t t = ui_fsm_step(mode, state.brightness, event);
+    TRACE(TRACE_UI, event << 16 | mode << 8 | state.brightness, t.commands);
+    app_driver_run_ui_commands(t);
+}
 
-    node_t *node = node::get();
-    endpoint_t *endpoint = endpoint::get(node, endpoint_id);
-    cluster_t *cluster = cluster::get(endpoint, cluster_id);
-    attribute_t *mode_attr = attribute::get(cluster, mode_attr_id);
 
-    esp_matter_attr_val_t val;
-    attribute::get_val(mode_attr, &val);
-    FanControl::FanModeEnum mode = static_cast<FanControl::FanModeEnum>(val.val.u8);
+static TaskHandle_t wireless_monitor_handle;
 
-    if (mode == FanControl::FanModeEnum::kOff) {
-        if (button == BUTTON_POWER) {
-            buzzer_beep();
-            if (state.prev_percentage == 0) {
-                val = esp_matter_enum8(static_cast<uint8_t>(state.prev_mode));
-                attribute::update(endpoint_id, cluster_id, mode_attr_id, &val);
-            } else {
-                val = esp_matter_uint8(state.prev_percentage);
-                attribute::update(endpoint_id, cluster_id, speed_attr_id, &val);
-            }
-        }
-    } else {
-        buzzer_beep();
-        if (state.brightness <= 1) {
-            state.brightness = 3;
-            led_set_brightness(state.brightness);
-        
-        } else {
-            if (button == BUTTON_POWER) {
-                val = esp_matter_enum8(static_cast<uint8_t>(FanControl::FanModeEnum::kOff));
-                attribute::update(endpoint_id, cluster_id, mode_attr_id, &val);
-
-            } else if (button == BUTTON_BRIGHTNESS) {
-                // Decrement (2 or 3), 1 is caught earlier
-                state.brightness--;
-                led_set_brightness(state.brightness);
-
-            } else if (button == BUTTON_MODE) {
-                // High -> Low -> Auto
-                FanControl::FanModeEnum new_mode;
-                if (mode == FanControl::FanModeEnum::kHigh) {
-                    new_mode = FanControl::FanModeEnum::kLow;
-                } else if (mode == FanControl::FanModeEnum::kLow) {
-                    new_mode = FanControl::FanModeEnum::kAuto;
-                } else {
-                    new_mode = FanControl::FanModeEnum::kHigh;
-                }
-                val = esp_matter_enum8(static_cast<uint8_t>(new_mode));
-                attribute::update(endpoint_id, cluster_id, mode_attr_id, &val);
-            }
-        }
+void app_driver_wireless_changed() {
+    if (wireless_monitor_handle != NULL) {
+        xTaskNotifyGive(wireless_monitor_handle);
     }
 }
 
-
 void wireless_monitor_task(void *pvParameters) {
     while (1) {
         // Check Wi-Fi connection status
@@ -262,96 +209,94 @@ void wireless_monitor_task(void *pvParameters) {
                 led_status_set_off(LED_IND_WIFI);
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Woken by connectivity and commissioning events, the timeout only catches missed ones
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WIRELESS_MONITOR_POLL_MS));
     }
 }
 
-uint8_t aq_enum_to_motor_percentage(uint8_t aq_enum) {
-    using namespace AirQuality;
+// Perceptual {green, orange, red} per AirQualityEnum value
+static constexpr led_color_t aq_colors[] = {
+    { 0, 0, 0 },        // unknown
+    { 255, 0, 0 },      // good
+    { 136, 224, 0 },    // fair, yellow
+    { 72, 248, 0 },     // moderate, light orange
+    { 0, 255, 0 },      // poor, deep orange
+    { 0, 186, 186 },    // very poor
+    { 0, 0, 255 },      // extremely poor, deep red
+};
+static_assert(sizeof(aq_colors) / sizeof(aq_colors[0]) == AQ_EXTREMELY_POOR + 1, "One color per air quality level");
 
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kGood)) {
-        return AUTO_GOOD_PERCENT;
-    }
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kFair)) {
-        return AUTO_FAIR_PERCENT;
-    }
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kModerate)) {
-        return AUTO_MODERATE_PERCENT;
-    }
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kPoor)) {
-        return AUTO_POOR_PERCENT;
-    }
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kVeryPoor)) {
-        return AUTO_VPOOR_PERCENT;
-    }
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kExtremelyPoor)) {
-        return AUTO_XPOOR_PERCENT;
+void aq_enum_set_rgb(uint8_t aq_enum) {
+    if (aq_enum > AQ_EXTREMELY_POOR) {
+        aq_enum = AQ_UNKNOWN;
     }
-    return AUTO_UNKNOWN_PERCENT;
+    led_rgb_fade(aq_colors[aq_enum], LED_AQ_FADE_MS);
 }
 
-void aq_enum_set_rgb(uint8_t aq_enum) {
-    using namespace AirQuality;
-
-    switch (static_cast<AirQualityEnum>(aq_enum)) {
-        case AirQualityEnum::kGood:
-            led_rgb_set(255, 0, 0);
-            break;
-        case AirQualityEnum::kFair:
-            // yellow
-            led_rgb_set(64, 192, 0);
-            break;
-        case AirQualityEnum::kModerate:
-            // light orange
-            led_rgb_set(16, 239, 0);
-            break;
-        case AirQualityEnum::kPoor:
-            // deep orange
-            led_rgb_set(0, 255, 0);
-            break;
-        case AirQualityEnum::kVeryPoor:
-            led_rgb_set(0, 128, 128);
-            break;
-        case AirQualityEnum::kExtremelyPoor:
-            // deep red
-            led_rgb_set(0, 0, 255);
-            break;
-        default:
-            led_rgb_set(0, 0, 0);
-    }
+// Warning blinks while the sensor is unreliable and stays lit when it is dead
+void sensor_health_show(pms_health_t health) {
+    static bool shown = false;
+    static pms_health_t shown_health;
 
-    if (aq_enum == static_cast<uint8_t>(AirQualityEnum::kUnknown)) {
+    if (shown && health == shown_health) {
+        return;
+    }
+    if (health == PMS_HEALTH_DEAD) {
         led_status_set_on(LED_IND_WARNING);
+        if (!sequencer_play_error(SEQ_ERROR_SENSOR_DEAD)) {
+            // A reset countdown or commissioning animation plays, flash the code with a later reading
+            return;
+        }
+    } else if (health == PMS_HEALTH_DEGRADED) {
+        led_status_set_blink(LED_IND_WARNING);
     } else {
         led_status_set_off(LED_IND_WARNING);
     }
+    shown = true;
+    shown_health = health;
 }
 
 
 void auto_controller_task(void *pvParameters) {
-    using namespace FanControl::Attributes;
-
     static aq_queue_item_t air_quality_item;
-    esp_matter_attr_val_t val;
+    static pms_stats_t sensor_stats;
 
     while (1) {
         if (xQueueReceive(air_quality_queue, &air_quality_item, portMAX_DELAY) == pdPASS) {
+            int32_t latency_us = static_cast<int32_t>(esp_timer_get_time() - air_quality_item.timestamp_us);
+            app_task_record_jitter(APP_TASK_AUTO_CONTROLLER, latency_us);
+            TRACE(TRACE_CONTROLLER_LAG, latency_us, 0);
+
             // Report enum value
-            val = esp_matter_enum8(air_quality_item.air_quality_enum);
-            attribute::report(air_quality_sensor_endpoint_id, AirQuality::Id, AirQuality::Attributes::AirQuality::Id, &val);
+            attr_report_air_quality(static_cast<AirQuality::AirQualityEnum>(air_quality_item.air_quality_enum));
             aq_enum_set_rgb(air_quality_item.air_quality_enum);
+            sensor_health_show(air_quality_item.health);
+            metrics_http_record_reading(air_quality_item.pm25_raw, air_quality_item.pm25,
+                                        air_quality_item.air_quality_enum);
+
+            pms_get_stats(&sensor_stats);
+            diag_report_sensor(&sensor_stats);
+
+            // Energy is integrated at the sensor rate, fan changes land within a second
+            energy_update(air_quality_item.timestamp_us, fan_get_percentage(), led_get_brightness());
+            fan_sample_rpm();
+
+            if (air_quality_item.air_quality_enum != static_cast<int>(AirQuality::AirQualityEnum::kUnknown)) {
+                pm_history_add(air_quality_item.timestamp_us / 1000000, air_quality_item.pm25);
+            }
 
             if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
-                uint8_t percentage = aq_enum_to_motor_percentage(air_quality_item.air_quality_enum);
+                uint8_t percentage = auto_control_update(&auto_control,
+                    air_quality_item.air_quality_enum, air_quality_item.pm25);
 
-                state.current_auto_percentage = percentage;
-                if (state.auto_mode) {
+                bool follow = driver_state_auto_update(&state, percentage);
+                TRACE(TRACE_CONTROLLER, air_quality_item.pm25, air_quality_item.air_quality_enum << 8 | percentage);
+                if (follow) {
                     // Set hardware
                     fan_set_percentage(percentage);
                     // report motor percentage to matter DB
-                    val = esp_matter_uint8(percentage);
-                    attribute::report(air_purifier_endpoint_id, FanControl::Id, PercentCurrent::Id, &val);
-                    attribute::report(air_purifier_endpoint_id, FanControl::Id, SpeedCurrent::Id, &val);
+                    attr_report_percent_current(percentage);
+                    attr_report_speed_current(percentage);
                 }
                 xSemaphoreGive(state_mutex);
             }
@@ -362,37 +307,27 @@ void auto_controller_task(void *pvParameters) {
 
 void app_driver_hw_init() {
     state_mutex = xSemaphoreCreateMutex();
+    driver_state_init(&state);
     air_quality_queue = xQueueCreate(1, sizeof(aq_queue_item_t));
+    pm_history_init();
+    auto_control_init(&auto_control, AUTO_STRATEGY);
+    energy_init();
 
     fan_init();
+    fan_cal_init();
     led_init();
     buzzer_init();
+    sequencer_init();
     buttons_init();
     pms_init(air_quality_queue);
-    xTaskCreate(&wireless_monitor_task, "wireless_monitor", 4096, NULL, 5, NULL);
-    xTaskCreate(&auto_controller_task, "auto_controller", 4096, NULL, 5, NULL);
+    app_task_create(APP_TASK_WIRELESS_MONITOR, wireless_monitor_task, NULL, &wireless_monitor_handle);
+    app_task_create(APP_TASK_AUTO_CONTROLLER, auto_controller_task, NULL, NULL);
+    app_task_create(APP_TASK_FAN_ACTUATOR, fan_actuator_task, NULL, &fan_actuator_handle);
 }
 
 void app_driver_set_defaults() {
-    using namespace FanControl::Attributes;
-
-    uint16_t endpoint_id = air_purifier_endpoint_id;
-    uint32_t cluster_id = FanControl::Id;
-    uint32_t mode_attr_id = FanControl::Attributes::FanMode::Id;
-    uint32_t speed_attr_id = FanControl::Attributes::SpeedSetting::Id;
-
-    node_t *node = node::get();
-    endpoint_t *endpoint = endpoint::get(node, endpoint_id);
-    cluster_t *cluster = cluster::get(endpoint, cluster_id);
-    attribute_t *mode_attr = attribute::get(cluster, mode_attr_id);
-    attribute_t *speed_attr = attribute::get(cluster, speed_attr_id);
-
-    esp_matter_attr_val_t val;
-    attribute::get_val(mode_attr, &val);
-    FanControl::FanModeEnum mode = static_cast<FanControl::FanModeEnum>(val.val.u8);
-
-    attribute::get_val(speed_attr, &val);
-    uint8_t speed = val.val.u8;
+    FanControl::FanModeEnum mode = attr_get_fan_mode();
+    uint8_t speed = attr_get_speed_setting();
 
     if (mode == FanControl::FanModeEnum::kAuto) {
         app_driver_update_mode(static_cast<uint8_t>(mode));
@@ -402,6 +337,53 @@ void app_driver_set_defaults() {
 }
 
 
+static void app_driver_apply_fan_target(bool is_mode, uint8_t value) {
+    if (is_mode) {
+        app_driver_update_mode(value);
+    } else {
+        app_driver_update_fan_speed(value);
+    }
+    taskENTER_CRITICAL(&fan_write_stats_lock);
+    fan_write_stats.applied++;
+    taskEXIT_CRITICAL(&fan_write_stats_lock);
+}
+
+// Applies the latest fan target, at most once per FAN_WRITE_MIN_INTERVAL_MS
+void fan_actuator_task(void *pvParameters) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        taskENTER_CRITICAL(&fan_target_lock);
+        FanTarget target = fan_target;
+        fan_target.pending = false;
+        taskEXIT_CRITICAL(&fan_target_lock);
+
+        if (!target.pending) {
+            continue;
+        }
+        if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+            app_driver_apply_fan_target(target.is_mode, target.value);
+            xSemaphoreGive(state_mutex);
+        }
+
+        // Writes arriving meanwhile only replace the target, the last one wins
+        vTaskDelay(pdMS_TO_TICKS(FAN_WRITE_MIN_INTERVAL_MS));
+    }
+}
+
+static void app_driver_request_fan_target(bool is_mode, uint8_t value) {
+#if FAN_WRITE_COALESCE
+    taskENTER_CRITICAL(&fan_target_lock);
+    fan_target.pending = true;
+    fan_target.is_mode = is_mode;
+    fan_target.value = value;
+    taskEXIT_CRITICAL(&fan_target_lock);
+    xTaskNotifyGive(fan_actuator_handle);
+#else
+    app_driver_apply_fan_target(is_mode, value);
+#endif
+}
+
 esp_err_t app_driver_attribute_update(uint16_t endpoint_id, uint32_t cluster_id,
                                       uint32_t attribute_id, esp_matter_attr_val_t *val)
 {
@@ -409,8 +391,11 @@ esp_err_t app_driver_attribute_update(uint16_t endpoint_id, uint32_t cluster_id,
 
     if (endpoint_id == air_purifier_endpoint_id) {
         if (cluster_id == FanControl::Id) {
+            int64_t start_us = esp_timer_get_time();
+
             if (attribute_id == FanControl::Attributes::FanMode::Id) {
-                app_driver_update_mode(val->val.u8);
+                TRACE(TRACE_FAN_WRITE, 1, val->val.u8);
+                app_driver_request_fan_target(true, val->val.u8);
 
             } else if (attribute_id == FanControl::Attributes::PercentSetting::Id
                 || attribute_id == FanControl::Attributes::SpeedSetting::Id) {
@@ -420,8 +405,20 @@ esp_err_t app_driver_attribute_update(uint16_t endpoint_id, uint32_t cluster_id,
                     return err;
                 }
 
-                app_driver_update_fan_speed(percentage);
+                TRACE(TRACE_FAN_WRITE, 0, percentage);
+                app_driver_request_fan_target(false, percentage);
+            } else {
+                return err;
+            }
+
+            uint32_t elapsed_us = esp_timer_get_time() - start_us;
+            taskENTER_CRITICAL(&fan_write_stats_lock);
+            fan_write_stats.received++;
+            fan_write_stats.callback_total_us += elapsed_us;
+            if (elapsed_us > fan_write_stats.callback_max_us) {
+                fan_write_stats.callback_max_us = elapsed_us;
             }
+            taskEXIT_CRITICAL(&fan_write_stats_lock);
         }
     }
 
@@ -429,30 +426,96 @@ esp_err_t app_driver_attribute_update(uint16_t endpoint_id, uint32_t cluster_id,
 }
 
 
-void app_driver_event_loop() {
-    // TODO replace with FreeRTOS task that reads sensor
-    // app_driver_update_air_quality();
+// Set while the factory reset countdown plays
+static volatile bool reset_pending;
+
+static void factory_reset_done(bool completed) {
+    reset_pending = false;
+    if (completed) {
+        esp_matter::factory_reset();
+    } else {
+        ESP_LOGI(TAG, "Factory reset aborted");
+    }
+}
 
+void app_driver_event_loop() {
     ButtonEvent event;
     while (xQueueReceive(button_queue, &event, portMAX_DELAY) == pdPASS) {
-        ESP_LOGI(TAG, "Button pressed (pin: %i, longPress: %i)", event.pin, event.longPress);
+        capture_button(&event);
+        if (reset_pending) {
+            // Letting go of the button or pressing any other one aborts the reset
+            if (!event.released || event.pin == BUTTON_BRIGHTNESS) {
+                sequencer_cancel();
+                buzzer_beep();
+            }
+            continue;
+        }
+        if (event.released) {
+            continue;
+        }
 
         if (event.longPress == false) {
             app_driver_buttons_callback(event.pin);
-        } else {
-            if (event.pin == BUTTON_BRIGHTNESS) {
-                led_set_brightness(3);
-                buzzer_beep();
+        } else if (event.pin == BUTTON_BRIGHTNESS) {
+            ESP_LOGW(TAG, "Factory reset in 3 s, release the button to abort");
+            reset_pending = true;
+            sequencer_play(&seq_reset_countdown, factory_reset_done);
+        } else if (event.pin == BUTTON_MODE) {
+            ESP_LOGI(TAG, "Motor calibration requested");
+            fan_cal_start();
+        }
+    }
+}
 
-                for (int i=0; i<3; i++) {
-                    led_rgb_set(255,0,0);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    led_rgb_set(0,0,0);
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                }
-                
-                esp_matter::factory_reset();
-            }
+static esp_err_t auto_strategy_handler(int argc, char **argv) {
+    if (argc > 0) {
+        uint8_t strategy;
+        if (strcmp(argv[0], "staircase") == 0) {
+            strategy = AUTO_STRATEGY_STAIRCASE;
+        } else if (strcmp(argv[0], "predictive") == 0) {
+            strategy = AUTO_STRATEGY_PREDICTIVE;
+        } else {
+            return ESP_ERR_INVALID_ARG;
         }
+        xSemaphoreTake(state_mutex, portMAX_DELAY);
+        auto_control.strategy = strategy;
+        xSemaphoreGive(state_mutex);
     }
-}
\ No newline at end of file
+
+    xSemaphoreTake(state_mutex, portMAX_DELAY);
+    bool predictive = auto_control.strategy == AUTO_STRATEGY_PREDICTIVE;
+    int32_t trend = auto_control_trend(&auto_control);
+    uint8_t percentage = state.current_auto_percentage;
+    xSemaphoreGive(state_mutex);
+
+    printf("strategy: %s, trend: %ld ug/m3/min, auto percentage: %u\n",
+           predictive ? "predictive" : "staircase", (long)trend, percentage);
+    return ESP_OK;
+}
+
+static esp_err_t fan_writes_handler(int argc, char **argv) {
+    taskENTER_CRITICAL(&fan_write_stats_lock);
+    FanWriteStats stats = fan_write_stats;
+    taskEXIT_CRITICAL(&fan_write_stats_lock);
+    uint32_t avg_us = stats.received > 0 ? stats.callback_total_us / stats.received : 0;
+    printf("coalescing: %s, received: %lu, applied: %lu, callback avg: %lu us, max: %lu us\n",
+           FAN_WRITE_COALESCE ? "on" : "off", (unsigned long)stats.received, (unsigned long)stats.applied,
+           (unsigned long)avg_us, (unsigned long)stats.callback_max_us);
+    return ESP_OK;
+}
+
+void app_driver_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "auto-strategy",
+            .description = "Show or set the auto mode strategy. Usage: auto-strategy [staircase|predictive].",
+            .handler = auto_strategy_handler,
+        },
+        {
+            .name = "fan-writes",
+            .description = "Show Matter fan write statistics and time spent in the Matter callback.",
+            .handler = fan_writes_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
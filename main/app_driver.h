@@ -68,6 +68,11 @@ void app_driver_update_air_quality();
 
 void app_driver_hw_init();
 
+// Refresh the Wi-Fi indicator after a connectivity or commissioning change
+void app_driver_wireless_changed();
+
 void app_driver_set_defaults();
 
 void app_driver_event_loop();
+
+void app_driver_register_commands();
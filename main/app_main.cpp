@@ -19,6 +19,22 @@
 #include <common_macros.h>
 #include <app_driver.h>
 #include <app_reset.h>
+#include "diag.h"
+#include "app_console.h"
+#include "pm_history.h"
+#include "tasks.h"
+#include "attributes.h"
+#include "sequencer.h"
+#include "fan_cal.h"
+#include "trace.h"
+#include "capture.h"
+#include "diag_logs.h"
+#include "log_ring.h"
+#include "wifi_fast.h"
+#include "power_mgmt.h"
+#include "energy.h"
+#include "ota.h"
+#include "metrics_http.h"
 
 #include <app/server/CommissioningWindowManager.h> 
 #include <app/server/Server.h>
@@ -44,8 +60,13 @@ static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
         ESP_LOGI(TAG, "Interface IP Address changed");
         break;
 
+    case chip::DeviceLayer::DeviceEventType::kWiFiConnectivityChange:
+        app_driver_wireless_changed();
+        break;
+
     case chip::DeviceLayer::DeviceEventType::kCommissioningComplete:
         ESP_LOGI(TAG, "Commissioning complete");
+        sequencer_play(&seq_commissioned, NULL);
         break;
 
     case chip::DeviceLayer::DeviceEventType::kFailSafeTimerExpired:
@@ -63,11 +84,13 @@ static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowOpened:
         ESP_LOGI(TAG, "Commissioning window opened");
         device_commisioning = 1;
+        app_driver_wireless_changed();
         break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowClosed:
         ESP_LOGI(TAG, "Commissioning window closed");
         device_commisioning = 0;
+        app_driver_wireless_changed();
         break;
 
     case chip::DeviceLayer::DeviceEventType::kFabricRemoved:
@@ -137,6 +160,12 @@ extern "C" void app_main()
     /* Initialize the ESP NVS layer */
     nvs_flash_init();
 
+    // Keep a copy of the log output from here on
+    log_ring_init();
+
+    // Before the drivers, they take PM locks as soon as they start
+    power_mgmt_init();
+
     // Initialize hardware
     app_driver_hw_init();
 
@@ -144,6 +173,10 @@ extern "C" void app_main()
     node::config_t node_config;
     node_t *node = node::create(&node_config, app_attribute_update_cb, app_identification_cb);
     ABORT_APP_ON_FAILURE(node != nullptr, ESP_LOGE(TAG, "Failed to create Matter node"));
+    err = diag_logs_create(node);
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to add diagnostic logs cluster"));
+    err = ota_create(node);
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to add OTA requestor cluster"));
 
     // Air purifier endpoint
     air_purifier::config_t air_purifier_config;
@@ -165,19 +198,50 @@ extern "C" void app_main()
     endpoint_t *air_quality_sensor_endpoint = air_quality_sensor::create(node, &air_quality_sensor_config, ENDPOINT_FLAG_NONE, NULL);
     ABORT_APP_ON_FAILURE(air_quality_sensor_endpoint != nullptr, ESP_LOGE(TAG, "Failed to add air quality cluster"));
     air_quality_sensor_endpoint_id = endpoint::get_id(air_quality_sensor_endpoint);
+    err = diag_create(air_quality_sensor_endpoint);
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to add diagnostics cluster"));
     ESP_LOGI(TAG, "Air quality sensor created with endpoint_id %d", air_quality_sensor_endpoint_id);
 
+    // Estimated power and energy on their own endpoint
+    err = energy_create(node);
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to add electrical sensor endpoint"));
+
+    err = attr_init(air_purifier_endpoint_id, air_quality_sensor_endpoint_id);
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to resolve attribute handles"));
+
+
+    // Before Matter brings the station up
+    wifi_fast_init();
 
     /* Matter start */
     err = esp_matter::start(app_event_cb);
     ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to start Matter, err:%d", err));
 
+    power_mgmt_start();
+    ota_init();
+    metrics_http_start();
+
     /* Starting driver with default values */
     app_driver_set_defaults();
 
+    // The button loop at the end of app_main runs in this task
+    app_task_adopt_current(APP_TASK_BUTTONS);
+    app_task_log_layout();
+    app_task_start_net_stress();
+
 #if CONFIG_ENABLE_CHIP_SHELL
     esp_matter::console::diagnostics_register_commands();
     esp_matter::console::wifi_register_commands();
+    app_console_init();
+    pm_history_register_commands();
+    app_driver_register_commands();
+    app_task_register_commands();
+    fan_cal_register_commands();
+    trace_register_commands();
+    capture_register_commands();
+    wifi_fast_register_commands();
+    power_mgmt_register_commands();
+    energy_register_commands();
     esp_matter::console::init();
 #endif
 
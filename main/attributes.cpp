@@ -0,0 +1,134 @@
+#include "attributes.h"
+
+#include <esp_log.h>
+#include <app/reporting/reporting.h>
+
+using namespace chip::app::Clusters;
+using namespace esp_matter;
+using FanControl::FanModeEnum;
+using AirQuality::AirQualityEnum;
+
+static const char *TAG = "attributes";
+
+struct attr_handle_t {
+    attribute_t *attribute;
+    uint16_t endpoint_id;
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+};
+
+static attr_handle_t fan_mode;
+static attr_handle_t percent_setting;
+static attr_handle_t percent_current;
+static attr_handle_t speed_setting;
+static attr_handle_t speed_current;
+static attr_handle_t air_quality;
+
+static attr_report_counts_t report_counts;
+
+
+static esp_err_t attr_resolve(attr_handle_t *handle, uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id) {
+    endpoint_t *endpoint = endpoint::get(node::get(), endpoint_id);
+    cluster_t *cluster = cluster::get(endpoint, cluster_id);
+    handle->attribute = attribute::get(cluster, attribute_id);
+    handle->endpoint_id = endpoint_id;
+    handle->cluster_id = cluster_id;
+    handle->attribute_id = attribute_id;
+
+    if (handle->attribute == nullptr) {
+        ESP_LOGE(TAG, "Attribute 0x%08lx of cluster 0x%08lx on endpoint %u not found",
+                 (unsigned long)attribute_id, (unsigned long)cluster_id, endpoint_id);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t attr_init(uint16_t air_purifier_endpoint_id, uint16_t air_quality_sensor_endpoint_id) {
+    using namespace FanControl::Attributes;
+
+    esp_err_t err = ESP_OK;
+    err |= attr_resolve(&fan_mode, air_purifier_endpoint_id, FanControl::Id, FanMode::Id);
+    err |= attr_resolve(&percent_setting, air_purifier_endpoint_id, FanControl::Id, PercentSetting::Id);
+    err |= attr_resolve(&percent_current, air_purifier_endpoint_id, FanControl::Id, PercentCurrent::Id);
+    err |= attr_resolve(&speed_setting, air_purifier_endpoint_id, FanControl::Id, SpeedSetting::Id);
+    err |= attr_resolve(&speed_current, air_purifier_endpoint_id, FanControl::Id, SpeedCurrent::Id);
+    err |= attr_resolve(&air_quality, air_quality_sensor_endpoint_id, AirQuality::Id, AirQuality::Attributes::AirQuality::Id);
+    return err == ESP_OK ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static uint8_t attr_get_u8(const attr_handle_t *handle) {
+    esp_matter_attr_val_t val;
+    attribute::get_val(handle->attribute, &val);
+    return val.val.u8;
+}
+
+// Same as attribute::report(), without looking the attribute up again
+static void attr_report(const attr_handle_t *handle, esp_matter_attr_val_t *val) {
+    lock::status_t lock_status = lock::chip_stack_lock(portMAX_DELAY);
+    if (lock_status == lock::FAILED) {
+        ESP_LOGE(TAG, "Could not get the CHIP stack lock");
+        return;
+    }
+    if (attribute::set_val(handle->attribute, val) == ESP_OK) {
+        MatterReportingAttributeChangeCallback(handle->endpoint_id, handle->cluster_id, handle->attribute_id);
+        attr_count_report(true);
+    }
+    if (lock_status == lock::SUCCESS) {
+        lock::chip_stack_unlock();
+    }
+}
+
+void attr_count_report(bool sent) {
+    __atomic_fetch_add(sent ? &report_counts.sent : &report_counts.suppressed, 1, __ATOMIC_RELAXED);
+}
+
+void attr_get_report_counts(attr_report_counts_t *counts) {
+    counts->sent = __atomic_load_n(&report_counts.sent, __ATOMIC_RELAXED);
+    counts->suppressed = __atomic_load_n(&report_counts.suppressed, __ATOMIC_RELAXED);
+}
+
+static esp_err_t attr_update(const attr_handle_t *handle, esp_matter_attr_val_t *val) {
+    return attribute::update(handle->endpoint_id, handle->cluster_id, handle->attribute_id, val);
+}
+
+FanModeEnum attr_get_fan_mode() {
+    return static_cast<FanModeEnum>(attr_get_u8(&fan_mode));
+}
+
+uint8_t attr_get_speed_setting() {
+    return attr_get_u8(&speed_setting);
+}
+
+uint8_t attr_get_percent_setting() {
+    return attr_get_u8(&percent_setting);
+}
+
+void attr_report_fan_mode(FanModeEnum mode) {
+    esp_matter_attr_val_t val = esp_matter_enum8(static_cast<uint8_t>(mode));
+    attr_report(&fan_mode, &val);
+}
+
+void attr_report_percent_current(uint8_t percentage) {
+    esp_matter_attr_val_t val = esp_matter_uint8(percentage);
+    attr_report(&percent_current, &val);
+}
+
+void attr_report_speed_current(uint8_t speed) {
+    esp_matter_attr_val_t val = esp_matter_uint8(speed);
+    attr_report(&speed_current, &val);
+}
+
+void attr_report_air_quality(AirQualityEnum value) {
+    esp_matter_attr_val_t val = esp_matter_enum8(static_cast<uint8_t>(value));
+    attr_report(&air_quality, &val);
+}
+
+esp_err_t attr_update_fan_mode(FanModeEnum mode) {
+    esp_matter_attr_val_t val = esp_matter_enum8(static_cast<uint8_t>(mode));
+    return attr_update(&fan_mode, &val);
+}
+
+esp_err_t attr_update_speed_setting(uint8_t speed) {
+    esp_matter_attr_val_t val = esp_matter_uint8(speed);
+    return attr_update(&speed_setting, &val);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+#include <esp_matter_cluster.h>
+
+#include <cstdint>
+
+// Typed access to the attributes the driver touches all the time. The handles
+// are looked up once, the get/report calls skip the node/endpoint/cluster walk.
+
+// Resolve the attribute handles, call once after the endpoints are created
+esp_err_t attr_init(uint16_t air_purifier_endpoint_id, uint16_t air_quality_sensor_endpoint_id);
+
+// Reads from the Matter DB
+chip::app::Clusters::FanControl::FanModeEnum attr_get_fan_mode();
+uint8_t attr_get_speed_setting();
+uint8_t attr_get_percent_setting();
+
+// Set the value in the Matter DB and notify subscribers, no write callbacks
+void attr_report_fan_mode(chip::app::Clusters::FanControl::FanModeEnum mode);
+void attr_report_percent_current(uint8_t percentage);
+void attr_report_speed_current(uint8_t speed);
+void attr_report_air_quality(chip::app::Clusters::AirQuality::AirQualityEnum air_quality);
+
+// Changed values reported to the Matter stack, and ones held back because
+// they moved less than their reporting threshold. Unchanged values count as
+// neither.
+struct attr_report_counts_t {
+    uint32_t sent;
+    uint32_t suppressed;
+};
+
+// Count a changed value as reported or held back, for the callers that report
+// outside attr_report_*
+void attr_count_report(bool sent);
+
+void attr_get_report_counts(attr_report_counts_t *counts);
+
+// Go through the regular write path, app_driver_attribute_update gets called
+esp_err_t attr_update_fan_mode(chip::app::Clusters::FanControl::FanModeEnum mode);
+esp_err_t attr_update_speed_setting(uint8_t speed);
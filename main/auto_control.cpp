@@ -0,0 +1,128 @@
+#include "auto_control.h"
+#include "hw_conf.h"
+
+
+// According to Chinese IAQI standard (also used by Xiaomi in original firmware)
+uint8_t pm25_to_aq_level(uint16_t pm25) {
+    if (pm25 < 35) {
+        return AQ_GOOD;
+    }
+    if (pm25 < 75) {
+        return AQ_FAIR;
+    }
+    if (pm25 < 115) {
+        return AQ_MODERATE;
+    }
+    if (pm25 < 150) {
+        return AQ_POOR;
+    }
+    if (pm25 <= 500) {
+        return AQ_VERY_POOR;
+    }
+
+    return AQ_EXTREMELY_POOR;
+}
+
+uint8_t aq_level_to_percentage(uint8_t aq_level) {
+    switch (aq_level) {
+        case AQ_GOOD:
+            return AUTO_GOOD_PERCENT;
+        case AQ_FAIR:
+            return AUTO_FAIR_PERCENT;
+        case AQ_MODERATE:
+            return AUTO_MODERATE_PERCENT;
+        case AQ_POOR:
+            return AUTO_POOR_PERCENT;
+        case AQ_VERY_POOR:
+            return AUTO_VPOOR_PERCENT;
+        case AQ_EXTREMELY_POOR:
+            return AUTO_XPOOR_PERCENT;
+        default:
+            return AUTO_UNKNOWN_PERCENT;
+    }
+}
+
+void auto_control_init(auto_control_t *control, uint8_t strategy) {
+    control->strategy = strategy;
+    for (uint8_t level = AQ_UNKNOWN; level <= AQ_EXTREMELY_POOR; level++) {
+        control->level_percentage[level] = aq_level_to_percentage(level);
+    }
+    control->count = 0;
+    control->pos = 0;
+}
+
+// Least squares slope numerator and denominator, in ug/m3 per sample
+static void trend_fraction(const auto_control_t *control, int64_t *num, int64_t *den) {
+    const int64_t n = AUTO_TREND_WINDOW_S;
+    int64_t sum_y = 0;
+    int64_t sum_xy = 0;
+
+    // Oldest sample has x = 0
+    for (uint8_t i = 0; i < n; i++) {
+        int64_t y = control->samples[(control->pos + i) % n];
+        sum_y += y;
+        sum_xy += i * y;
+    }
+    int64_t sum_x = n * (n - 1) / 2;
+    int64_t sum_xx = n * (n - 1) * (2 * n - 1) / 6;
+
+    *num = n * sum_xy - sum_x * sum_y;
+    *den = n * sum_xx - sum_x * sum_x;
+}
+
+int32_t auto_control_trend(const auto_control_t *control) {
+    if (control->count < AUTO_TREND_WINDOW_S) {
+        return 0;
+    }
+    int64_t num, den;
+    trend_fraction(control, &num, &den);
+    return static_cast<int32_t>(num * 60 / den);
+}
+
+static uint8_t predicted_level(const auto_control_t *control, uint8_t aq_level, uint16_t pm25) {
+    int64_t num, den;
+    trend_fraction(control, &num, &den);
+
+    // Ignore slow drift and sensor noise
+    if (num * 60 > -AUTO_TREND_DEADBAND * den && num * 60 < AUTO_TREND_DEADBAND * den) {
+        return aq_level;
+    }
+
+    int64_t predicted = pm25 + num * AUTO_PREDICT_HORIZON_S / den;
+    if (predicted < 0) {
+        predicted = 0;
+    }
+    if (predicted > UINT16_MAX) {
+        predicted = UINT16_MAX;
+    }
+    uint8_t level = pm25_to_aq_level(static_cast<uint16_t>(predicted));
+
+    // Boost ahead of a rising event, but relax only one level at a time
+    if (level > aq_level + AUTO_PREDICT_MAX_BOOST) {
+        level = aq_level + AUTO_PREDICT_MAX_BOOST;
+    }
+    if (level + 1 < aq_level) {
+        level = aq_level - 1;
+    }
+    return level;
+}
+
+uint8_t auto_control_update(auto_control_t *control, uint8_t aq_level, uint16_t pm25) {
+    if (aq_level == AQ_UNKNOWN || aq_level > AQ_EXTREMELY_POOR) {
+        // The trend assumes samples 1 s apart, start over after a sensor gap
+        control->count = 0;
+        control->pos = 0;
+        return control->level_percentage[AQ_UNKNOWN];
+    }
+
+    control->samples[control->pos] = pm25;
+    control->pos = (control->pos + 1) % AUTO_TREND_WINDOW_S;
+    if (control->count < AUTO_TREND_WINDOW_S) {
+        control->count++;
+    }
+
+    if (control->strategy != AUTO_STRATEGY_PREDICTIVE || control->count < AUTO_TREND_WINDOW_S) {
+        return control->level_percentage[aq_level];
+    }
+    return control->level_percentage[predicted_level(control, aq_level, pm25)];
+}
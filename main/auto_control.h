@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// Same values as chip::app::Clusters::AirQuality::AirQualityEnum,
+// kept here so the controller builds without the Matter SDK
+enum aq_level_t : uint8_t {
+    AQ_UNKNOWN = 0,
+    AQ_GOOD = 1,
+    AQ_FAIR = 2,
+    AQ_MODERATE = 3,
+    AQ_POOR = 4,
+    AQ_VERY_POOR = 5,
+    AQ_EXTREMELY_POOR = 6,
+};
+
+// Fan speed follows the current air quality level
+#define AUTO_STRATEGY_STAIRCASE  0
+// Fan speed follows the level predicted from the PM2.5 trend
+#define AUTO_STRATEGY_PREDICTIVE 1
+
+#define AUTO_TREND_MAX_WINDOW 60
+
+struct auto_control_t {
+    uint8_t strategy;
+    // Fan percentage per aq_level_t, defaults to the AUTO_*_PERCENT values
+    uint8_t level_percentage[AQ_EXTREMELY_POOR + 1];
+    // Filtered PM2.5, one sample per second
+    uint16_t samples[AUTO_TREND_MAX_WINDOW];
+    uint8_t count;
+    uint8_t pos;
+};
+
+uint8_t pm25_to_aq_level(uint16_t pm25);
+
+// The plain staircase used by auto mode
+uint8_t aq_level_to_percentage(uint8_t aq_level);
+
+void auto_control_init(auto_control_t *control, uint8_t strategy);
+
+// Feed one sensor reading (once per second), returns the fan percentage.
+// An AQ_UNKNOWN reading clears the trend window.
+uint8_t auto_control_update(auto_control_t *control, uint8_t aq_level, uint16_t pm25);
+
+// PM2.5 slope over the trend window in ug/m3 per minute, 0 until the window is full
+int32_t auto_control_trend(const auto_control_t *control);
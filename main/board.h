@@ -0,0 +1,365 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+// Board descriptors: pins and peripheral assignments per target, constexpr so
+// every use folds into a constant and nothing is looked up at run time. The
+// descriptor for the build target is BOARD, hw_conf.h maps the GPIO_* and
+// LEDC_* names onto it. board_check() validates a descriptor against what
+// its chip has. tools/host/board_check builds every descriptor, so a bad pin
+// on a target nobody builds for still fails.
+
+enum board_target_t : uint8_t {
+    BOARD_TARGET_ESP32,
+    BOARD_TARGET_ESP32S3,
+    BOARD_TARGET_ESP32C6,
+    BOARD_TARGET_COUNT,
+};
+
+// What a chip offers, for the checks only
+struct board_soc_t {
+    const char *name;
+    // GPIOs that exist, that are input only, and that belong to flash, PSRAM or the console
+    uint64_t gpio_mask;
+    uint64_t input_only_mask;
+    uint64_t reserved_mask;
+    bool ledc_high_speed;
+    uint8_t ledc_channels;
+    uint8_t ledc_timers;
+    uint8_t uart_ports;
+    uint8_t i2c_ports;
+};
+
+constexpr uint64_t board_gpio_range(int first, int last) {
+    return ((last >= 63 ? ~0ULL : (1ULL << (last + 1)) - 1)) & ~((1ULL << first) - 1);
+}
+
+constexpr board_soc_t board_socs[BOARD_TARGET_COUNT] = {
+    {
+        .name = "esp32",
+        .gpio_mask = board_gpio_range(0, 39) & ~(1ULL << 20 | 1ULL << 24 | board_gpio_range(28, 31)),
+        .input_only_mask = board_gpio_range(34, 39),
+        // UART0 console, SPI flash
+        .reserved_mask = 1ULL << 1 | 1ULL << 3 | board_gpio_range(6, 11),
+        .ledc_high_speed = true,
+        .ledc_channels = 8,
+        .ledc_timers = 4,
+        .uart_ports = 3,
+        .i2c_ports = 2,
+    },
+    {
+        .name = "esp32s3",
+        .gpio_mask = board_gpio_range(0, 21) | board_gpio_range(26, 48),
+        .input_only_mask = 0,
+        // UART0 console, USB, SPI flash and octal PSRAM
+        .reserved_mask = 1ULL << 43 | 1ULL << 44 | 1ULL << 19 | 1ULL << 20 | board_gpio_range(26, 37),
+        .ledc_high_speed = false,
+        .ledc_channels = 8,
+        .ledc_timers = 4,
+        .uart_ports = 3,
+        .i2c_ports = 2,
+    },
+    {
+        .name = "esp32c6",
+        .gpio_mask = board_gpio_range(0, 30),
+        .input_only_mask = 0,
+        // USB serial/JTAG, UART0 console, SPI flash
+        .reserved_mask = 1ULL << 12 | 1ULL << 13 | 1ULL << 16 | 1ULL << 17 | board_gpio_range(24, 30),
+        .ledc_high_speed = false,
+        .ledc_channels = 6,
+        .ledc_timers = 4,
+        .uart_ports = 2,
+        .i2c_ports = 1,
+    },
+};
+
+// Pin not connected on this board
+#define BOARD_NC (-1)
+
+struct board_t {
+    const char *name;
+    board_target_t target;
+
+    // GPIOs, outputs unless noted
+    int8_t led_green;
+    int8_t led_orange;
+    int8_t led_red;
+    int8_t buzzer;
+    // Inputs, active low
+    int8_t btn_power;
+    int8_t btn_brightness;
+    int8_t btn_mode;
+    // I2C to the status LED and button backlight controller
+    int8_t led_sda;
+    int8_t led_scl;
+    // Not used by the firmware
+    int8_t eeprom_sda;
+    int8_t eeprom_scl;
+    int8_t motor_pwm;
+    int8_t motor_brk;
+    // Input, tachometer
+    int8_t motor_fg;
+    int8_t motor_5v;
+    int8_t pms_rx;
+    int8_t pms_tx;
+    int8_t pms_5v;
+    // Level on pms_5v that powers the sensor
+    uint8_t pms_5v_on_level;
+
+    // Motor and RGB PWM run in high speed mode where the chip has it, the buzzer always in low speed
+    bool ledc_high_speed;
+    uint8_t ledc_timer_motor;
+    uint8_t ledc_timer_rgb;
+    uint8_t ledc_timer_buzzer;
+    uint8_t ledc_channel_motor;
+    uint8_t ledc_channel_green;
+    uint8_t ledc_channel_orange;
+    uint8_t ledc_channel_red;
+    uint8_t ledc_channel_buzzer;
+
+    uint8_t uart_pms;
+    uint8_t i2c_led;
+};
+
+// The original purifier board
+constexpr board_t board_esp32 = {
+    .name = "purifier-esp32",
+    .target = BOARD_TARGET_ESP32,
+    .led_green = 33,
+    .led_orange = 32,
+    .led_red = 21,
+    .buzzer = 4,
+    .btn_power = 19,
+    .btn_brightness = 18,
+    .btn_mode = 5,
+    .led_sda = 14,
+    .led_scl = 27,
+    .eeprom_sda = 36,
+    .eeprom_scl = 37,
+    .motor_pwm = 26,
+    .motor_brk = 2,
+    .motor_fg = 34,
+    .motor_5v = 15,
+    .pms_rx = 16,
+    .pms_tx = 17,
+    .pms_5v = 13,
+    .pms_5v_on_level = 0,
+    .ledc_high_speed = true,
+    .ledc_timer_motor = 0,
+    .ledc_timer_rgb = 1,
+    .ledc_timer_buzzer = 2,
+    .ledc_channel_motor = 0,
+    .ledc_channel_green = 1,
+    .ledc_channel_orange = 2,
+    .ledc_channel_red = 3,
+    .ledc_channel_buzzer = 4,
+    .uart_pms = 1,
+    .i2c_led = 0,
+};
+
+// Same peripherals wired to an ESP32-S3-DevKitC-1, more RAM for logs and traces
+constexpr board_t board_esp32s3 = {
+    .name = "devkit-esp32s3",
+    .target = BOARD_TARGET_ESP32S3,
+    .led_green = 4,
+    .led_orange = 5,
+    .led_red = 6,
+    .buzzer = 7,
+    .btn_power = 15,
+    .btn_brightness = 16,
+    .btn_mode = 17,
+    .led_sda = 8,
+    .led_scl = 9,
+    .eeprom_sda = BOARD_NC,
+    .eeprom_scl = BOARD_NC,
+    .motor_pwm = 10,
+    .motor_brk = 11,
+    .motor_fg = 12,
+    .motor_5v = 13,
+    .pms_rx = 18,
+    .pms_tx = 21,
+    .pms_5v = 14,
+    .pms_5v_on_level = 0,
+    .ledc_high_speed = false,
+    .ledc_timer_motor = 0,
+    .ledc_timer_rgb = 1,
+    .ledc_timer_buzzer = 2,
+    .ledc_channel_motor = 0,
+    .ledc_channel_green = 1,
+    .ledc_channel_orange = 2,
+    .ledc_channel_red = 3,
+    .ledc_channel_buzzer = 4,
+    .uart_pms = 1,
+    .i2c_led = 0,
+};
+
+// Same peripherals wired to an ESP32-C6-DevKitC-1, for Matter over Thread
+constexpr board_t board_esp32c6 = {
+    .name = "devkit-esp32c6",
+    .target = BOARD_TARGET_ESP32C6,
+    .led_green = 18,
+    .led_orange = 19,
+    .led_red = 20,
+    .buzzer = 21,
+    .btn_power = 2,
+    .btn_brightness = 3,
+    .btn_mode = 22,
+    .led_sda = 6,
+    .led_scl = 7,
+    .eeprom_sda = BOARD_NC,
+    .eeprom_scl = BOARD_NC,
+    .motor_pwm = 0,
+    .motor_brk = 1,
+    .motor_fg = 23,
+    .motor_5v = 8,
+    .pms_rx = 4,
+    .pms_tx = 5,
+    .pms_5v = 15,
+    .pms_5v_on_level = 0,
+    .ledc_high_speed = false,
+    .ledc_timer_motor = 0,
+    .ledc_timer_rgb = 1,
+    .ledc_timer_buzzer = 2,
+    .ledc_channel_motor = 0,
+    .ledc_channel_green = 1,
+    .ledc_channel_orange = 2,
+    .ledc_channel_red = 3,
+    .ledc_channel_buzzer = 4,
+    .uart_pms = 1,
+    .i2c_led = 0,
+};
+
+// Every descriptor, for the host check
+constexpr const board_t *board_all[] = { &board_esp32, &board_esp32s3, &board_esp32c6 };
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#define BOARD board_esp32s3
+#elif defined(CONFIG_IDF_TARGET_ESP32C6)
+#define BOARD board_esp32c6
+#elif defined(CONFIG_IDF_TARGET_ESP32) || !defined(ESP_PLATFORM)
+#define BOARD board_esp32
+#else
+#error "No board descriptor for this target, add one to board.h"
+#endif
+
+
+// Adds a pin to the used set, false if it is not usable or already taken
+constexpr bool board_claim_pin(const board_soc_t &soc, uint64_t *used, int8_t pin, bool output) {
+    if (pin == BOARD_NC) {
+        return true;
+    }
+    if (pin < 0 || pin > 63) {
+        return false;
+    }
+    uint64_t bit = 1ULL << pin;
+    if (!(soc.gpio_mask & bit) || (soc.reserved_mask & bit) || (*used & bit)) {
+        return false;
+    }
+    if (output && (soc.input_only_mask & bit)) {
+        return false;
+    }
+    *used |= bit;
+    return true;
+}
+
+// NULL when the descriptor fits its chip, otherwise what is wrong
+constexpr const char *board_check(const board_t &b) {
+    if (b.target >= BOARD_TARGET_COUNT) {
+        return "unknown target";
+    }
+    const board_soc_t &soc = board_socs[b.target];
+    uint64_t used = 0;
+
+    const int8_t outputs[] = {
+        b.led_green, b.led_orange, b.led_red, b.buzzer, b.led_sda, b.led_scl,
+        b.motor_pwm, b.motor_brk, b.motor_5v, b.pms_tx, b.pms_5v,
+    };
+    for (int8_t pin : outputs) {
+        if (!board_claim_pin(soc, &used, pin, true)) {
+            return "output pin missing, reserved, input only or used twice";
+        }
+    }
+    // The EEPROM bus is not driven, its pins only have to be free
+    const int8_t inputs[] = {
+        b.btn_power, b.btn_brightness, b.btn_mode, b.motor_fg, b.pms_rx, b.eeprom_sda, b.eeprom_scl,
+    };
+    for (int8_t pin : inputs) {
+        if (!board_claim_pin(soc, &used, pin, false)) {
+            return "input pin missing, reserved or used twice";
+        }
+    }
+    const int8_t required[] = {
+        b.led_green, b.led_orange, b.led_red, b.buzzer, b.btn_power, b.btn_brightness, b.btn_mode,
+        b.led_sda, b.led_scl, b.motor_pwm, b.motor_brk, b.motor_fg, b.motor_5v, b.pms_rx, b.pms_tx, b.pms_5v,
+    };
+    for (int8_t pin : required) {
+        if (pin == BOARD_NC) {
+            return "only the EEPROM pins may be left unconnected";
+        }
+    }
+
+    if (b.ledc_high_speed && !soc.ledc_high_speed) {
+        return "chip has no LEDC high speed mode";
+    }
+    const uint8_t timers[] = { b.ledc_timer_motor, b.ledc_timer_rgb, b.ledc_timer_buzzer };
+    for (uint8_t timer : timers) {
+        if (timer >= soc.ledc_timers) {
+            return "LEDC timer out of range";
+        }
+    }
+    // Motor and RGB share a speed mode, and with it timers and channels
+    if (b.ledc_timer_motor == b.ledc_timer_rgb) {
+        return "motor and RGB need their own LEDC timers";
+    }
+    const uint8_t channels[] = {
+        b.ledc_channel_motor, b.ledc_channel_green, b.ledc_channel_orange, b.ledc_channel_red,
+    };
+    uint32_t channels_used = 0;
+    for (uint8_t channel : channels) {
+        if (channel >= soc.ledc_channels || (channels_used & 1u << channel)) {
+            return "LEDC channel out of range or used twice";
+        }
+        channels_used |= 1u << channel;
+    }
+    if (b.ledc_channel_buzzer >= soc.ledc_channels) {
+        return "LEDC channel out of range or used twice";
+    }
+    // Without high speed mode the buzzer shares the low speed timers and channels
+    if (!b.ledc_high_speed) {
+        if (b.ledc_timer_buzzer == b.ledc_timer_motor || b.ledc_timer_buzzer == b.ledc_timer_rgb) {
+            return "buzzer needs its own LEDC timer";
+        }
+        if (channels_used & 1u << b.ledc_channel_buzzer) {
+            return "LEDC channel out of range or used twice";
+        }
+    }
+
+    // UART0 is the console
+    if (b.uart_pms == 0 || b.uart_pms >= soc.uart_ports) {
+        return "PMS UART out of range";
+    }
+    if (b.i2c_led >= soc.i2c_ports) {
+        return "I2C port out of range";
+    }
+    return nullptr;
+}
+
+static_assert(board_check(BOARD) == nullptr, "Board descriptor does not fit its chip, run tools/host/board_check");
+
+#ifdef ESP_PLATFORM
+#include "hal/ledc_types.h"
+#include "soc/soc_caps.h"
+
+// Speed mode of the motor and RGB channels, LEDC_HIGH_SPEED_MODE only exists on chips that have it
+constexpr ledc_mode_t board_ledc_mode(const board_t &b) {
+#if SOC_LEDC_SUPPORT_HS_MODE
+    return b.ledc_high_speed ? LEDC_HIGH_SPEED_MODE : LEDC_LOW_SPEED_MODE;
+#else
+    return LEDC_LOW_SPEED_MODE;
+#endif
+}
+#endif
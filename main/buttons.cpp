@@ -1,5 +1,7 @@
 #include "hw_conf.h"
 #include "buttons.h"
+#include "trace.h"
+#include "power_mgmt.h"
 
 #include "driver/gpio.h"
 #include "esp_attr.h"
@@ -10,7 +12,7 @@
 #include "freertos/timers.h"
 
 
-#define QUEUE_LENGTH 4
+#define QUEUE_LENGTH 8
 #define QUEUE_ITEM_SIZE sizeof(ButtonEvent)
 #define LONG_PRESS_TIME_MS 7000
 
@@ -23,17 +25,30 @@ static TimerHandle_t powerButtonTimer;
 static TimerHandle_t brightnessButtonTimer;
 static TimerHandle_t modeButtonTimer;
 
+// Bit per GPIO of the buttons currently held down
+static uint32_t pressed_pins;
+
+static const gpio_num_t button_gpios[] = { GPIO_BTN_POWER, GPIO_BTN_BRIGHTNESS, GPIO_BTN_MODE };
+
 
 static void IRAM_ATTR gpio_isr_handler(void *arg) {
     uint8_t pin = (uint8_t)(uintptr_t)arg;
     // Active LOW
     bool pressed = !gpio_get_level(static_cast<gpio_num_t>(pin));
+    TRACE(TRACE_BUTTON, pin, pressed);
+
+    // Stay awake until every button is released
+    if (pressed) {
+        pressed_pins |= 1 << pin;
+    } else {
+        pressed_pins &= ~(1 << pin);
+    }
+    power_hold(POWER_LOCK_BUTTONS, pressed_pins != 0);
 
-    
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     if (pressed) {
-        ButtonEvent event = { .pin = pin, .longPress = false };
+        ButtonEvent event = { .pin = pin, .longPress = false, .released = false };
         xQueueSendFromISR(button_queue, &event, &xHigherPriorityTaskWoken);
 
         // Start the appropriate timer to detect a long press
@@ -51,6 +66,9 @@ static void IRAM_ATTR gpio_isr_handler(void *arg) {
                 break;
         }
     } else {
+        ButtonEvent event = { .pin = pin, .longPress = false, .released = true };
+        xQueueSendFromISR(button_queue, &event, &xHigherPriorityTaskWoken);
+
         // Stop the timer as soon as the button is released
         switch (pin) {
             case BUTTON_POWER:
@@ -74,7 +92,8 @@ static void IRAM_ATTR gpio_isr_handler(void *arg) {
 
 static void long_press_timer_callback(TimerHandle_t xTimer) {
     uint8_t pin = (uint8_t)(uintptr_t)pvTimerGetTimerID(xTimer);
-    ButtonEvent event = { .pin = pin, .longPress = true };
+    ButtonEvent event = { .pin = pin, .longPress = true, .released = false };
+    TRACE(TRACE_BUTTON, pin, 2);
 
     // Send the long press event to the queue
     xQueueSend(button_queue, &event, portMAX_DELAY);
@@ -110,4 +129,16 @@ void buttons_init() {
     powerButtonTimer = xTimerCreate("PowerButtonTimer", pdMS_TO_TICKS(LONG_PRESS_TIME_MS), pdFALSE, (void*) BUTTON_POWER, long_press_timer_callback);
     brightnessButtonTimer = xTimerCreate("BrightnessButtonTimer", pdMS_TO_TICKS(LONG_PRESS_TIME_MS), pdFALSE, (void*) BUTTON_BRIGHTNESS, long_press_timer_callback);
     modeButtonTimer = xTimerCreate("ModeButtonTimer", pdMS_TO_TICKS(LONG_PRESS_TIME_MS), pdFALSE, (void*) BUTTON_MODE, long_press_timer_callback);
-}
\ No newline at end of file
+}
+
+void buttons_set_wakeup(bool enable) {
+    for (gpio_num_t gpio : button_gpios) {
+        if (enable) {
+            // Replaces the edge interrupt type until wakeup is disabled again
+            gpio_wakeup_enable(gpio, GPIO_INTR_LOW_LEVEL);
+        } else {
+            gpio_wakeup_disable(gpio);
+            gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+        }
+    }
+}
@@ -19,9 +19,13 @@ extern QueueHandle_t button_queue;
 typedef struct {
     uint8_t pin;      // Button pin identifier
     bool longPress;   // True if long press, false if short press
+    bool released;    // True when the button was let go, longPress is false then
 } ButtonEvent;
 
 // Function prototypes
 void buttons_init();
+
+// Level wakeup from light sleep while enabled, edge interrupts otherwise
+void buttons_set_wakeup(bool enable);
 void button_task(void *pvParameters);
 
@@ -1,5 +1,7 @@
 #include "buzzer.h"
 #include "hw_conf.h"
+#include "tasks.h"
+#include "power_mgmt.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -10,7 +12,9 @@
 #define BUZZER_DUTY (1 << (BUZZER_DUTY_RES - 1))
 
 
-static void buzzer_beep_task(void *arg);
+static TaskHandle_t buzzer_task_handle;
+
+static void buzzer_task(void *arg);
 
 void buzzer_init() {
     // Configure the LEDC timer
@@ -34,24 +38,30 @@ void buzzer_init() {
         .hpoint         = 0
     };
     ledc_channel_config(&buzzer_channel);
+
+    app_task_create(APP_TASK_BUZZER, buzzer_task, NULL, &buzzer_task_handle);
 }
 
 void buzzer_beep() {
-    xTaskCreate(buzzer_beep_task, "buzzer_beep_task", 2048, NULL, 10, NULL);
+    xTaskNotifyGive(buzzer_task_handle);
 }
 
-static void buzzer_beep_task(void *arg) {
-    // Turn on the buzzer
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER, BUZZER_DUTY);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER);
+static void buzzer_task(void *arg) {
+    while (1) {
+        // Beeps requested while one is playing are merged into one
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-    // Wait for the beep duration
-    vTaskDelay(pdMS_TO_TICKS(BUZZER_BEEP_TIME_MS));
+        // Turn on the buzzer
+        power_hold(POWER_LOCK_BUZZER, true);
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER, BUZZER_DUTY);
+        ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER);
 
-    // Turn off the buzzer
-    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER, 0);
-    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER);
+        // Wait for the beep duration
+        vTaskDelay(pdMS_TO_TICKS(BUZZER_BEEP_TIME_MS));
 
-    // Delete the task as it's no longer needed
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+        // Turn off the buzzer
+        ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER, 0);
+        ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_BUZZER);
+        power_hold(POWER_LOCK_BUZZER, false);
+    }
+}
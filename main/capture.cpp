@@ -0,0 +1,125 @@
+#include "capture.h"
+#include "capture_ring.h"
+#include "app_console.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_timer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes per "C" line of the dump
+#define CAPTURE_LINE_BYTES 32
+
+static uint8_t capture_buf[CAPTURE_RING_SIZE];
+static capture_ring_t capture_ring = { .buf = capture_buf, .size = CAPTURE_RING_SIZE, .empty = true };
+static bool capture_enabled = CAPTURE_ENABLE;
+static portMUX_TYPE capture_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint32_t capture_time_ms() {
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+void capture_uart(const uint8_t *data, int len) {
+    if (!capture_enabled) {
+        return;
+    }
+    uint32_t now_ms = capture_time_ms();
+    taskENTER_CRITICAL(&capture_lock);
+    capture_ring_add_uart(&capture_ring, now_ms, data, len);
+    taskEXIT_CRITICAL(&capture_lock);
+}
+
+void capture_button(const ButtonEvent *event) {
+    if (!capture_enabled) {
+        return;
+    }
+    uint8_t flags = (event->longPress ? CAPTURE_FLAG_LONG : 0) | (event->released ? CAPTURE_FLAG_RELEASED : 0);
+    uint32_t now_ms = capture_time_ms();
+    taskENTER_CRITICAL(&capture_lock);
+    capture_ring_add_button(&capture_ring, now_ms, event->pin, flags);
+    taskEXIT_CRITICAL(&capture_lock);
+}
+
+static void capture_status() {
+    taskENTER_CRITICAL(&capture_lock);
+    uint32_t records = capture_ring.records;
+    uint32_t dropped = capture_ring.dropped;
+    uint32_t bytes = capture_ring.head - capture_ring.tail;
+    taskEXIT_CRITICAL(&capture_lock);
+    printf("capture %s, %lu records, %lu dropped, %lu/%u bytes\n", capture_enabled ? "on" : "off",
+           (unsigned long)records, (unsigned long)dropped, (unsigned long)bytes, CAPTURE_RING_SIZE);
+}
+
+// "H <start_ms> <len> <frame hex>" with the decoder state before the first
+// record, then the records as "C <hex>" lines
+static esp_err_t capture_dump() {
+    uint8_t *copy = static_cast<uint8_t *>(malloc(CAPTURE_RING_SIZE));
+    if (copy == NULL) {
+        printf("Not enough memory for the dump\n");
+        return ESP_ERR_NO_MEM;
+    }
+    // Copy under the lock so the records and the start state match, the print is slow
+    capture_state_t first;
+    taskENTER_CRITICAL(&capture_lock);
+    size_t len = capture_ring_copy(&capture_ring, capture_ring.tail, copy, CAPTURE_RING_SIZE);
+    uint32_t records = capture_ring.records;
+    uint32_t dropped = capture_ring.dropped;
+    first = capture_ring.first;
+    taskEXIT_CRITICAL(&capture_lock);
+
+    printf("# capture %lu records, %lu dropped, %u bytes\n", (unsigned long)records,
+           (unsigned long)dropped, (unsigned)len);
+    printf("H %lu %u ", (unsigned long)first.time_ms, first.len);
+    for (size_t i = 0; i < first.len && i < CAPTURE_UART_MAX; i++) {
+        printf("%02x", first.frame[i]);
+    }
+    printf("\n");
+    for (size_t pos = 0; pos < len; pos += CAPTURE_LINE_BYTES) {
+        printf("C ");
+        for (size_t i = pos; i < len && i < pos + CAPTURE_LINE_BYTES; i++) {
+            printf("%02x", copy[i]);
+        }
+        printf("\n");
+    }
+    printf("# end\n");
+    free(copy);
+    return ESP_OK;
+}
+
+
+static esp_err_t capture_handler(int argc, char **argv) {
+    if (argc == 0) {
+        capture_status();
+        return ESP_OK;
+    }
+    if (strcmp(argv[0], "start") == 0) {
+        capture_enabled = true;
+    } else if (strcmp(argv[0], "stop") == 0) {
+        capture_enabled = false;
+    } else if (strcmp(argv[0], "clear") == 0) {
+        taskENTER_CRITICAL(&capture_lock);
+        capture_ring_clear(&capture_ring);
+        taskEXIT_CRITICAL(&capture_lock);
+    } else if (strcmp(argv[0], "dump") == 0) {
+        return capture_dump();
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    capture_status();
+    return ESP_OK;
+}
+
+void capture_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "capture",
+            .description = "Record sensor UART reads and button events, replay with tools/host/capture_replay. "
+                           "Usage: capture [start|stop|clear|dump].",
+            .handler = capture_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
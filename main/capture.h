@@ -0,0 +1,17 @@
+#pragma once
+
+#include "hw_conf.h"
+#include "buttons.h"
+
+#include <cstdint>
+
+// Record of the raw sensor UART reads and button events, replayed on the host
+// with tools/host/capture_replay to reproduce field issues. Dumped as text
+// with "purifier capture dump", the records are in capture_ring.h.
+
+// From pms_task, len as returned by uart_read_bytes
+void capture_uart(const uint8_t *data, int len);
+
+void capture_button(const ButtonEvent *event);
+
+void capture_register_commands();
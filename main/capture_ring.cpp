@@ -0,0 +1,193 @@
+#include "capture_ring.h"
+
+#include <string.h>
+
+static size_t varint_put(uint8_t *out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+static size_t varint_get(const uint8_t *data, size_t len, uint32_t *value) {
+    *value = 0;
+    for (size_t n = 0; n < len && n < 5; n++) {
+        *value |= static_cast<uint32_t>(data[n] & 0x7F) << (7 * n);
+        if ((data[n] & 0x80) == 0) {
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+size_t capture_decode(capture_state_t *state, const uint8_t *data, size_t len, capture_record_t *record) {
+    if (len < 1) {
+        return 0;
+    }
+    uint32_t dt_ms, value;
+    size_t pos = 1;
+    size_t n = varint_get(data + pos, len - pos, &dt_ms);
+    if (n == 0) {
+        return 0;
+    }
+    pos += n;
+
+    record->type = data[0] & CAPTURE_TYPE_MASK;
+    record->flags = data[0] & ~CAPTURE_TYPE_MASK;
+    switch (record->type) {
+        case CAPTURE_TYPE_UART_FULL: {
+            n = varint_get(data + pos, len - pos, &value);
+            size_t kept = value < CAPTURE_UART_MAX ? value : CAPTURE_UART_MAX;
+            if (n == 0 || value > UINT16_MAX || pos + n + kept > len) {
+                return 0;
+            }
+            pos += n;
+            memcpy(state->frame, data + pos, kept);
+            state->len = static_cast<uint16_t>(value);
+            pos += kept;
+            break;
+        }
+        case CAPTURE_TYPE_UART_DELTA: {
+            n = varint_get(data + pos, len - pos, &value);
+            if (n == 0 || state->len > CAPTURE_DELTA_MAX || (state->len < 32 && value >> state->len != 0)) {
+                return 0;
+            }
+            pos += n;
+            for (uint8_t i = 0; i < state->len; i++) {
+                if (value & (1u << i)) {
+                    if (pos >= len) {
+                        return 0;
+                    }
+                    state->frame[i] = data[pos++];
+                }
+            }
+            break;
+        }
+        case CAPTURE_TYPE_BUTTON:
+            if (pos >= len) {
+                return 0;
+            }
+            record->pin = data[pos++];
+            break;
+        default:
+            return 0;
+    }
+
+    state->time_ms += dt_ms;
+    record->time_ms = state->time_ms;
+    if (record->type != CAPTURE_TYPE_BUTTON) {
+        record->len = state->len;
+        record->data = state->frame;
+    }
+    return pos;
+}
+
+void capture_ring_init(capture_ring_t *ring, uint8_t *buf, uint32_t size) {
+    ring->buf = buf;
+    ring->size = size;
+    capture_ring_clear(ring);
+}
+
+void capture_ring_clear(capture_ring_t *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->records = 0;
+    ring->dropped = 0;
+    memset(&ring->last, 0, sizeof(ring->last));
+    memset(&ring->first, 0, sizeof(ring->first));
+    ring->empty = true;
+}
+
+size_t capture_ring_copy(const capture_ring_t *ring, uint32_t pos, uint8_t *out, size_t max) {
+    if (pos < ring->tail || pos >= ring->head) {
+        return 0;
+    }
+    size_t len = ring->head - pos < max ? ring->head - pos : max;
+    size_t offset = pos % ring->size;
+    size_t first = ring->size - offset < len ? ring->size - offset : len;
+    memcpy(out, ring->buf + offset, first);
+    memcpy(out + first, ring->buf, len - first);
+    return len;
+}
+
+// Drop the oldest record, first moves past it so dumps still decode
+static void capture_ring_evict(capture_ring_t *ring) {
+    uint8_t record_bytes[CAPTURE_RECORD_MAX];
+    capture_record_t record;
+    size_t len = capture_ring_copy(ring, ring->tail, record_bytes, sizeof(record_bytes));
+    size_t n = capture_decode(&ring->first, record_bytes, len, &record);
+    if (n == 0) {
+        // Cannot happen with records this module wrote, start over rather than decode garbage
+        capture_ring_clear(ring);
+        return;
+    }
+    ring->tail += n;
+    ring->records--;
+    ring->dropped++;
+}
+
+static void capture_ring_put(capture_ring_t *ring, const uint8_t *record, size_t len) {
+    while (ring->head + len - ring->tail > ring->size && ring->records > 0) {
+        capture_ring_evict(ring);
+    }
+    size_t offset = ring->head % ring->size;
+    size_t first = ring->size - offset < len ? ring->size - offset : len;
+    memcpy(ring->buf + offset, record, first);
+    memcpy(ring->buf, record + first, len - first);
+    ring->head += len;
+    ring->records++;
+}
+
+// Type byte and time, the first record of a ring also sets where decoding starts
+static size_t capture_ring_header(capture_ring_t *ring, uint8_t *out, uint8_t type, uint32_t time_ms) {
+    if (ring->empty) {
+        ring->first.time_ms = time_ms;
+        ring->last.time_ms = time_ms;
+        ring->empty = false;
+    }
+    out[0] = type;
+    size_t n = 1 + varint_put(out + 1, time_ms - ring->last.time_ms);
+    ring->last.time_ms = time_ms;
+    return n;
+}
+
+void capture_ring_add_uart(capture_ring_t *ring, uint32_t time_ms, const uint8_t *data, int len) {
+    uint8_t record[CAPTURE_RECORD_MAX];
+    uint16_t read_len = len > 0 ? (len < UINT16_MAX ? len : UINT16_MAX) : 0;
+    size_t kept = read_len < CAPTURE_UART_MAX ? read_len : CAPTURE_UART_MAX;
+    size_t n;
+
+    if (!ring->empty && read_len == ring->last.len && read_len <= CAPTURE_DELTA_MAX) {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kept; i++) {
+            if (data[i] != ring->last.frame[i]) {
+                mask |= 1u << i;
+            }
+        }
+        n = capture_ring_header(ring, record, CAPTURE_TYPE_UART_DELTA, time_ms);
+        n += varint_put(record + n, mask);
+        for (size_t i = 0; i < kept; i++) {
+            if (mask & (1u << i)) {
+                record[n++] = data[i];
+            }
+        }
+    } else {
+        n = capture_ring_header(ring, record, CAPTURE_TYPE_UART_FULL, time_ms);
+        n += varint_put(record + n, read_len);
+        memcpy(record + n, data, kept);
+        n += kept;
+    }
+    memcpy(ring->last.frame, data, kept);
+    ring->last.len = read_len;
+    capture_ring_put(ring, record, n);
+}
+
+void capture_ring_add_button(capture_ring_t *ring, uint32_t time_ms, uint8_t pin, uint8_t flags) {
+    uint8_t record[8];
+    size_t n = capture_ring_header(ring, record, CAPTURE_TYPE_BUTTON | flags, time_ms);
+    record[n++] = pin;
+    capture_ring_put(ring, record, n);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Capture of what the device received: raw sensor UART reads and button
+// events, with millisecond timestamps, in a byte ring that keeps the newest
+// records. Records are variable length, a sensor read costs 7-10 bytes when
+// it differs from the previous one in a few bytes. Pure logic, the host
+// replay tool (tools/host/capture_replay) decodes dumps with the same code.
+//
+// Record: type byte (CAPTURE_TYPE_* | CAPTURE_FLAG_*), varint ms since the
+// previous record, then
+//   UART_FULL:  varint read length, min(length, CAPTURE_UART_MAX) bytes
+//   UART_DELTA: read as long as the previous one, varint mask of the bytes
+//               that changed (bit 0 = byte 0), those bytes
+//   BUTTON:     pin
+
+#define CAPTURE_TYPE_UART_FULL  0
+#define CAPTURE_TYPE_UART_DELTA 1
+#define CAPTURE_TYPE_BUTTON     2
+#define CAPTURE_TYPE_MASK       0x03
+#define CAPTURE_FLAG_LONG       0x04
+#define CAPTURE_FLAG_RELEASED   0x08
+
+// Bytes kept of one read, a sensor frame is 20, longer reads are garbage
+#define CAPTURE_UART_MAX 64
+// Delta records need the mask to fit in a 32 bit varint
+#define CAPTURE_DELTA_MAX 32
+#define CAPTURE_RECORD_MAX (1 + 5 + 5 + CAPTURE_UART_MAX)
+
+struct capture_record_t {
+    uint8_t type;
+    uint8_t flags;
+    // Since the start of the decoded range
+    uint32_t time_ms;
+    uint8_t pin;
+    // Length the read returned, only min(len, CAPTURE_UART_MAX) bytes are in data
+    uint16_t len;
+    const uint8_t *data;
+};
+
+// State carried from one record to the next
+struct capture_state_t {
+    uint32_t time_ms;
+    uint16_t len;
+    uint8_t frame[CAPTURE_UART_MAX];
+};
+
+struct capture_ring_t {
+    uint8_t *buf;
+    uint32_t size;
+    // Absolute byte positions, the records are in [tail, head)
+    uint32_t head;
+    uint32_t tail;
+    uint32_t records;
+    uint32_t dropped;
+    // After the newest record, for encoding the next one
+    capture_state_t last;
+    // Before the oldest record, where decoding a dump starts
+    capture_state_t first;
+    bool empty;
+};
+
+void capture_ring_init(capture_ring_t *ring, uint8_t *buf, uint32_t size);
+
+void capture_ring_clear(capture_ring_t *ring);
+
+// Reads of len <= 0 (timeouts) are recorded with length 0
+void capture_ring_add_uart(capture_ring_t *ring, uint32_t time_ms, const uint8_t *data, int len);
+
+void capture_ring_add_button(capture_ring_t *ring, uint32_t time_ms, uint8_t pin, uint8_t flags);
+
+// Copy up to max bytes of records starting at absolute position pos
+size_t capture_ring_copy(const capture_ring_t *ring, uint32_t pos, uint8_t *out, size_t max);
+
+// Decode the record at data, returns the bytes it took or 0 if it is cut off or invalid
+size_t capture_decode(capture_state_t *state, const uint8_t *data, size_t len, capture_record_t *record);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Colors are given in perceptual steps (0..255 per LED). The tables below are
+// built at compile time and turn them into LEDC duty at LED_DUTY_BITS.
+
+#define LED_DUTY_BITS 13
+#define LED_DUTY_MAX ((1 << LED_DUTY_BITS) - 1)
+
+struct led_color_t {
+    uint8_t green;
+    uint8_t orange;
+    uint8_t red;
+};
+
+namespace color_detail {
+
+// Newton iteration, constexpr std::pow is not available
+constexpr double fifth_root(double x) {
+    if (x <= 0) {
+        return 0;
+    }
+    double y = 1;
+    for (int i = 0; i < 64; i++) {
+        y = (4 * y + x / (y * y * y * y)) / 5;
+    }
+    return y;
+}
+
+// x^2.2
+constexpr double gamma(double x) {
+    return x * x * fifth_root(x);
+}
+
+// CIE 1931 lightness (0..1) to relative luminance
+constexpr double cie_luminance(double lightness) {
+    double l = lightness * 100;
+    if (l <= 8) {
+        return l / 903.3;
+    }
+    double t = (l + 16) / 116;
+    return t * t * t;
+}
+
+template <typename F>
+constexpr std::array<uint16_t, 256> make_lut(F curve) {
+    std::array<uint16_t, 256> lut = {};
+    for (int i = 0; i < 256; i++) {
+        lut[i] = static_cast<uint16_t>(curve(i / 255.0) * LED_DUTY_MAX + 0.5);
+    }
+    return lut;
+}
+
+constexpr bool is_monotonic(const std::array<uint16_t, 256> &lut) {
+    for (int i = 1; i < 256; i++) {
+        if (lut[i] < lut[i - 1]) {
+            return false;
+        }
+    }
+    return lut[0] == 0 && lut[255] == LED_DUTY_MAX;
+}
+
+}  // namespace color_detail
+
+// Color component to linear light, used for mixing the LEDs
+constexpr std::array<uint16_t, 256> led_gamma_lut = color_detail::make_lut(color_detail::gamma);
+// Lightness to linear light, used for dimming so brightness levels look evenly spaced
+constexpr std::array<uint16_t, 256> led_lightness_lut = color_detail::make_lut(color_detail::cie_luminance);
+
+static_assert(color_detail::is_monotonic(led_gamma_lut), "Gamma table must be monotonic");
+static_assert(color_detail::is_monotonic(led_lightness_lut), "Lightness table must be monotonic");
+
+// Duty for one LED: color component scaled by a lightness (both 0..255)
+constexpr uint32_t led_color_duty(uint8_t component, uint8_t lightness) {
+    return static_cast<uint32_t>(led_gamma_lut[component]) * led_lightness_lut[lightness] / LED_DUTY_MAX;
+}
+
+static_assert(led_color_duty(255, 255) == LED_DUTY_MAX, "Full color at full lightness must be full duty");
+static_assert(led_color_duty(255, 0) == 0, "Zero lightness must be off");
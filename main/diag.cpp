@@ -0,0 +1,84 @@
+#include "diag.h"
+#include "attributes.h"
+
+#include <esp_log.h>
+#include <esp_matter.h>
+
+using namespace esp_matter;
+
+static const char *TAG = "diag";
+
+static uint16_t diag_endpoint_id;
+static bool diag_created;
+
+// Values as last reported to the Matter DB
+static pms_stats_t reported_sensor;
+
+
+esp_err_t diag_create(endpoint_t *endpoint) {
+    cluster_t *cluster = cluster::create(endpoint, DIAG_CLUSTER_ID, CLUSTER_FLAG_SERVER);
+    if (cluster == nullptr) {
+        ESP_LOGE(TAG, "Failed to create diagnostics cluster");
+        return ESP_FAIL;
+    }
+
+    cluster::global::attribute::create_cluster_revision(cluster, 1);
+    cluster::global::attribute::create_feature_map(cluster, 0);
+
+    attribute::create(cluster, DiagAttr::SensorHealth, ATTRIBUTE_FLAG_NONE, esp_matter_enum8(PMS_HEALTH_OK));
+    attribute::create(cluster, DiagAttr::SensorConsecutiveFailures, ATTRIBUTE_FLAG_NONE, esp_matter_uint16(0));
+    attribute::create(cluster, DiagAttr::SensorErrorRate, ATTRIBUTE_FLAG_NONE, esp_matter_uint16(0));
+    attribute::create(cluster, DiagAttr::SensorFramesOk, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorTimeouts, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorBadFrames, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorChecksumErrors, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorUartFlushes, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorUartReinits, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+    attribute::create(cluster, DiagAttr::SensorPowerCycles, ATTRIBUTE_FLAG_NONE, esp_matter_uint32(0));
+
+    diag_endpoint_id = endpoint::get_id(endpoint);
+    diag_created = true;
+    return ESP_OK;
+}
+
+static void diag_report_u32(uint32_t attribute_id, uint32_t value, uint32_t *reported) {
+    if (value == *reported) {
+        return;
+    }
+    attr_count_report(true);
+    esp_matter_attr_val_t val = esp_matter_uint32(value);
+    attribute::report(diag_endpoint_id, DIAG_CLUSTER_ID, attribute_id, &val);
+    *reported = value;
+}
+
+static void diag_report_u16(uint32_t attribute_id, uint16_t value, uint16_t *reported) {
+    if (value == *reported) {
+        return;
+    }
+    attr_count_report(true);
+    esp_matter_attr_val_t val = esp_matter_uint16(value);
+    attribute::report(diag_endpoint_id, DIAG_CLUSTER_ID, attribute_id, &val);
+    *reported = value;
+}
+
+void diag_report_sensor(const pms_stats_t *stats) {
+    if (!diag_created) {
+        return;
+    }
+
+    if (stats->health != reported_sensor.health) {
+        attr_count_report(true);
+        esp_matter_attr_val_t val = esp_matter_enum8(stats->health);
+        attribute::report(diag_endpoint_id, DIAG_CLUSTER_ID, DiagAttr::SensorHealth, &val);
+        reported_sensor.health = stats->health;
+    }
+    diag_report_u16(DiagAttr::SensorConsecutiveFailures, stats->consecutive_failures, &reported_sensor.consecutive_failures);
+    diag_report_u16(DiagAttr::SensorErrorRate, stats->error_rate_permille, &reported_sensor.error_rate_permille);
+    diag_report_u32(DiagAttr::SensorFramesOk, stats->frames_ok, &reported_sensor.frames_ok);
+    diag_report_u32(DiagAttr::SensorTimeouts, stats->timeouts, &reported_sensor.timeouts);
+    diag_report_u32(DiagAttr::SensorBadFrames, stats->bad_frames, &reported_sensor.bad_frames);
+    diag_report_u32(DiagAttr::SensorChecksumErrors, stats->checksum_errors, &reported_sensor.checksum_errors);
+    diag_report_u32(DiagAttr::SensorUartFlushes, stats->uart_flushes, &reported_sensor.uart_flushes);
+    diag_report_u32(DiagAttr::SensorUartReinits, stats->uart_reinits, &reported_sensor.uart_reinits);
+    diag_report_u32(DiagAttr::SensorPowerCycles, stats->power_cycles, &reported_sensor.power_cycles);
+}
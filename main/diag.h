@@ -0,0 +1,28 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+#include "pms.h"
+
+// Vendor specific cluster (test vendor prefix) carrying device health counters
+#define DIAG_CLUSTER_ID 0xFFF1FC00
+
+namespace DiagAttr {
+    constexpr uint32_t SensorHealth = 0x0000;
+    constexpr uint32_t SensorConsecutiveFailures = 0x0001;
+    constexpr uint32_t SensorErrorRate = 0x0002;
+    constexpr uint32_t SensorFramesOk = 0x0003;
+    constexpr uint32_t SensorTimeouts = 0x0004;
+    constexpr uint32_t SensorBadFrames = 0x0005;
+    constexpr uint32_t SensorChecksumErrors = 0x0006;
+    constexpr uint32_t SensorUartFlushes = 0x0007;
+    constexpr uint32_t SensorUartReinits = 0x0008;
+    constexpr uint32_t SensorPowerCycles = 0x0009;
+}
+
+// Add the diagnostics cluster to an endpoint, must be called before Matter start
+esp_err_t diag_create(esp_matter::endpoint_t *endpoint);
+
+// Report sensor counters, only the attributes that changed are reported
+void diag_report_sensor(const pms_stats_t *stats);
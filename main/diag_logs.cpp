@@ -0,0 +1,195 @@
+#include "diag_logs.h"
+#include "log_ring.h"
+#include "trace.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <app/clusters/diagnostic-logs-server/diagnostic-logs-server.h>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace chip;
+using namespace chip::app::Clusters::DiagnosticLogs;
+using namespace esp_matter;
+
+static const char *TAG = "diag_logs";
+
+// Only one transfer at a time, the rings are shared
+#define DIAG_LOGS_SESSION 1
+
+enum log_phase_t : uint8_t {
+    LOG_PHASE_HEADER,
+    LOG_PHASE_LOG,
+    LOG_PHASE_TRACE_HEADER,
+    LOG_PHASE_TRACE,
+    LOG_PHASE_DONE,
+};
+
+// Read position in both rings, the end positions are fixed when the session starts
+struct log_session_t {
+    bool open;
+    log_phase_t phase;
+    uint32_t log_pos;
+    uint32_t log_end;
+    uint32_t trace_pos;
+    uint32_t trace_end;
+};
+
+
+// Fill as much of out as possible, returns the number of bytes written
+static size_t session_collect(log_session_t *session, uint8_t *out, size_t size) {
+    char *buf = reinterpret_cast<char *>(out);
+    size_t used = 0;
+
+    while (session->phase != LOG_PHASE_DONE) {
+        switch (session->phase) {
+            case LOG_PHASE_HEADER:
+            case LOG_PHASE_TRACE_HEADER: {
+                char header[80];
+                int len = session->phase == LOG_PHASE_HEADER
+                    ? snprintf(header, sizeof(header), "# purifier log, uptime %lld s\n",
+                               esp_timer_get_time() / 1000000)
+                    : snprintf(header, sizeof(header), "# trace %lu records\n",
+                               (unsigned long)(session->trace_end - session->trace_pos));
+                if (used + len > size) {
+                    return used;
+                }
+                memcpy(&buf[used], header, len);
+                used += len;
+                session->phase = static_cast<log_phase_t>(session->phase + 1);
+                break;
+            }
+            case LOG_PHASE_LOG:
+                used += log_ring_read(&session->log_pos, session->log_end, &buf[used], size - used);
+                if (session->log_pos < session->log_end) {
+                    return used;
+                }
+                session->phase = LOG_PHASE_TRACE_HEADER;
+                break;
+            case LOG_PHASE_TRACE:
+                while (session->trace_pos < session->trace_end) {
+                    if (used + TRACE_LINE_LEN > size) {
+                        return used;
+                    }
+                    if (trace_format_record(session->trace_pos, &buf[used])) {
+                        used += TRACE_LINE_LEN;
+                    }
+                    session->trace_pos++;
+                }
+                session->phase = LOG_PHASE_DONE;
+                break;
+            default:
+                session->phase = LOG_PHASE_DONE;
+                break;
+        }
+    }
+    return used;
+}
+
+static void session_start(log_session_t *session) {
+    uint32_t log_start;
+    memset(session, 0, sizeof(*session));
+    session->open = true;
+    log_ring_range(&log_start, &session->log_end);
+    session->log_pos = log_start;
+    trace_range(&session->trace_pos, &session->trace_end);
+}
+
+// Headers take less than this
+#define DIAG_LOGS_HEADER_BYTES 96
+
+// Skip the oldest log bytes and trace records so the newest ones fit in size.
+// The output ends with the trace, so its records are kept first.
+static void session_keep_tail(log_session_t *session, size_t size) {
+    size_t avail = size > DIAG_LOGS_HEADER_BYTES ? size - DIAG_LOGS_HEADER_BYTES : 0;
+    uint32_t records = avail / TRACE_LINE_LEN;
+    if (session->trace_end - session->trace_pos > records) {
+        session->trace_pos = session->trace_end - records;
+    }
+    avail -= (session->trace_end - session->trace_pos) * TRACE_LINE_LEN;
+    if (session->log_end - session->log_pos > avail) {
+        session->log_pos = session->log_end - avail;
+    }
+}
+
+
+class PurifierLogProvider : public DiagnosticLogsProviderDelegate {
+public:
+    CHIP_ERROR StartLogCollection(IntentEnum intent, LogSessionHandle &outHandle,
+                                  Optional<uint64_t> &outTimeStamp, Optional<uint64_t> &outTimeSinceBoot) override {
+        if (intent != IntentEnum::kEndUserSupport) {
+            return CHIP_ERROR_NOT_FOUND;
+        }
+        if (session.open) {
+            return CHIP_ERROR_BUSY;
+        }
+        session_start(&session);
+        outHandle = DIAG_LOGS_SESSION;
+        outTimeSinceBoot.SetValue(esp_timer_get_time());
+        ESP_LOGI(TAG, "Log transfer started");
+        return CHIP_NO_ERROR;
+    }
+
+    CHIP_ERROR CollectLog(LogSessionHandle sessionHandle, MutableByteSpan &outBuffer, bool &outIsEndOfLog) override {
+        if (sessionHandle != DIAG_LOGS_SESSION || !session.open) {
+            return CHIP_ERROR_INVALID_ARGUMENT;
+        }
+        size_t len = session_collect(&session, outBuffer.data(), outBuffer.size());
+        outBuffer.reduce_size(len);
+        outIsEndOfLog = session.phase == LOG_PHASE_DONE;
+        return CHIP_NO_ERROR;
+    }
+
+    CHIP_ERROR EndLogCollection(LogSessionHandle sessionHandle) override {
+        if (sessionHandle != DIAG_LOGS_SESSION) {
+            return CHIP_ERROR_INVALID_ARGUMENT;
+        }
+        session.open = false;
+        return CHIP_NO_ERROR;
+    }
+
+    size_t GetSizeForIntent(IntentEnum intent) override {
+        if (intent != IntentEnum::kEndUserSupport) {
+            return 0;
+        }
+        uint32_t log_start, log_end, trace_start, trace_end;
+        log_ring_range(&log_start, &log_end);
+        trace_range(&trace_start, &trace_end);
+        return (log_end - log_start) + (trace_end - trace_start) * TRACE_LINE_LEN + DIAG_LOGS_HEADER_BYTES;
+    }
+
+    // Small logs are sent in the response, the oldest part of the rest is cut
+    CHIP_ERROR GetLogForIntent(IntentEnum intent, MutableByteSpan &outBuffer,
+                               Optional<uint64_t> &outTimeStamp, Optional<uint64_t> &outTimeSinceBoot) override {
+        if (intent != IntentEnum::kEndUserSupport) {
+            return CHIP_ERROR_NOT_FOUND;
+        }
+        log_session_t inline_session;
+        session_start(&inline_session);
+        session_keep_tail(&inline_session, outBuffer.size());
+        size_t len = session_collect(&inline_session, outBuffer.data(), outBuffer.size());
+        outBuffer.reduce_size(len);
+        outTimeSinceBoot.SetValue(esp_timer_get_time());
+        return CHIP_NO_ERROR;
+    }
+
+private:
+    log_session_t session = {};
+};
+
+static PurifierLogProvider log_provider;
+
+
+// Called by the cluster server when the endpoint comes up
+void emberAfDiagnosticLogsClusterInitCallback(chip::EndpointId endpoint) {
+    DiagnosticLogsServer::Instance().SetDiagnosticLogsProviderDelegate(endpoint, &log_provider);
+}
+
+esp_err_t diag_logs_create(node_t *node) {
+    endpoint_t *root = endpoint::get(node, 0);
+    cluster::diagnostic_logs::config_t config;
+    cluster_t *cluster = cluster::diagnostic_logs::create(root, &config, CLUSTER_FLAG_SERVER);
+    return cluster != nullptr ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+// Diagnostic Logs cluster on the root endpoint. The end user support intent
+// returns the log ring followed by the event trace ("T <hex>" lines, see
+// tools/trace_decode.py). Large logs go over BDX in chunks read straight
+// from the rings. log_ring_init() must run first.
+esp_err_t diag_logs_create(esp_matter::node_t *node);
@@ -0,0 +1,34 @@
+#include "driver_state.h"
+#include "hw_conf.h"
+
+void driver_state_init(driver_state_t *state) {
+    state->brightness = UI_BRIGHTNESS_MAX;
+    state->prev_mode = UI_MODE_HIGH;
+    state->prev_percentage = 0;
+    state->current_auto_percentage = AUTO_UNKNOWN_PERCENT;
+    state->auto_mode = false;
+}
+
+driver_fan_t driver_state_set_percentage(driver_state_t *state, uint8_t percentage) {
+    if (percentage != 0) {
+        state->prev_percentage = percentage;
+    }
+    state->auto_mode = false;
+    return { percentage, ui_mode_from_percentage(percentage), true };
+}
+
+driver_fan_t driver_state_set_mode(driver_state_t *state, ui_mode_t mode) {
+    uint8_t percentage = ui_mode_percentage(mode, state->current_auto_percentage);
+    if (mode != UI_MODE_AUTO) {
+        return driver_state_set_percentage(state, percentage);
+    }
+    state->prev_mode = UI_MODE_AUTO;
+    state->prev_percentage = 0;
+    state->auto_mode = true;
+    return { percentage, UI_MODE_AUTO, false };
+}
+
+bool driver_state_auto_update(driver_state_t *state, uint8_t percentage) {
+    state->current_auto_percentage = percentage;
+    return state->auto_mode;
+}
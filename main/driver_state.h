@@ -0,0 +1,43 @@
+#pragma once
+
+#include "ui_fsm.h"
+
+#include <cstdint>
+
+// Fan bookkeeping of app_driver.cpp that is not in the Matter data model:
+// what turning the fan back on restores and whether the auto controller
+// drives it. Pure logic, the host simulators run the same steps. Not thread
+// safe, the firmware holds state_mutex around every call.
+
+struct driver_state_t {
+    // UI_BRIGHTNESS_MIN..UI_BRIGHTNESS_MAX
+    uint8_t brightness;
+    // Restored while prev_percentage is 0
+    ui_mode_t prev_mode;
+    // Restored when not 0, percentage takes precedence over mode
+    uint8_t prev_percentage;
+    // Last auto_control_update() result
+    uint8_t current_auto_percentage;
+    bool auto_mode;
+};
+
+// What the driver applies after a fan write
+struct driver_fan_t {
+    // Fan speed, also PercentCurrent and SpeedCurrent
+    uint8_t percentage;
+    // Shown on the indicators
+    ui_mode_t mode;
+    // FanMode follows the percentage, false when FanMode itself was written
+    bool report_mode;
+};
+
+void driver_state_init(driver_state_t *state);
+
+// PercentSetting or SpeedSetting write
+driver_fan_t driver_state_set_percentage(driver_state_t *state, uint8_t percentage);
+
+// FanMode write, modes other than auto become their percentage
+driver_fan_t driver_state_set_mode(driver_state_t *state, ui_mode_t mode);
+
+// New auto_control_update() result, returns true if the fan follows it
+bool driver_state_auto_update(driver_state_t *state, uint8_t percentage);
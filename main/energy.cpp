@@ -0,0 +1,392 @@
+#include "energy.h"
+#include "power_model.h"
+#include "report_policy.h"
+#include "attributes.h"
+#include "app_console.h"
+#include "hw_conf.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_log.h>
+#include <nvs.h>
+
+#include <app/clusters/electrical-energy-measurement-server/electrical-energy-measurement-server.h>
+#include <app/clusters/electrical-power-measurement-server/electrical-power-measurement-server.h>
+#include <app/clusters/power-topology-server/power-topology-server.h>
+#include <app/reporting/reporting.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace chip;
+using namespace chip::app;
+using namespace chip::app::Clusters;
+using namespace esp_matter;
+
+#define ENERGY_NVS_NAMESPACE "energy"
+#define ENERGY_NVS_MODEL_KEY "model"
+#define ENERGY_NVS_TOTAL_KEY "total_uj"
+
+// The model is an estimate, claim +-20 %
+#define ENERGY_ACCURACY_PERCENT100THS 2000
+
+#define UJ_PER_MWH 3600000ULL
+
+static const char *TAG = "energy";
+
+static const power_model_t default_model = {
+    .base_mw = POWER_MODEL_BASE_MW,
+    .fan_min_mw = POWER_MODEL_FAN_MIN_MW,
+    .fan_max_mw = POWER_MODEL_FAN_MAX_MW,
+    .led_mw = POWER_MODEL_LED_MW,
+};
+static power_model_t model = default_model;
+static bool model_calibrated;
+
+// Guards the model and the integration state between the controller task and the console
+static portMUX_TYPE energy_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t last_update_us;
+static uint32_t power_mw;
+static uint64_t total_uj;
+
+// Only touched from energy_update()
+static uint64_t saved_uj;
+static int64_t last_save_us;
+static report_policy_t reported;
+static bool accuracy_set;
+
+static uint16_t energy_endpoint_id;
+static bool energy_created;
+
+
+static const ElectricalPowerMeasurement::Structs::MeasurementAccuracyRangeStruct::Type power_ranges[] = {
+    {
+        .rangeMin = 0,
+        .rangeMax = POWER_MODEL_BASE_MW + POWER_MODEL_FAN_MAX_MW + 1000,
+        .percentMax = MakeOptional(static_cast<Percent100ths>(ENERGY_ACCURACY_PERCENT100THS)),
+    },
+};
+
+static const ElectricalPowerMeasurement::Structs::MeasurementAccuracyStruct::Type power_accuracy = {
+    .measurementType = ElectricalPowerMeasurement::MeasurementTypeEnum::kActivePower,
+    // Estimated from the operating point, not measured
+    .measured = false,
+    .minMeasuredValue = 0,
+    .maxMeasuredValue = POWER_MODEL_BASE_MW + POWER_MODEL_FAN_MAX_MW + 1000,
+    .accuracyRanges = DataModel::List<const ElectricalPowerMeasurement::Structs::MeasurementAccuracyRangeStruct::Type>(power_ranges),
+};
+
+static const ElectricalEnergyMeasurement::Structs::MeasurementAccuracyRangeStruct::Type energy_ranges[] = {
+    {
+        .rangeMin = 0,
+        .rangeMax = INT64_MAX,
+        .percentMax = MakeOptional(static_cast<Percent100ths>(ENERGY_ACCURACY_PERCENT100THS)),
+    },
+};
+
+static const ElectricalEnergyMeasurement::Structs::MeasurementAccuracyStruct::Type energy_accuracy = {
+    .measurementType = ElectricalEnergyMeasurement::MeasurementTypeEnum::kElectricalEnergy,
+    .measured = false,
+    .minMeasuredValue = 0,
+    .maxMeasuredValue = INT64_MAX,
+    .accuracyRanges = DataModel::List<const ElectricalEnergyMeasurement::Structs::MeasurementAccuracyRangeStruct::Type>(energy_ranges),
+};
+
+
+// Serves ActivePower from the model, everything else is not supported
+class PurifierPowerDelegate : public ElectricalPowerMeasurement::Delegate {
+public:
+    ElectricalPowerMeasurement::PowerModeEnum GetPowerMode() override {
+        return ElectricalPowerMeasurement::PowerModeEnum::kAc;
+    }
+    uint8_t GetNumberOfMeasurementTypes() override { return 1; }
+
+    CHIP_ERROR StartAccuracyRead() override { return CHIP_NO_ERROR; }
+    CHIP_ERROR GetAccuracyByIndex(uint8_t index,
+                                  ElectricalPowerMeasurement::Structs::MeasurementAccuracyStruct::Type &accuracy) override {
+        if (index > 0) {
+            return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+        }
+        accuracy = power_accuracy;
+        return CHIP_NO_ERROR;
+    }
+    CHIP_ERROR EndAccuracyRead() override { return CHIP_NO_ERROR; }
+
+    CHIP_ERROR StartRangesRead() override { return CHIP_NO_ERROR; }
+    CHIP_ERROR GetRangeByIndex(uint8_t, ElectricalPowerMeasurement::Structs::MeasurementRangeStruct::Type &) override {
+        return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+    }
+    CHIP_ERROR EndRangesRead() override { return CHIP_NO_ERROR; }
+
+    CHIP_ERROR StartHarmonicCurrentsRead() override { return CHIP_NO_ERROR; }
+    CHIP_ERROR GetHarmonicCurrentsByIndex(uint8_t, ElectricalPowerMeasurement::Structs::HarmonicMeasurementStruct::Type &) override {
+        return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+    }
+    CHIP_ERROR EndHarmonicCurrentsRead() override { return CHIP_NO_ERROR; }
+
+    CHIP_ERROR StartHarmonicPhasesRead() override { return CHIP_NO_ERROR; }
+    CHIP_ERROR GetHarmonicPhasesByIndex(uint8_t, ElectricalPowerMeasurement::Structs::HarmonicMeasurementStruct::Type &) override {
+        return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
+    }
+    CHIP_ERROR EndHarmonicPhasesRead() override { return CHIP_NO_ERROR; }
+
+    DataModel::Nullable<int64_t> GetActivePower() override {
+        return DataModel::MakeNullable(static_cast<int64_t>(energy_get_power_mw()));
+    }
+
+    DataModel::Nullable<int64_t> GetVoltage() override { return {}; }
+    DataModel::Nullable<int64_t> GetActiveCurrent() override { return {}; }
+    DataModel::Nullable<int64_t> GetReactiveCurrent() override { return {}; }
+    DataModel::Nullable<int64_t> GetApparentCurrent() override { return {}; }
+    DataModel::Nullable<int64_t> GetReactivePower() override { return {}; }
+    DataModel::Nullable<int64_t> GetApparentPower() override { return {}; }
+    DataModel::Nullable<int64_t> GetRMSVoltage() override { return {}; }
+    DataModel::Nullable<int64_t> GetRMSCurrent() override { return {}; }
+    DataModel::Nullable<int64_t> GetRMSPower() override { return {}; }
+    DataModel::Nullable<int64_t> GetFrequency() override { return {}; }
+    DataModel::Nullable<int64_t> GetPowerFactor() override { return {}; }
+    DataModel::Nullable<int64_t> GetNeutralCurrent() override { return {}; }
+};
+
+// Node topology, the measurements cover the whole device
+class PurifierTopologyDelegate : public PowerTopology::Delegate {
+public:
+    CHIP_ERROR GetAvailableEndpointAtIndex(size_t, EndpointId &) override { return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED; }
+    CHIP_ERROR GetActiveEndpointAtIndex(size_t, EndpointId &) override { return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED; }
+};
+
+static PurifierPowerDelegate power_delegate;
+static PurifierTopologyDelegate topology_delegate;
+
+
+static void model_load() {
+    nvs_handle_t handle;
+    size_t size = sizeof(model);
+
+    if (nvs_open(ENERGY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    power_model_t stored;
+    if (nvs_get_blob(handle, ENERGY_NVS_MODEL_KEY, &stored, &size) == ESP_OK && size == sizeof(stored)) {
+        model = stored;
+        model_calibrated = true;
+    }
+    uint64_t stored_uj;
+    if (nvs_get_u64(handle, ENERGY_NVS_TOTAL_KEY, &stored_uj) == ESP_OK) {
+        total_uj = stored_uj;
+        saved_uj = stored_uj;
+    }
+    nvs_close(handle);
+}
+
+static esp_err_t model_save(const power_model_t *calibrated) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ENERGY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (calibrated != NULL) {
+        err = nvs_set_blob(handle, ENERGY_NVS_MODEL_KEY, calibrated, sizeof(*calibrated));
+    } else {
+        err = nvs_erase_key(handle, ENERGY_NVS_MODEL_KEY);
+        err = err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+static void total_save(uint64_t uj) {
+    nvs_handle_t handle;
+    if (nvs_open(ENERGY_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_u64(handle, ENERGY_NVS_TOTAL_KEY, uj) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+void energy_init() {
+    model_load();
+    ESP_LOGI(TAG, "%s power model, %llu Wh so far", model_calibrated ? "Calibrated" : "Nominal",
+             (unsigned long long)(total_uj / UJ_PER_MWH / 1000));
+}
+
+esp_err_t energy_create(node_t *node) {
+    endpoint::electrical_sensor::config_t sensor_config;
+    sensor_config.power_topology.delegate = &topology_delegate;
+    endpoint_t *endpoint = endpoint::electrical_sensor::create(node, &sensor_config, ENDPOINT_FLAG_NONE, NULL);
+    if (endpoint == nullptr) {
+        ESP_LOGE(TAG, "Failed to create electrical sensor endpoint");
+        return ESP_FAIL;
+    }
+    cluster::power_topology::feature::node_topology::add(cluster::get(endpoint, PowerTopology::Id));
+
+    cluster::electrical_power_measurement::config_t power_config;
+    power_config.delegate = &power_delegate;
+    cluster_t *power_cluster = cluster::electrical_power_measurement::create(endpoint, &power_config, CLUSTER_FLAG_SERVER);
+    cluster::electrical_energy_measurement::config_t energy_config;
+    cluster_t *energy_cluster = cluster::electrical_energy_measurement::create(endpoint, &energy_config, CLUSTER_FLAG_SERVER);
+    if (power_cluster == nullptr || energy_cluster == nullptr) {
+        ESP_LOGE(TAG, "Failed to create power and energy measurement clusters");
+        return ESP_FAIL;
+    }
+    cluster::electrical_power_measurement::feature::alternating_current::add(power_cluster);
+    cluster::electrical_energy_measurement::feature::imported_energy::add(energy_cluster);
+    cluster::electrical_energy_measurement::feature::cumulative_energy::add(energy_cluster);
+
+    energy_endpoint_id = endpoint::get_id(endpoint);
+    energy_created = true;
+    ESP_LOGI(TAG, "Electrical sensor created with endpoint_id %d", energy_endpoint_id);
+    return ESP_OK;
+}
+
+// Called with the CHIP stack lock held
+static void energy_report(uint32_t power, uint64_t mwh, int64_t now_us) {
+    if (!accuracy_set) {
+        // The cluster server only exists once Matter has started
+        accuracy_set = ElectricalEnergyMeasurement::SetMeasurementAccuracy(energy_endpoint_id, energy_accuracy) == CHIP_NO_ERROR;
+        if (!accuracy_set) {
+            return;
+        }
+    }
+
+    bool report_power = report_policy_power_due(&reported, power);
+    if (report_power || power != reported.power_mw) {
+        attr_count_report(report_power);
+    }
+    if (report_power) {
+        MatterReportingAttributeChangeCallback(energy_endpoint_id, ElectricalPowerMeasurement::Id,
+                                               ElectricalPowerMeasurement::Attributes::ActivePower::Id);
+        report_policy_power_sent(&reported, power);
+    }
+
+    bool report_energy = report_policy_energy_due(&reported, mwh);
+    if (report_energy || mwh != reported.energy_mwh) {
+        attr_count_report(report_energy);
+    }
+    if (report_energy) {
+        ElectricalEnergyMeasurement::Structs::EnergyMeasurementStruct::Type imported;
+        imported.energy = static_cast<int64_t>(mwh);
+        imported.endSystime.SetValue(static_cast<uint64_t>(now_us / 1000));
+        if (ElectricalEnergyMeasurement::NotifyCumulativeEnergyMeasured(energy_endpoint_id, MakeOptional(imported), NullOptional)) {
+            report_policy_energy_sent(&reported, mwh);
+        }
+    }
+}
+
+void energy_update(int64_t now_us, uint8_t fan_percentage, uint8_t led_level) {
+    taskENTER_CRITICAL(&energy_lock);
+    if (last_update_us != 0) {
+        // mW * us = nJ
+        total_uj += static_cast<uint64_t>(power_mw) * (now_us - last_update_us) / 1000;
+    }
+    last_update_us = now_us;
+    power_mw = power_model_estimate(&model, fan_percentage, led_level);
+    uint32_t power = power_mw;
+    uint64_t uj = total_uj;
+    taskEXIT_CRITICAL(&energy_lock);
+
+    if (energy_created) {
+        lock::status_t lock_status = lock::chip_stack_lock(portMAX_DELAY);
+        if (lock_status != lock::FAILED) {
+            energy_report(power, uj / UJ_PER_MWH, now_us);
+            if (lock_status == lock::SUCCESS) {
+                lock::chip_stack_unlock();
+            }
+        }
+    }
+
+    // Coalesce flash writes, an hour of energy at most is lost on power loss
+    if (uj != saved_uj && now_us - last_save_us >= ENERGY_SAVE_INTERVAL_S * 1000000LL) {
+        total_save(uj);
+        saved_uj = uj;
+        last_save_us = now_us;
+    }
+}
+
+uint32_t energy_get_power_mw() {
+    taskENTER_CRITICAL(&energy_lock);
+    uint32_t power = power_mw;
+    taskEXIT_CRITICAL(&energy_lock);
+    return power;
+}
+
+uint64_t energy_get_total_mwh() {
+    taskENTER_CRITICAL(&energy_lock);
+    uint64_t uj = total_uj;
+    taskEXIT_CRITICAL(&energy_lock);
+    return uj / UJ_PER_MWH;
+}
+
+
+static esp_err_t energy_handler(int argc, char **argv) {
+    taskENTER_CRITICAL(&energy_lock);
+    power_model_t m = model;
+    bool calibrated = model_calibrated;
+    taskEXIT_CRITICAL(&energy_lock);
+
+    uint64_t mwh = energy_get_total_mwh();
+    printf("power: %lu mW, energy: %llu.%03llu Wh\n", (unsigned long)energy_get_power_mw(),
+           (unsigned long long)(mwh / 1000), (unsigned long long)(mwh % 1000));
+    printf("model (%s): base %lu mW, fan %lu..%lu mW, leds %lu/%lu/%lu mW\n", calibrated ? "calibrated" : "nominal",
+           (unsigned long)m.base_mw, (unsigned long)m.fan_min_mw, (unsigned long)m.fan_max_mw,
+           (unsigned long)m.led_mw[1], (unsigned long)m.led_mw[2], (unsigned long)m.led_mw[3]);
+    return ESP_OK;
+}
+
+static esp_err_t energy_cal_handler(int argc, char **argv) {
+    power_model_t m = default_model;
+    esp_err_t err;
+
+    if (argc == 1 && strcmp(argv[0], "default") == 0) {
+        err = model_save(NULL);
+    } else if (argc == 3 || argc == 6) {
+        m.base_mw = strtoul(argv[0], NULL, 10);
+        m.fan_min_mw = strtoul(argv[1], NULL, 10);
+        m.fan_max_mw = strtoul(argv[2], NULL, 10);
+        for (int i = 1; argc == 6 && i < POWER_MODEL_LED_LEVELS; i++) {
+            m.led_mw[i] = strtoul(argv[2 + i], NULL, 10);
+        }
+        if (m.fan_max_mw < m.fan_min_mw) {
+            printf("fan_max_mw must not be below fan_min_mw\n");
+            return ESP_ERR_INVALID_ARG;
+        }
+        err = model_save(&m);
+    } else {
+        printf("Usage: energy-cal <base_mw> <fan_min_mw> <fan_max_mw> [led1_mw led2_mw led3_mw] | default\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (err != ESP_OK) {
+        printf("Failed to store the model: %s\n", esp_err_to_name(err));
+        return err;
+    }
+
+    taskENTER_CRITICAL(&energy_lock);
+    model = m;
+    model_calibrated = argc != 1;
+    taskEXIT_CRITICAL(&energy_lock);
+    printf("Model updated, applies from the next sensor cycle\n");
+    return ESP_OK;
+}
+
+void energy_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "energy",
+            .description = "Show estimated power, cumulative energy and the power model.",
+            .handler = energy_handler,
+        },
+        {
+            .name = "energy-cal",
+            .description = "Set the power model from wall measurements: base with fan and LEDs off, fan at 1 % and "
+                           "100 % minus base, optionally LEDs per brightness level. "
+                           "Usage: energy-cal <base_mw> <fan_min_mw> <fan_max_mw> [led1 led2 led3] | default.",
+            .handler = energy_cal_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+#include <cstdint>
+
+// Estimated power and cumulative energy from the power model, published
+// through the Electrical Power Measurement and Electrical Energy Measurement
+// clusters on an Electrical Sensor endpoint. Values are reported when they
+// moved past a threshold, not periodically. Energy is kept in NVS, writes are
+// coalesced so the flash sees at most one per ENERGY_SAVE_INTERVAL_S.
+
+// Load the model and the energy counter, call before energy_create()
+void energy_init();
+
+// Add the Electrical Sensor endpoint, must be called before Matter start
+esp_err_t energy_create(esp_matter::node_t *node);
+
+// Integrate up to now and apply the new operating point
+void energy_update(int64_t now_us, uint8_t fan_percentage, uint8_t led_level);
+
+uint32_t energy_get_power_mw();
+
+uint64_t energy_get_total_mwh();
+
+void energy_register_commands();
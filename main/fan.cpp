@@ -1,18 +1,108 @@
 #include "hw_conf.h"
 #include "fan.h"
+#include "trace.h"
+#include "power_mgmt.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/ledc.h"
 #include "driver/gpio.h"
+#include "driver/pulse_cnt.h"
 #include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include <math.h>
+#include <string.h>
 
 static uint8_t fan_current_percentage;
 
-#define LEDC_MODE LEDC_HIGH_SPEED_MODE
+#define LEDC_MODE LEDC_MODE_PWM
 #define LEDC_RESOLUTION LEDC_TIMER_8_BIT
 
+#define FAN_NVS_NAMESPACE "fan"
+#define FAN_NVS_LUT_KEY "lut"
+
+// The counter wraps to 0 when it reaches the limit
+#define FG_PCNT_LIMIT 32767
+
+static const char *TAG = "fan";
+
+// PWM frequency per percentage, entry 0 is unused (motor off)
+static uint16_t fan_lut[FAN_LUT_SIZE];
+static bool fan_lut_calibrated;
+
+// Guards the LUT and the motor outputs against the calibration task
+static SemaphoreHandle_t fan_mutex;
+static bool fan_calibrating;
+
+static pcnt_unit_handle_t fg_unit;
+
+// fan_sample_rpm() state, the counter is shared with fan_measure_rpm() but only read
+static portMUX_TYPE rpm_lock = portMUX_INITIALIZER_UNLOCKED;
+static int rpm_count;
+static int64_t rpm_time_us;
+static uint32_t rpm_cached;
+
+
+static void fan_lut_load() {
+    nvs_handle_t handle;
+    size_t size = sizeof(fan_lut);
+
+    fan_lut_default(fan_lut);
+    if (nvs_open(FAN_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    uint16_t stored[FAN_LUT_SIZE];
+    if (nvs_get_blob(handle, FAN_NVS_LUT_KEY, stored, &size) == ESP_OK && size == sizeof(stored)) {
+        memcpy(fan_lut, stored, sizeof(fan_lut));
+        fan_lut_calibrated = true;
+        ESP_LOGI(TAG, "Loaded calibrated speed table (%u..%u Hz)", fan_lut[1], fan_lut[100]);
+    }
+    nvs_close(handle);
+}
+
+static esp_err_t fan_lut_save() {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(FAN_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(handle, FAN_NVS_LUT_KEY, fan_lut, sizeof(fan_lut));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+static void fan_tach_init() {
+    pcnt_unit_config_t unit_config = {
+        .low_limit = -1,
+        .high_limit = FG_PCNT_LIMIT,
+    };
+    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &fg_unit));
+
+    // The FG line is noisy while the PWM switches
+    pcnt_glitch_filter_config_t filter_config = {
+        .max_glitch_ns = 1000,
+    };
+    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(fg_unit, &filter_config));
+
+    pcnt_chan_config_t chan_config = {
+        .edge_gpio_num = GPIO_MOTOR_FG,
+        .level_gpio_num = -1,
+    };
+    pcnt_channel_handle_t channel;
+    ESP_ERROR_CHECK(pcnt_new_channel(fg_unit, &chan_config, &channel));
+    pcnt_channel_set_edge_action(channel, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+
+    ESP_ERROR_CHECK(pcnt_unit_enable(fg_unit));
+    ESP_ERROR_CHECK(pcnt_unit_clear_count(fg_unit));
+    ESP_ERROR_CHECK(pcnt_unit_start(fg_unit));
+}
+
 
 void fan_init() {
     // Prepare and configure the LEDC timer
@@ -51,38 +141,118 @@ void fan_init() {
     // Break pin (active LOW)
     gpio_set_direction(GPIO_MOTOR_BRK, GPIO_MODE_OUTPUT);
     gpio_set_level(GPIO_MOTOR_BRK, 0);
+
+    fan_mutex = xSemaphoreCreateMutex();
+    fan_lut_load();
+    fan_tach_init();
 }
 
 uint8_t fan_get_percentage() {
     return fan_current_percentage;
 }
 
+static void fan_apply(bool on, uint32_t freq) {
+    // The PWM frequency follows the APB clock
+    if (on) {
+        power_hold(POWER_LOCK_FAN, true);
+    }
+    // Deactivate break
+    gpio_set_level(GPIO_MOTOR_BRK, 1);
+    gpio_set_level(GPIO_MOTOR_5V, on);
+    ledc_set_freq(LEDC_MODE, LEDC_TIMER_MOTOR_PWM, freq);
+    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL_MOTOR_PWM, on ? 128 : 0);
+    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL_MOTOR_PWM);
+    if (!on) {
+        power_hold(POWER_LOCK_FAN, false);
+    }
+}
+
 void fan_set_percentage(uint8_t percentage) {
-    // Deactivate break after driver is ready
     if (percentage > 100) {
         percentage = 100;
     }
 
-    bool supply_voltage;
-    uint32_t duty;
-    uint32_t freq;
-
-    if (percentage == 0) {
-        supply_voltage = false;
-        duty = 0;
-        freq = 100;
-    } else {
-        supply_voltage = true;
-        duty = 128;
-        freq = 100 + ((percentage-1) * (510 - 99) / 99);
+    xSemaphoreTake(fan_mutex, portMAX_DELAY);
+    fan_current_percentage = percentage;
+    // Applied once the calibration is over
+    if (!fan_calibrating) {
+        uint32_t freq = fan_lut_frequency(fan_lut, percentage);
+        TRACE(TRACE_FAN_SET, percentage, freq);
+        fan_apply(percentage != 0, freq);
     }
+    xSemaphoreGive(fan_mutex);
+}
 
-    // Deactivate break
-    gpio_set_level(GPIO_MOTOR_BRK, 1);
-    gpio_set_level(GPIO_MOTOR_5V, supply_voltage);
-    ledc_set_freq(LEDC_MODE, LEDC_TIMER_MOTOR_PWM, freq);
-    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL_MOTOR_PWM, duty);
-    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL_MOTOR_PWM);
+uint32_t fan_measure_rpm(uint32_t window_ms) {
+    int start, end;
+    pcnt_unit_get_count(fg_unit, &start);
+    vTaskDelay(pdMS_TO_TICKS(window_ms));
+    pcnt_unit_get_count(fg_unit, &end);
+
+    uint32_t pulses = (end - start + FG_PCNT_LIMIT) % FG_PCNT_LIMIT;
+    return pulses * 60000 / (window_ms * FAN_FG_PULSES_PER_REV);
+}
+
+void fan_sample_rpm() {
+    int count;
+    pcnt_unit_get_count(fg_unit, &count);
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&rpm_lock);
+    int64_t elapsed_us = now_us - rpm_time_us;
+    // Only one counter wrap is told apart, longer gaps just start a new period
+    if (rpm_time_us != 0 && elapsed_us > 0 && elapsed_us < FAN_RPM_SAMPLE_MAX_MS * 1000LL) {
+        uint32_t pulses = (count - rpm_count + FG_PCNT_LIMIT) % FG_PCNT_LIMIT;
+        rpm_cached = pulses * 60000000ULL / (elapsed_us * FAN_FG_PULSES_PER_REV);
+    }
+    rpm_count = count;
+    rpm_time_us = now_us;
+    taskEXIT_CRITICAL(&rpm_lock);
+}
+
+uint32_t fan_get_rpm() {
+    taskENTER_CRITICAL(&rpm_lock);
+    uint32_t rpm = rpm_cached;
+    taskEXIT_CRITICAL(&rpm_lock);
+    return rpm;
+}
+
+void fan_get_lut(uint16_t *lut, bool *calibrated) {
+    xSemaphoreTake(fan_mutex, portMAX_DELAY);
+    memcpy(lut, fan_lut, sizeof(fan_lut));
+    *calibrated = fan_lut_calibrated;
+    xSemaphoreGive(fan_mutex);
+}
+
+void fan_calibration_begin() {
+    xSemaphoreTake(fan_mutex, portMAX_DELAY);
+    fan_calibrating = true;
+    xSemaphoreGive(fan_mutex);
+}
+
+void fan_calibration_set_frequency(uint32_t freq_hz) {
+    xSemaphoreTake(fan_mutex, portMAX_DELAY);
+    // Percentage 255 marks calibration steps in the trace
+    TRACE(TRACE_FAN_SET, 255, freq_hz);
+    fan_apply(true, freq_hz);
+    xSemaphoreGive(fan_mutex);
+}
+
+esp_err_t fan_calibration_end(const uint16_t *lut) {
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(fan_mutex, portMAX_DELAY);
+    if (lut != NULL) {
+        memcpy(fan_lut, lut, sizeof(fan_lut));
+        fan_lut_calibrated = true;
+        err = fan_lut_save();
+    }
+    fan_calibrating = false;
+    // Back to the speed that was requested meanwhile
+    uint8_t percentage = fan_current_percentage;
+    fan_apply(percentage != 0, fan_lut_frequency(fan_lut, percentage));
+    xSemaphoreGive(fan_mutex);
+    return err;
 }
 
 void fan_set_power(bool val) {
@@ -1,11 +1,36 @@
 #pragma once
 
+#include <esp_err.h>
+
 #include <cstdint>
 
+#include "fan_lut.h"
+
 void fan_init();
 
 uint8_t fan_get_percentage();
 
 void fan_set_power(bool val);
 
-void fan_set_percentage(uint8_t val);
\ No newline at end of file
+void fan_set_percentage(uint8_t val);
+
+// Motor speed from the FG tachometer, averaged over the window (blocks)
+uint32_t fan_measure_rpm(uint32_t window_ms);
+
+// Update the cached motor speed from the tachometer pulses since the last
+// call, called once per sensor reading
+void fan_sample_rpm();
+
+// Cached motor speed over the last fan_sample_rpm() period, does not block
+uint32_t fan_get_rpm();
+
+void fan_get_lut(uint16_t *lut, bool *calibrated);
+
+// While calibrating, fan_set_percentage only records the requested speed
+void fan_calibration_begin();
+
+// Run the motor at a raw PWM frequency, only during calibration
+void fan_calibration_set_frequency(uint32_t freq_hz);
+
+// Install and persist a new table (NULL keeps the current one) and restore the requested speed
+esp_err_t fan_calibration_end(const uint16_t *lut);
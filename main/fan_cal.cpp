@@ -0,0 +1,203 @@
+#include "fan_cal.h"
+#include "fan.h"
+#include "buzzer.h"
+#include "app_console.h"
+#include "hw_conf.h"
+#include "tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <esp_log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Readings this close to each other count as steady
+#define FAN_CAL_STEADY_PERMILLE 30
+#define FAN_CAL_STEADY_TRIES 5
+
+static const char *TAG = "fan_cal";
+
+struct cal_point_t {
+    uint16_t freq;
+    uint16_t rpm;
+};
+
+static TaskHandle_t cal_task_handle;
+static volatile bool cal_running;
+static volatile bool cal_cancel;
+
+static cal_point_t cal_points[FAN_CAL_POINTS];
+
+
+// Measure until two consecutive windows agree
+static uint32_t measure_steady_rpm() {
+    vTaskDelay(pdMS_TO_TICKS(FAN_CAL_SETTLE_MS));
+
+    uint32_t prev = fan_measure_rpm(FAN_CAL_WINDOW_MS);
+    for (int i = 0; i < FAN_CAL_STEADY_TRIES; i++) {
+        uint32_t rpm = fan_measure_rpm(FAN_CAL_WINDOW_MS);
+        uint32_t diff = rpm > prev ? rpm - prev : prev - rpm;
+        if (diff * 1000 <= prev * FAN_CAL_STEADY_PERMILLE) {
+            return (rpm + prev) / 2;
+        }
+        prev = rpm;
+    }
+    ESP_LOGW(TAG, "Speed did not settle, using %lu rpm", (unsigned long)prev);
+    return prev;
+}
+
+// Percentage p gets the frequency at which the motor runs at
+// rpm_min + (p - 1) / 99 * (rpm_max - rpm_min), interpolated between the points
+static bool build_lut(cal_point_t *points, int count, uint16_t *lut) {
+    // A curve that dips (measurement noise) would make the inverse ambiguous
+    for (int i = 1; i < count; i++) {
+        if (points[i].rpm < points[i - 1].rpm) {
+            points[i].rpm = points[i - 1].rpm;
+        }
+    }
+
+    uint32_t rpm_min = points[0].rpm;
+    uint32_t rpm_max = points[count - 1].rpm;
+    if (rpm_max <= rpm_min) {
+        return false;
+    }
+
+    lut[0] = points[0].freq;
+    int seg = 0;
+    for (int p = 1; p < FAN_LUT_SIZE; p++) {
+        uint32_t target = rpm_min + (rpm_max - rpm_min) * (p - 1) / 99;
+        while (seg < count - 2 && points[seg + 1].rpm < target) {
+            seg++;
+        }
+
+        const cal_point_t &a = points[seg];
+        const cal_point_t &b = points[seg + 1];
+        uint32_t freq = a.freq;
+        if (b.rpm > a.rpm && target > a.rpm) {
+            freq = a.freq + (b.freq - a.freq) * (target - a.rpm) / (b.rpm - a.rpm);
+        }
+        if (freq > b.freq) {
+            freq = b.freq;
+        }
+        lut[p] = freq < lut[p - 1] ? lut[p - 1] : freq;
+    }
+    return true;
+}
+
+static void fan_cal_task(void *pvParameters) {
+    static uint16_t lut[FAN_LUT_SIZE];
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        ESP_LOGI(TAG, "Calibration started, %d points from %d to %d Hz", FAN_CAL_POINTS, FAN_FREQ_MIN, FAN_FREQ_MAX);
+        buzzer_beep();
+        fan_calibration_begin();
+
+        int count = 0;
+        for (; count < FAN_CAL_POINTS && !cal_cancel; count++) {
+            uint32_t freq = FAN_FREQ_MIN + (FAN_FREQ_MAX - FAN_FREQ_MIN) * count / (FAN_CAL_POINTS - 1);
+            fan_calibration_set_frequency(freq);
+            uint32_t rpm = measure_steady_rpm();
+            cal_points[count].freq = freq;
+            cal_points[count].rpm = rpm > UINT16_MAX ? UINT16_MAX : rpm;
+            ESP_LOGI(TAG, "%3lu Hz: %5lu rpm", (unsigned long)freq, (unsigned long)rpm);
+        }
+
+        if (cal_cancel) {
+            ESP_LOGW(TAG, "Calibration cancelled");
+            fan_calibration_end(NULL);
+        } else if (!build_lut(cal_points, count, lut)) {
+            ESP_LOGE(TAG, "Calibration failed, no speed change measured on the FG line");
+            fan_calibration_end(NULL);
+        } else {
+            esp_err_t err = fan_calibration_end(lut);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to store the speed table: %s", esp_err_to_name(err));
+            }
+            ESP_LOGI(TAG, "Calibration done, %u rpm..%u rpm", cal_points[0].rpm, cal_points[count - 1].rpm);
+            buzzer_beep();
+        }
+
+        cal_cancel = false;
+        cal_running = false;
+    }
+}
+
+void fan_cal_start() {
+    if (cal_running) {
+        return;
+    }
+    cal_running = true;
+    xTaskNotifyGive(cal_task_handle);
+}
+
+void fan_cal_cancel() {
+    if (cal_running) {
+        cal_cancel = true;
+    }
+}
+
+bool fan_cal_running() {
+    return cal_running;
+}
+
+void fan_cal_init() {
+    app_task_create(APP_TASK_FAN_CAL, fan_cal_task, NULL, &cal_task_handle);
+}
+
+
+static esp_err_t fan_calibrate_handler(int argc, char **argv) {
+    if (argc > 0 && strcmp(argv[0], "cancel") == 0) {
+        fan_cal_cancel();
+        return ESP_OK;
+    }
+    if (fan_cal_running()) {
+        printf("Calibration already running\n");
+        return ESP_OK;
+    }
+    printf("Calibration takes about %d s\n",
+           FAN_CAL_POINTS * (FAN_CAL_SETTLE_MS + 2 * FAN_CAL_WINDOW_MS) / 1000);
+    fan_cal_start();
+    return ESP_OK;
+}
+
+static esp_err_t fan_lut_handler(int argc, char **argv) {
+    uint16_t lut[FAN_LUT_SIZE];
+    bool calibrated;
+    fan_get_lut(lut, &calibrated);
+
+    printf("# %s\n", calibrated ? "calibrated" : "default");
+    printf("percentage,freq_hz\n");
+    for (int p = 1; p < FAN_LUT_SIZE; p++) {
+        printf("%d,%u\n", p, lut[p]);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t fan_rpm_handler(int argc, char **argv) {
+    printf("percentage: %u, rpm: %lu\n", fan_get_percentage(), (unsigned long)fan_measure_rpm(1000));
+    return ESP_OK;
+}
+
+void fan_cal_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "fan-calibrate",
+            .description = "Sweep the motor and store a new speed table. Usage: fan-calibrate [cancel].",
+            .handler = fan_calibrate_handler,
+        },
+        {
+            .name = "fan-lut",
+            .description = "Print the percentage to PWM frequency table as CSV.",
+            .handler = fan_lut_handler,
+        },
+        {
+            .name = "fan-rpm",
+            .description = "Measure the motor speed on the FG line over 1 s.",
+            .handler = fan_rpm_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Motor calibration: sweeps the PWM frequency, measures the steady RPM on the
+// FG line and stores a table that makes the percentage linear in RPM (airflow)
+
+void fan_cal_init();
+
+// Start a sweep in the background, ignored if one is running
+void fan_cal_start();
+
+// Stop after the current point, the previous table is kept
+void fan_cal_cancel();
+
+bool fan_cal_running();
+
+void fan_cal_register_commands();
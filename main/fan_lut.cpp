@@ -0,0 +1,19 @@
+#include "fan_lut.h"
+#include "hw_conf.h"
+
+void fan_lut_default(uint16_t *lut) {
+    lut[0] = FAN_FREQ_MIN;
+    for (int p = 1; p < FAN_LUT_SIZE; p++) {
+        lut[p] = FAN_FREQ_MIN + (p - 1) * (FAN_FREQ_MAX - FAN_FREQ_MIN) / 99;
+    }
+}
+
+uint32_t fan_lut_frequency(const uint16_t *lut, uint8_t percentage) {
+    if (percentage == 0) {
+        return FAN_FREQ_MIN;
+    }
+    if (percentage > 100) {
+        percentage = 100;
+    }
+    return lut[percentage];
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Percentage to motor PWM frequency. Pure logic, also built into the host
+// tools (tools/host/microbench).
+
+// PWM frequency table, one entry per percentage
+#define FAN_LUT_SIZE 101
+
+// Linear in frequency, used until the motor is calibrated
+void fan_lut_default(uint16_t *lut);
+
+// Frequency for a percentage, FAN_FREQ_MIN while off, above 100 counts as 100
+uint32_t fan_lut_frequency(const uint16_t *lut, uint8_t percentage);
@@ -1,49 +1,75 @@
 #pragma once
 
-#define GPIO_LED_GREEN GPIO_NUM_33
-#define GPIO_LED_ORANGE GPIO_NUM_32
-#define GPIO_LED_RED GPIO_NUM_21
+#include "board.h"
 
-#define GPIO_BUZZER GPIO_NUM_4
+// Pins and peripherals of the board for the build target, see board.h
 
-#define GPIO_BTN_POWER GPIO_NUM_19
-#define GPIO_BTN_BRIGHTNESS GPIO_NUM_18
-#define GPIO_BTN_MODE GPIO_NUM_5
+#define GPIO_LED_GREEN static_cast<gpio_num_t>(BOARD.led_green)
+#define GPIO_LED_ORANGE static_cast<gpio_num_t>(BOARD.led_orange)
+#define GPIO_LED_RED static_cast<gpio_num_t>(BOARD.led_red)
 
-#define GPIO_LED_SDA GPIO_NUM_14
-#define GPIO_LED_SCL GPIO_NUM_27
+#define GPIO_BUZZER static_cast<gpio_num_t>(BOARD.buzzer)
 
-#define GPIO_EEPROM_SDA GPIO_NUM_36
-#define GPIO_EEPROM_SCL GPIO_NUM_37
+#define GPIO_BTN_POWER static_cast<gpio_num_t>(BOARD.btn_power)
+#define GPIO_BTN_BRIGHTNESS static_cast<gpio_num_t>(BOARD.btn_brightness)
+#define GPIO_BTN_MODE static_cast<gpio_num_t>(BOARD.btn_mode)
 
-#define GPIO_MOTOR_PWM GPIO_NUM_26 // OUT
-#define GPIO_MOTOR_BRK GPIO_NUM_2  // OUT
-#define GPIO_MOTOR_FG GPIO_NUM_34  // IN
-#define GPIO_MOTOR_5V GPIO_NUM_15  // OUT
+#define GPIO_LED_SDA static_cast<gpio_num_t>(BOARD.led_sda)
+#define GPIO_LED_SCL static_cast<gpio_num_t>(BOARD.led_scl)
+
+#define GPIO_EEPROM_SDA static_cast<gpio_num_t>(BOARD.eeprom_sda)
+#define GPIO_EEPROM_SCL static_cast<gpio_num_t>(BOARD.eeprom_scl)
+
+#define GPIO_MOTOR_PWM static_cast<gpio_num_t>(BOARD.motor_pwm) // OUT
+#define GPIO_MOTOR_BRK static_cast<gpio_num_t>(BOARD.motor_brk) // OUT
+#define GPIO_MOTOR_FG static_cast<gpio_num_t>(BOARD.motor_fg)   // IN
+#define GPIO_MOTOR_5V static_cast<gpio_num_t>(BOARD.motor_5v)   // OUT
 
 // PS for particle sensor
-#define GPIO_PMS_RX GPIO_NUM_16
-#define GPIO_PMS_TX GPIO_NUM_17
-#define GPIO_PMS_5V GPIO_NUM_13
+#define GPIO_PMS_RX static_cast<gpio_num_t>(BOARD.pms_rx)
+#define GPIO_PMS_TX static_cast<gpio_num_t>(BOARD.pms_tx)
+#define GPIO_PMS_5V static_cast<gpio_num_t>(BOARD.pms_5v)
+// Sensor supply is enabled by pulling the pin to this level
+#define PMS_5V_ON_LEVEL (BOARD.pms_5v_on_level)
+
 
+// Peripherals
 
-// ESP32 peripherals
+// Motor and RGB PWM, the buzzer always uses LEDC_LOW_SPEED_MODE
+#define LEDC_MODE_PWM board_ledc_mode(BOARD)
 
-#define LEDC_TIMER_MOTOR_PWM LEDC_TIMER_0
-#define LEDC_TIMER_RGB LEDC_TIMER_1
-#define LEDC_TIMER_BUZZER LEDC_TIMER_2
+#define LEDC_TIMER_MOTOR_PWM static_cast<ledc_timer_t>(BOARD.ledc_timer_motor)
+#define LEDC_TIMER_RGB static_cast<ledc_timer_t>(BOARD.ledc_timer_rgb)
+#define LEDC_TIMER_BUZZER static_cast<ledc_timer_t>(BOARD.ledc_timer_buzzer)
 
-#define LEDC_CHANNEL_MOTOR_PWM LEDC_CHANNEL_0
-#define LEDC_CHANNEL_RGB_R LEDC_CHANNEL_1
-#define LEDC_CHANNEL_RGB_G LEDC_CHANNEL_2
-#define LEDC_CHANNEL_RGB_B LEDC_CHANNEL_3
-#define LEDC_CHANNEL_BUZZER LEDC_CHANNEL_4
+#define LEDC_CHANNEL_MOTOR_PWM static_cast<ledc_channel_t>(BOARD.ledc_channel_motor)
+#define LEDC_CHANNEL_LED_GREEN static_cast<ledc_channel_t>(BOARD.ledc_channel_green)
+#define LEDC_CHANNEL_LED_ORANGE static_cast<ledc_channel_t>(BOARD.ledc_channel_orange)
+#define LEDC_CHANNEL_LED_RED static_cast<ledc_channel_t>(BOARD.ledc_channel_red)
+#define LEDC_CHANNEL_BUZZER static_cast<ledc_channel_t>(BOARD.ledc_channel_buzzer)
 
-#define UART_PMS UART_NUM_1
+#define UART_PMS static_cast<uart_port_t>(BOARD.uart_pms)
+#define I2C_LED static_cast<i2c_port_t>(BOARD.i2c_led)
 
 #define BUZZER_FREQUENCY 2000
 #define BUZZER_BEEP_TIME_MS 60
 
+// Air quality color changes fade over this time
+#define LED_AQ_FADE_MS 1500
+
+// Motor PWM frequency range, slowest to fastest
+#define FAN_FREQ_MIN 100
+#define FAN_FREQ_MAX 511
+// Tachometer pulses per motor revolution on GPIO_MOTOR_FG
+#define FAN_FG_PULSES_PER_REV 2
+// Cached RPM samples further apart than this are dropped, the pulse counter
+// may have wrapped more than once (32767 pulses, 9 min at 1800 rpm)
+#define FAN_RPM_SAMPLE_MAX_MS 60000
+// Calibration sweep: measured frequencies, time to settle, RPM averaging window
+#define FAN_CAL_POINTS 24
+#define FAN_CAL_SETTLE_MS 3000
+#define FAN_CAL_WINDOW_MS 2000
+
 #define AUTO_GOOD_PERCENT 30
 #define AUTO_FAIR_PERCENT 45
 #define AUTO_MODERATE_PERCENT 60
@@ -52,3 +78,76 @@
 #define AUTO_XPOOR_PERCENT 100
 #define AUTO_UNKNOWN_PERCENT AUTO_GOOD_PERCENT
 
+// Fan writes from Matter are applied by a worker task at most once per interval,
+// only the latest value is kept. Set to 0 to apply them inside the Matter callback.
+#define FAN_WRITE_COALESCE 1
+#define FAN_WRITE_MIN_INTERVAL_MS 100
+
+// Binary event trace, see trace.h. Ring size in 16 byte records, power of two
+#define TRACE_ENABLE 1
+#define TRACE_RING_RECORDS 512
+
+// Sensor UART and button capture for host replay, see capture.h. A reading
+// takes about 9 bytes, so 8 KB holds around a quarter hour
+#define CAPTURE_ENABLE 1
+#define CAPTURE_RING_SIZE 8192
+
+// Prometheus endpoint, see metrics_http.h. Unauthenticated, off by default
+#define METRICS_HTTP_ENABLE 0
+#define METRICS_HTTP_PORT 9100
+#define METRICS_BUF_SIZE 4096
+
+// Copy of the log output kept for the Matter Diagnostic Logs cluster
+#define LOG_RING_SIZE 8192
+
+// Connect straight to the last AP (BSSID/channel cached in NVS) before scanning
+#define WIFI_FAST_CONNECT 1
+
+// Nominal power model, replace with wall measurements using energy-cal
+#define POWER_MODEL_BASE_MW 1200
+#define POWER_MODEL_FAN_MIN_MW 1500
+#define POWER_MODEL_FAN_MAX_MW 38000
+#define POWER_MODEL_LED_MW { 0, 60, 200, 600 }
+// Report power after a change of this many mW or percent, whichever is larger
+#define ENERGY_POWER_REPORT_MW 500
+#define ENERGY_POWER_REPORT_PERCENT 5
+// Report cumulative energy after it grew by this much
+#define ENERGY_REPORT_MWH 1000
+// Persist energy at most this often, at most this much is lost on power loss
+#define ENERGY_SAVE_INTERVAL_S 3600
+
+// DFS and automatic light sleep (also needs CONFIG_PM_ENABLE and tickless idle)
+#define POWER_MGMT_ENABLE 1
+// XTAL frequency, the lowest the ESP32 runs at with Wi-Fi on
+#define POWER_MIN_CPU_FREQ_MHZ 40
+// Beacon intervals between wakeups in modem sleep, 3 x 102.4 ms stays below
+// the 500 ms MRP idle retry interval
+#define POWER_WIFI_LISTEN_INTERVAL 3
+// Rough module current from the ESP32 datasheet, for the idle estimate only
+#define POWER_EST_ACTIVE_UA 30000
+#define POWER_EST_LIGHT_SLEEP_UA 800
+
+// The Wi-Fi indicator follows events, this poll only catches missed ones
+#define WIRELESS_MONITOR_POLL_MS 30000
+
+// Flood the network with multicast UDP to measure control loop jitter under load
+#define TASK_NET_STRESS 0
+
+// Auto mode strategy, AUTO_STRATEGY_STAIRCASE or AUTO_STRATEGY_PREDICTIVE
+#define AUTO_STRATEGY AUTO_STRATEGY_STAIRCASE
+// Seconds of PM2.5 history used to estimate the trend (max 60)
+#define AUTO_TREND_WINDOW_S 30
+// How far ahead the trend is extrapolated
+#define AUTO_PREDICT_HORIZON_S 120
+// Trends slower than this (ug/m3 per minute) are ignored
+#define AUTO_TREND_DEADBAND 3
+// Max levels the prediction may add on top of the current one
+#define AUTO_PREDICT_MAX_BOOST 2
+
+// PM2.5 filtering between the sensor and the auto controller
+#define PM_FILTER_OUTLIER PM_FILTER_HAMPEL
+#define PM_FILTER_WINDOW 5
+#define PM_FILTER_HAMPEL_K_Q8 (3 * 256)
+#define PM_FILTER_HAMPEL_MIN_DEV 5
+#define PM_FILTER_EMA_ALPHA_Q8 96
+
@@ -7,11 +7,19 @@
 #include "driver/i2c.h"
 
 #include "led.h"
+#include "led_status.h"
+#include "color.h"
+#include "trace.h"
 #include "hw_conf.h"
+#include "tasks.h"
+#include "power_mgmt.h"
 
+#include "esp_timer.h"
 
-#define LEDC_MODE LEDC_HIGH_SPEED_MODE
-#define LEDC_RESOLUTION LEDC_TIMER_8_BIT
+
+#define LEDC_MODE LEDC_MODE_PWM
+#define LEDC_RESOLUTION LEDC_TIMER_13_BIT
+static_assert(LEDC_RESOLUTION == LED_DUTY_BITS, "LEDC resolution must match the color tables");
 
 #define BTN_FULL_BRIGHT 0x3C
 #define BTN_HALF_BRIGHT 0x28
@@ -25,16 +33,35 @@
 #define TAG "LED"
 
 
-static uint8_t rgb_dim_bits;
-static uint8_t rgb_channels[3];
+// Lightness of the color LEDs per brightness level, level 2 gives a quarter of the light
+static const uint8_t level_lightness[] = { 0, 0, 146, 255 };
+
+static const ledc_channel_t rgb_ledc_channels[3] = {
+    LEDC_CHANNEL_LED_GREEN, LEDC_CHANNEL_LED_ORANGE, LEDC_CHANNEL_LED_RED
+};
 
-static uint8_t status_on_mask;
-static uint8_t status_blink_mask;
-// Only for optimization
-static uint8_t status_current;
+static uint8_t rgb_lightness;
+static uint8_t brightness_level;
+static led_color_t rgb_color;
+// Any color output above zero, LEDC needs the APB clock then
+static volatile bool rgb_lit;
+static esp_timer_handle_t rgb_release_timer;
+
+static led_status_t status;
 // Changes with blinking leds
 static volatile bool blink_cycle_on;
-static volatile bool status_indicators_enabled;
+static TaskHandle_t blink_task_handle;
+
+// Animations from the sequencer, shown at full brightness over the normal state
+static bool rgb_override_active;
+static led_color_t rgb_override;
+
+// A fade to black is over, the outputs can stop with the clock
+static void rgb_release_cb(void *arg) {
+    if (!rgb_lit) {
+        power_hold(POWER_LOCK_RGB, false);
+    }
+}
 
 void led_rgb_init() {
     // Prepare and configure the LEDC timer
@@ -47,64 +74,100 @@ void led_rgb_init() {
     };
     ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
 
-    ledc_channel_config_t ledc_conf_r = {
-        .gpio_num = GPIO_LED_GREEN,
-        .speed_mode = LEDC_MODE,
-        .channel = LEDC_CHANNEL_RGB_R,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = LEDC_TIMER_RGB,
-        .duty = 0,
-        .hpoint = 0,
-    };
-    ledc_channel_config(&ledc_conf_r);
+    static const gpio_num_t gpios[3] = { GPIO_LED_GREEN, GPIO_LED_ORANGE, GPIO_LED_RED };
+    for (int i = 0; i < 3; i++) {
+        ledc_channel_config_t ledc_conf = {
+            .gpio_num = gpios[i],
+            .speed_mode = LEDC_MODE,
+            .channel = rgb_ledc_channels[i],
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = LEDC_TIMER_RGB,
+            .duty = 0,
+            .hpoint = 0,
+        };
+        ledc_channel_config(&ledc_conf);
+    }
 
-    ledc_channel_config_t ledc_conf_g = {
-        .gpio_num = GPIO_LED_ORANGE,
-        .speed_mode = LEDC_MODE,
-        .channel = LEDC_CHANNEL_RGB_G,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = LEDC_TIMER_RGB,
-        .duty = 0,
-        .hpoint = 0,
-    };
-    ledc_channel_config(&ledc_conf_g);
+    // Initialize fade service.
+    ledc_fade_func_install(0);
 
-    ledc_channel_config_t ledc_conf_b = {
-        .gpio_num = GPIO_LED_RED,
-        .speed_mode = LEDC_MODE,
-        .channel = LEDC_CHANNEL_RGB_B,
-        .intr_type = LEDC_INTR_DISABLE,
-        .timer_sel = LEDC_TIMER_RGB,
-        .duty = 0,
-        .hpoint = 0,
+    const esp_timer_create_args_t timer_args = {
+        .callback = rgb_release_cb,
+        .name = "rgb_release",
     };
-    ledc_channel_config(&ledc_conf_b);
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &rgb_release_timer));
+}
 
-    // Initialize fade service.
-    ledc_fade_func_install(0);
+// Write the color, either at once or with a hardware fade
+static void led_rgb_write(led_color_t color, uint8_t lightness, int fade_time_ms) {
+    const uint8_t components[3] = { color.green, color.orange, color.red };
+    TRACE(TRACE_LED_RGB, color.green << 16 | color.orange << 8 | color.red, lightness << 16 | (fade_time_ms & 0xFFFF));
+
+    uint32_t duties[3];
+    bool lit = false;
+    for (int i = 0; i < 3; i++) {
+        duties[i] = led_color_duty(components[i], lightness);
+        lit |= duties[i] != 0;
+    }
+    // Hold the clock for the whole fade, also when it fades to black
+    esp_timer_stop(rgb_release_timer);
+    rgb_lit = lit;
+    if (lit || fade_time_ms > 0) {
+        power_hold(POWER_LOCK_RGB, true);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        uint32_t duty = duties[i];
+        // A running fade holds the channel until it ends
+        ledc_fade_stop(LEDC_MODE, rgb_ledc_channels[i]);
+        if (fade_time_ms > 0) {
+            ledc_set_fade_time_and_start(LEDC_MODE, rgb_ledc_channels[i], duty, fade_time_ms, LEDC_FADE_NO_WAIT);
+        } else {
+            ledc_set_duty(LEDC_MODE, rgb_ledc_channels[i], duty);
+            ledc_update_duty(LEDC_MODE, rgb_ledc_channels[i]);
+        }
+    }
+
+    if (!lit) {
+        if (fade_time_ms > 0) {
+            esp_timer_start_once(rgb_release_timer, fade_time_ms * 1000LL);
+        } else {
+            power_hold(POWER_LOCK_RGB, false);
+        }
+    }
 }
 
 void led_rgb_update() {
-    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL_RGB_R, rgb_channels[0] >> rgb_dim_bits);
-    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL_RGB_G, rgb_channels[1] >> rgb_dim_bits);
-    ledc_set_duty(LEDC_MODE, LEDC_CHANNEL_RGB_B, rgb_channels[2] >> rgb_dim_bits);
-    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL_RGB_R);
-    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL_RGB_G);
-    ledc_update_duty(LEDC_MODE, LEDC_CHANNEL_RGB_B);
-}
-
-void led_rgb_set(uint32_t ch0, uint32_t ch1, uint32_t ch2) {
-    rgb_channels[0] = ch0;
-    rgb_channels[1] = ch1;
-    rgb_channels[2] = ch2;
+    if (rgb_override_active) {
+        led_rgb_write(rgb_override, 255, 0);
+    } else {
+        led_rgb_write(rgb_color, rgb_lightness, 0);
+    }
+}
+
+static bool led_color_equal(led_color_t a, led_color_t b) {
+    return a.green == b.green && a.orange == b.orange && a.red == b.red;
+}
+
+void led_rgb_set(led_color_t color) {
+    rgb_color = color;
     led_rgb_update();
 }
 
+void led_rgb_fade(led_color_t color, int fade_time_ms) {
+    if (led_color_equal(color, rgb_color)) {
+        return;
+    }
+    rgb_color = color;
+    if (!rgb_override_active) {
+        led_rgb_write(rgb_color, rgb_lightness, fade_time_ms);
+    }
+}
 
-void led_rgb_fade(uint32_t red, uint32_t green, uint32_t blue, int fade_time_ms) {
-    ledc_set_fade_time_and_start(LEDC_MODE, LEDC_CHANNEL_RGB_R, red, fade_time_ms, LEDC_FADE_NO_WAIT);
-    ledc_set_fade_time_and_start(LEDC_MODE, LEDC_CHANNEL_RGB_G, green, fade_time_ms, LEDC_FADE_NO_WAIT);
-    ledc_set_fade_time_and_start(LEDC_MODE, LEDC_CHANNEL_RGB_B, blue, fade_time_ms, LEDC_FADE_NO_WAIT);
+void led_rgb_override(led_color_t color) {
+    rgb_override = color;
+    rgb_override_active = true;
+    led_rgb_update();
 }
 
 
@@ -114,7 +177,7 @@ void cms_send(uint8_t command, uint8_t value) {
     i2c_master_write_byte(cmd, command, 1);
     i2c_master_write_byte(cmd, value, 1);
     i2c_master_stop(cmd);
-    ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_NUM_0, cmd, -1));
+    ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_LED, cmd, -1));
 }
 
 // brightness from 0 (off) to 8 (max)
@@ -133,80 +196,99 @@ void led_status_brightness(uint8_t brightness) {
 
 
 void led_status_show() {
-    uint8_t current_indicators = 0;
-    if (status_indicators_enabled) {
-        current_indicators = status_on_mask;
-        if (blink_cycle_on) {
-            current_indicators |= status_blink_mask;
-        }
-    }
     // Send only if needed
-    if (current_indicators != status_current) {
-        cms_send(0x68, current_indicators);
-        status_current = current_indicators;
+    if (led_status_update(&status, blink_cycle_on)) {
+        TRACE(TRACE_LED_STATUS, status.current, 0);
+        cms_send(0x68, status.current);
     }
 }
 
 void led_status_set_on(uint8_t mask) {
-    status_on_mask |= mask;
+    status.on_mask |= mask;
     led_status_show();
 }
 
 void led_status_set_blink(uint8_t mask) {
     // If the indicator should blink, it cannot be in the on mask
-    status_on_mask &= ~mask;
-    status_blink_mask |= mask;
+    status.on_mask &= ~mask;
+    status.blink_mask |= mask;
     led_status_show();
+    if (blink_task_handle != NULL) {
+        xTaskNotifyGive(blink_task_handle);
+    }
 }
 
 void led_status_set_off(uint8_t mask) {
-    status_on_mask &= ~mask;
-    status_blink_mask &= ~mask;
+    status.on_mask &= ~mask;
+    status.blink_mask &= ~mask;
+    led_status_show();
+}
+
+void led_status_override(uint8_t mask) {
+    status.override_mask = mask;
+    led_status_show();
+}
+
+void led_release_override() {
+    rgb_override_active = false;
+    status.override_mask = 0;
+    led_rgb_update();
     led_status_show();
 }
 
 // level 0 (off), 1 (only power button), 2 (everything but dim), 3 (everything max brightness)
 void led_set_brightness(uint8_t level) {
+    brightness_level = level;
     if (level == 0) {
         led_status_brightness(0);
-        rgb_dim_bits = 8;
+        rgb_lightness = level_lightness[level];
         led_rgb_update();
         
     } else if (level == 1) {
         led_status_brightness(1);
-        status_indicators_enabled = false;
+        status.enabled = false;
         led_status_show();
         cms_send(BTN_POWER_BACKLIGHT, BTN_HALF_BRIGHT);
         cms_send(BTN_BRIGHTNESS_BACKLIGHT, BTN_ZERO_BRIGHT);
         cms_send(BTN_MODE_BACKLIGHT, BTN_ZERO_BRIGHT);
-        rgb_dim_bits = 8;
+        rgb_lightness = level_lightness[level];
         led_rgb_update();
 
     } else if (level == 2) {
         led_status_brightness(1);
-        status_indicators_enabled = true;
+        status.enabled = true;
         led_status_show();
         cms_send(BTN_POWER_BACKLIGHT, BTN_FULL_BRIGHT);
         cms_send(BTN_BRIGHTNESS_BACKLIGHT, BTN_FULL_BRIGHT);
         cms_send(BTN_MODE_BACKLIGHT, BTN_FULL_BRIGHT);
-        rgb_dim_bits = 2;
+        rgb_lightness = level_lightness[level];
         led_rgb_update();
 
     } else if (level == 3) {
         led_status_brightness(8);
-        status_indicators_enabled = true;
+        status.enabled = true;
         led_status_show();
         cms_send(BTN_POWER_BACKLIGHT, BTN_FULL_BRIGHT);
         cms_send(BTN_BRIGHTNESS_BACKLIGHT, BTN_FULL_BRIGHT);
         cms_send(BTN_MODE_BACKLIGHT, BTN_FULL_BRIGHT);
-        rgb_dim_bits = 0;
+        rgb_lightness = level_lightness[level];
         led_rgb_update();
     }
 }
 
+uint8_t led_get_brightness() {
+    return brightness_level;
+}
+
 
 void blink_task(void *pvParameters) {
     while (1) {
+        // No wakeups while nothing blinks
+        if (status.blink_mask == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
         blink_cycle_on = true;
         led_status_show();
         vTaskDelay(pdMS_TO_TICKS(750));
@@ -225,10 +307,10 @@ void led_status_init() {
         .scl_io_num = GPIO_LED_SCL,
         .master = { .clk_speed = 100000 },
     };
-    i2c_param_config(I2C_NUM_0, &conf);
-    i2c_driver_install(I2C_NUM_0, conf.mode, 0, 0, 0);
+    i2c_param_config(I2C_LED, &conf);
+    i2c_driver_install(I2C_LED, conf.mode, 0, 0, 0);
 
-    xTaskCreate(blink_task, "blink_task", 1024, NULL, 5, NULL);
+    app_task_create(APP_TASK_BLINK, blink_task, NULL, &blink_task_handle);
 }
 
 
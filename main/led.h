@@ -1,5 +1,9 @@
+#pragma once
+
 #include <cstdint>
 
+#include "color.h"
+
 #define LED_IND_WARNING (1<<0)
 #define LED_IND_WIFI    (1<<1)
 #define LED_IND_LOCK    (1<<2)
@@ -12,14 +16,27 @@
 
 void led_init();
 
-void led_rgb_set(uint32_t red, uint32_t green, uint32_t blue);
+// Color in perceptual steps, dimmed by the brightness level
+void led_rgb_set(led_color_t color);
 
-void led_rgb_fade(uint32_t red, uint32_t green, uint32_t blue, int fade_time_ms);
+// Same through the LEDC fade unit, nothing happens if the color does not change
+void led_rgb_fade(led_color_t color, int fade_time_ms);
 
 void led_set_brightness(uint8_t level);
 
+// Level last set with led_set_brightness()
+uint8_t led_get_brightness();
+
 void led_status_set_on(uint8_t mask);
 
 void led_status_set_blink(uint8_t mask);
 
-void led_status_set_off(uint8_t mask);
\ No newline at end of file
+void led_status_set_off(uint8_t mask);
+
+// Temporarily replace what the RGB LEDs and indicators show, used by the sequencer
+void led_rgb_override(led_color_t color);
+
+void led_status_override(uint8_t mask);
+
+// Back to the normal state set by led_rgb_set/led_status_set_*
+void led_release_override();
\ No newline at end of file
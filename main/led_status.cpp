@@ -0,0 +1,17 @@
+#include "led_status.h"
+
+bool led_status_update(led_status_t *status, bool blink_on) {
+    uint8_t indicators = 0;
+    if (status->enabled) {
+        indicators = status->on_mask;
+        if (blink_on) {
+            indicators |= status->blink_mask;
+        }
+    }
+    indicators |= status->override_mask;
+    if (indicators == status->current) {
+        return false;
+    }
+    status->current = indicators;
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Indicator LEDs on the front panel controller. Pure logic, also built into
+// the host tools (tools/host/microbench).
+
+struct led_status_t {
+    uint8_t on_mask;
+    uint8_t blink_mask;
+    // Off at brightness 1, where only the power button is lit
+    bool enabled;
+    // Sequencer animations, shown over everything else
+    uint8_t override_mask;
+    // What the controller shows now
+    uint8_t current;
+};
+
+// Indicators for the blink phase. True when they differ from current, which
+// is then updated and has to be sent.
+bool led_status_update(led_status_t *status, bool blink_on);
@@ -0,0 +1,87 @@
+#include "log_ring.h"
+#include "hw_conf.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <esp_log.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Longer log lines are cut in the ring, not on the console
+#define LOG_RING_LINE_MAX 192
+
+static char log_ring[LOG_RING_SIZE];
+static uint32_t log_head;
+// Guards the ring and the line buffer. A mutex, not a critical section, so
+// formatting and reader copies never hold off interrupts.
+static SemaphoreHandle_t log_mutex;
+static char log_line[LOG_RING_LINE_MAX];
+
+static vprintf_like_t console_vprintf;
+
+
+static void log_ring_write(const char *data, size_t len) {
+    size_t offset = log_head % LOG_RING_SIZE;
+    size_t first = len < LOG_RING_SIZE - offset ? len : LOG_RING_SIZE - offset;
+    memcpy(&log_ring[offset], data, first);
+    memcpy(log_ring, data + first, len - first);
+    log_head += len;
+}
+
+static int log_ring_vprintf(const char *format, va_list args) {
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return console_vprintf(format, args);
+    }
+
+    // Formatted once, the console gets the same line unless it was cut
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(log_line, sizeof(log_line), format, copy);
+    va_end(copy);
+    bool cut = len >= (int)sizeof(log_line);
+    if (len > 0) {
+        size_t kept = cut ? sizeof(log_line) - 1 : len;
+        if (cut) {
+            log_line[kept - 1] = '\n';
+        }
+        log_ring_write(log_line, kept);
+    }
+    int written = len >= 0 && !cut ? console_vprintf("%s", log_line) : -1;
+    xSemaphoreGive(log_mutex);
+
+    return written >= 0 ? written : console_vprintf(format, args);
+}
+
+void log_ring_init() {
+    log_mutex = xSemaphoreCreateMutex();
+    console_vprintf = esp_log_set_vprintf(log_ring_vprintf);
+}
+
+void log_ring_range(uint32_t *start, uint32_t *end) {
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    *end = log_head;
+    *start = log_head > LOG_RING_SIZE ? log_head - LOG_RING_SIZE : 0;
+    xSemaphoreGive(log_mutex);
+}
+
+size_t log_ring_read(uint32_t *pos, uint32_t end, char *out, size_t max) {
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    if (log_head - *pos > LOG_RING_SIZE) {
+        *pos = log_head - LOG_RING_SIZE;
+    }
+    size_t len = end > *pos ? end - *pos : 0;
+    if (len > max) {
+        len = max;
+    }
+    size_t offset = *pos % LOG_RING_SIZE;
+    size_t first = len < LOG_RING_SIZE - offset ? len : LOG_RING_SIZE - offset;
+    memcpy(out, &log_ring[offset], first);
+    memcpy(out + first, log_ring, len - first);
+    *pos += len;
+    xSemaphoreGive(log_mutex);
+    return len;
+}
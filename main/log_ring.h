@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Copy of the ESP log output in a RAM ring, exported through the Matter
+// Diagnostic Logs cluster. Positions are absolute byte counts since boot.
+
+// Hook into esp_log, the serial output is kept
+void log_ring_init();
+
+// Oldest and next position in the ring
+void log_ring_range(uint32_t *start, uint32_t *end);
+
+// Copy bytes from *pos up to end into out, advances *pos. If the writer
+// already overwrote *pos the read starts at the oldest byte still there.
+size_t log_ring_read(uint32_t *pos, uint32_t end, char *out, size_t max);
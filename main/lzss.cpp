@@ -0,0 +1,67 @@
+#include "lzss.h"
+
+#include <string.h>
+
+// Hand the window to the sink before it wraps, and at the end of every feed
+static bool flush(lzss_t *lz, lzss_sink_t sink, void *ctx) {
+    bool ok = lz->pos == lz->flushed || sink(ctx, &lz->window[lz->flushed], lz->pos - lz->flushed);
+    lz->flushed = lz->pos;
+    return ok;
+}
+
+static bool put(lzss_t *lz, uint8_t byte, lzss_sink_t sink, void *ctx) {
+    lz->window[lz->pos++] = byte;
+    if (lz->pos < LZSS_WINDOW_SIZE) {
+        return true;
+    }
+    bool ok = flush(lz, sink, ctx);
+    lz->pos = 0;
+    lz->flushed = 0;
+    return ok;
+}
+
+void lzss_init(lzss_t *lz) {
+    memset(lz, 0, sizeof(*lz));
+}
+
+bool lzss_decode(lzss_t *lz, const uint8_t *data, size_t len, lzss_sink_t sink, void *ctx) {
+    size_t i = 0;
+    while (i < len) {
+        if (lz->flag_items == 0 && !lz->match_split) {
+            lz->flags = data[i++];
+            lz->flag_items = 8;
+            continue;
+        }
+
+        if (lz->flags & 1) {
+            if (!put(lz, data[i++], sink, ctx)) {
+                return false;
+            }
+        } else {
+            if (!lz->match_split) {
+                lz->match_lo = data[i++];
+                lz->match_split = true;
+                continue;
+            }
+            uint8_t hi = data[i++];
+            lz->match_split = false;
+            uint16_t distance = (lz->match_lo | (hi >> 4) << 8) + 1;
+            uint8_t length = (hi & 0x0F) + LZSS_MIN_MATCH;
+            uint16_t from = (lz->pos - distance) & (LZSS_WINDOW_SIZE - 1);
+            // Byte by byte, a match may overlap its own output
+            for (uint8_t n = 0; n < length; n++) {
+                if (!put(lz, lz->window[from], sink, ctx)) {
+                    return false;
+                }
+                from = (from + 1) & (LZSS_WINDOW_SIZE - 1);
+            }
+        }
+        lz->flags >>= 1;
+        lz->flag_items--;
+    }
+    return flush(lz, sink, ctx);
+}
+
+bool lzss_complete(const lzss_t *lz) {
+    return !lz->match_split;
+}
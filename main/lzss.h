@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming LZSS decoder with a fixed window, output goes to a sink as it is
+// produced. Pure logic, also built into the host tools. tools/ota_compress.py
+// is the matching encoder.
+//
+// Stream layout: a flags byte, then 8 items, bit 0 of the flags first.
+//   flag 1: one literal byte
+//   flag 0: two bytes d0 d1, distance = (d0 | (d1 >> 4) << 8) + 1,
+//           length = (d1 & 0x0F) + LZSS_MIN_MATCH
+// The stream simply ends, the container carries the decoded size.
+#define LZSS_WINDOW_BITS 12
+#define LZSS_WINDOW_SIZE (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH (LZSS_MIN_MATCH + 15)
+
+// Returns false to stop decoding
+typedef bool (*lzss_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+struct lzss_t {
+    uint8_t window[LZSS_WINDOW_SIZE];
+    // Next write position, and the start of bytes the sink has not seen
+    uint16_t pos;
+    uint16_t flushed;
+    uint8_t flags;
+    // Items left under the current flags byte
+    uint8_t flag_items;
+    // First byte of a match split between two feeds
+    uint8_t match_lo;
+    bool match_split;
+};
+
+void lzss_init(lzss_t *lz);
+
+// Decode the next input bytes, false if the sink stopped
+bool lzss_decode(lzss_t *lz, const uint8_t *data, size_t len, lzss_sink_t sink, void *ctx);
+
+// The input ended on an item boundary
+bool lzss_complete(const lzss_t *lz);
@@ -0,0 +1,108 @@
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+struct metrics_writer_t {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+};
+
+
+static void metrics_printf(metrics_writer_t *w, const char *format, ...) {
+    if (w->overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w->buf + w->len, w->size - w->len, format, args);
+    va_end(args);
+    if (n < 0 || static_cast<size_t>(n) >= w->size - w->len) {
+        w->overflow = true;
+        return;
+    }
+    w->len += n;
+}
+
+// TYPE, HELP and optionally UNIT lines of a metric family
+static void metrics_family(metrics_writer_t *w, const char *name, const char *type, const char *help,
+                           const char *unit = nullptr) {
+    metrics_printf(w, "# TYPE %s %s\n", name, type);
+    if (unit != nullptr) {
+        metrics_printf(w, "# UNIT %s %s\n", name, unit);
+    }
+    metrics_printf(w, "# HELP %s %s\n", name, help);
+}
+
+static void metrics_gauge(metrics_writer_t *w, const char *name, const char *help, uint64_t value,
+                          const char *unit = nullptr) {
+    metrics_family(w, name, "gauge", help, unit);
+    metrics_printf(w, "%s %llu\n", name, (unsigned long long)value);
+}
+
+// Counter family with one sample per label value
+static void metrics_counters(metrics_writer_t *w, const char *name, const char *help, const char *label,
+                             const char *const *label_values, const uint32_t *values, size_t count) {
+    metrics_family(w, name, "counter", help);
+    for (size_t i = 0; i < count; i++) {
+        metrics_printf(w, "%s_total{%s=\"%s\"} %lu\n", name, label, label_values[i], (unsigned long)values[i]);
+    }
+}
+
+size_t metrics_format(const metrics_snapshot_t *m, char *buf, size_t size) {
+    metrics_writer_t w = { buf, size, 0, size == 0 };
+
+    metrics_family(&w, "purifier_uptime_seconds", "gauge", "Time since boot.", "seconds");
+    metrics_printf(&w, "purifier_uptime_seconds %llu.%03u\n", (unsigned long long)(m->uptime_ms / 1000),
+                   (unsigned)(m->uptime_ms % 1000));
+
+    if (m->has_reading) {
+        metrics_family(&w, "purifier_pm25_micrograms_per_cubic_meter", "gauge",
+                       "PM2.5 concentration, as read and after the outlier filter.", "micrograms_per_cubic_meter");
+        metrics_printf(&w, "purifier_pm25_micrograms_per_cubic_meter{stage=\"raw\"} %u\n", m->pm25_raw);
+        metrics_printf(&w, "purifier_pm25_micrograms_per_cubic_meter{stage=\"filtered\"} %u\n", m->pm25);
+        metrics_gauge(&w, "purifier_air_quality",
+                      "Matter AirQualityEnum, 0 unknown, 1 good to 6 extremely poor.", m->air_quality);
+    }
+
+    metrics_gauge(&w, "purifier_fan_mode", "Matter FanModeEnum, 0 off, 1 low, 2 medium, 3 high, 5 auto.",
+                  m->fan_mode);
+    metrics_gauge(&w, "purifier_fan_speed_percent", "Fan speed setpoint.", m->fan_percent);
+    metrics_gauge(&w, "purifier_fan_rpm", "Motor speed from the tachometer.", m->fan_rpm);
+
+    static const char *const report_results[] = { "sent", "suppressed" };
+    const uint32_t reports[] = { m->reports_sent, m->reports_suppressed };
+    metrics_counters(&w, "purifier_attribute_reports", "Changed attribute values reported, or held back by a reporting threshold.",
+                     "result", report_results, reports, 2);
+
+    static const char *const frame_results[] = { "ok", "timeout", "bad", "checksum" };
+    const uint32_t frames[] = { m->frames_ok, m->frames_timeout, m->frames_bad, m->frames_checksum };
+    metrics_counters(&w, "purifier_sensor_frames", "Particle sensor responses by result.",
+                     "result", frame_results, frames, 4);
+
+    static const char *const recovery_actions[] = { "flush", "reinit", "power_cycle" };
+    const uint32_t recoveries[] = { m->uart_flushes, m->uart_reinits, m->power_cycles };
+    metrics_counters(&w, "purifier_sensor_recoveries", "Recovery actions taken on the particle sensor link.",
+                     "action", recovery_actions, recoveries, 3);
+
+    metrics_gauge(&w, "purifier_sensor_health", "Sensor link condition, 0 ok, 1 degraded, 2 dead.", m->sensor_health);
+
+    metrics_gauge(&w, "purifier_heap_free_bytes", "Free heap.", m->heap_free, "bytes");
+    metrics_gauge(&w, "purifier_heap_min_free_bytes", "Lowest free heap since boot.", m->heap_min_free, "bytes");
+    metrics_gauge(&w, "purifier_heap_largest_free_block_bytes", "Largest allocatable heap block.",
+                  m->heap_largest_block, "bytes");
+
+    if (m->task_count > 0) {
+        metrics_family(&w, "purifier_task_stack_free_bytes", "gauge", "Lowest free stack since the task started.",
+                       "bytes");
+        for (uint8_t i = 0; i < m->task_count && i < METRICS_TASKS_MAX; i++) {
+            metrics_printf(&w, "purifier_task_stack_free_bytes{task=\"%s\"} %lu\n", m->tasks[i].name,
+                           (unsigned long)m->tasks[i].stack_free);
+        }
+    }
+
+    metrics_printf(&w, "# EOF\n");
+    return w.overflow ? 0 : w.len;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// OpenMetrics text exposition of the device telemetry, for Prometheus. Pure
+// logic: the firmware fills a snapshot for its HTTP endpoint (metrics_http.h)
+// and the host device simulator serves the same text, so scrapers can be
+// tested without hardware. Formatting writes into the caller's buffer and
+// never allocates.
+
+// Content-Type of the exposition
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+#define METRICS_TASKS_MAX 16
+
+struct metrics_task_t {
+    const char *name;
+    // Lowest free stack seen, bytes
+    uint32_t stack_free;
+};
+
+struct metrics_snapshot_t {
+    uint64_t uptime_ms;
+    // No reading since boot leaves the PM and air quality gauges out
+    bool has_reading;
+    uint16_t pm25_raw;
+    uint16_t pm25;
+    // AirQualityEnum, 0 unknown to 6 extremely poor
+    uint8_t air_quality;
+    // FanModeEnum
+    uint8_t fan_mode;
+    uint8_t fan_percent;
+    uint32_t fan_rpm;
+    // Changed attribute values reported to the Matter stack and ones held back by a reporting threshold
+    uint32_t reports_sent;
+    uint32_t reports_suppressed;
+    // Sensor link, the pms_stats_t counters
+    uint32_t frames_ok;
+    uint32_t frames_timeout;
+    uint32_t frames_bad;
+    uint32_t frames_checksum;
+    uint32_t uart_flushes;
+    uint32_t uart_reinits;
+    uint32_t power_cycles;
+    uint8_t sensor_health;
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t heap_largest_block;
+    uint8_t task_count;
+    metrics_task_t tasks[METRICS_TASKS_MAX];
+};
+
+// Format the exposition, ending with "# EOF". Returns its length, or 0 if it
+// does not fit in size bytes (including the terminator).
+size_t metrics_format(const metrics_snapshot_t *m, char *buf, size_t size);
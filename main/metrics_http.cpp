@@ -0,0 +1,137 @@
+#include "metrics_http.h"
+#include "metrics.h"
+#include "attributes.h"
+#include "fan.h"
+#include "pms.h"
+#include "tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_heap_caps.h>
+#include <esp_http_server.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static_assert(APP_TASK_COUNT <= METRICS_TASKS_MAX, "Not enough task slots in metrics_snapshot_t");
+
+#if METRICS_HTTP_ENABLE
+static const char *TAG = "metrics";
+
+static portMUX_TYPE reading_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool has_reading;
+static uint16_t last_pm25_raw;
+static uint16_t last_pm25;
+static uint8_t last_air_quality;
+
+// The server task handles one request at a time, so both can be static
+static metrics_snapshot_t snapshot;
+static char metrics_buf[METRICS_BUF_SIZE];
+
+static void metrics_collect(metrics_snapshot_t *m) {
+    m->uptime_ms = esp_timer_get_time() / 1000;
+
+    taskENTER_CRITICAL(&reading_lock);
+    m->has_reading = has_reading;
+    m->pm25_raw = last_pm25_raw;
+    m->pm25 = last_pm25;
+    m->air_quality = last_air_quality;
+    taskEXIT_CRITICAL(&reading_lock);
+
+    m->fan_mode = static_cast<uint8_t>(attr_get_fan_mode());
+    m->fan_percent = fan_get_percentage();
+    // Sampled with every sensor reading, a scrape never waits for the tachometer
+    m->fan_rpm = fan_get_rpm();
+
+    attr_report_counts_t reports;
+    attr_get_report_counts(&reports);
+    m->reports_sent = reports.sent;
+    m->reports_suppressed = reports.suppressed;
+
+    pms_stats_t sensor;
+    pms_get_stats(&sensor);
+    m->frames_ok = sensor.frames_ok;
+    m->frames_timeout = sensor.timeouts;
+    m->frames_bad = sensor.bad_frames;
+    m->frames_checksum = sensor.checksum_errors;
+    m->uart_flushes = sensor.uart_flushes;
+    m->uart_reinits = sensor.uart_reinits;
+    m->power_cycles = sensor.power_cycles;
+    m->sensor_health = sensor.health;
+
+    m->heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    m->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    m->heap_largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+
+    m->task_count = 0;
+    for (int i = 0; i < APP_TASK_COUNT; i++) {
+        metrics_task_t *task = &m->tasks[m->task_count];
+        if (app_task_get_stack_free(static_cast<app_task_id_t>(i), &task->stack_free)) {
+            task->name = app_task_get_config(static_cast<app_task_id_t>(i))->name;
+            m->task_count++;
+        }
+    }
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+    static bool adopted;
+    if (!adopted) {
+        // Registers the server task so its stack shows up too
+        app_task_adopt_current(APP_TASK_METRICS);
+        adopted = true;
+    }
+
+    metrics_collect(&snapshot);
+    size_t len = metrics_format(&snapshot, metrics_buf, sizeof(metrics_buf));
+    if (len == 0) {
+        ESP_LOGE(TAG, "Exposition does not fit in %u bytes", (unsigned)sizeof(metrics_buf));
+        return httpd_resp_send_500(req);
+    }
+    httpd_resp_set_type(req, METRICS_CONTENT_TYPE);
+    return httpd_resp_send(req, metrics_buf, len);
+}
+#endif
+
+
+void metrics_http_record_reading(int pm25_raw, int pm25, int air_quality) {
+#if METRICS_HTTP_ENABLE
+    taskENTER_CRITICAL(&reading_lock);
+    has_reading = true;
+    last_pm25_raw = pm25_raw;
+    last_pm25 = pm25;
+    last_air_quality = air_quality;
+    taskEXIT_CRITICAL(&reading_lock);
+#endif
+}
+
+void metrics_http_start() {
+#if METRICS_HTTP_ENABLE
+    static httpd_handle_t server;
+    if (server != NULL) {
+        return;
+    }
+
+    const app_task_config_t *task = app_task_get_config(APP_TASK_METRICS);
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = METRICS_HTTP_PORT;
+    config.stack_size = task->stack;
+    config.task_priority = task->priority;
+    config.core_id = task->core;
+    // CHIP needs most of the lwIP sockets, a scraper holds one connection
+    config.max_open_sockets = 2;
+    config.max_uri_handlers = 1;
+    config.lru_purge_enable = true;
+    if (httpd_start(&server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the metrics server");
+        server = NULL;
+        return;
+    }
+
+    static const httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+    ESP_LOGI(TAG, "OpenMetrics on port %d, path /metrics", METRICS_HTTP_PORT);
+#endif
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "hw_conf.h"
+
+// Prometheus scrape endpoint: GET http://<device>:METRICS_HTTP_PORT/metrics
+// returns the OpenMetrics text of metrics.h. Off unless METRICS_HTTP_ENABLE,
+// the endpoint has no authentication and anyone on the network can read it.
+// Scrapes are formatted into a static buffer by the server task, nothing is
+// allocated per request.
+
+// Start the server, call once the network stack is up
+void metrics_http_start();
+
+// Latest sensor reading, from the controller task
+void metrics_http_record_reading(int pm25_raw, int pm25, int air_quality);
@@ -0,0 +1,398 @@
+#include "ota.h"
+#include "ota_stream.h"
+#include "tasks.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+
+#include <app/clusters/ota-requestor/BDXDownloader.h>
+#include <app/clusters/ota-requestor/DefaultOTARequestor.h>
+#include <app/clusters/ota-requestor/DefaultOTARequestorStorage.h>
+#include <app/clusters/ota-requestor/ExtendedOTARequestorDriver.h>
+#include <app/server/Server.h>
+#include <lib/core/OTAImageHeader.h>
+#include <platform/CHIPDeviceLayer.h>
+#include <platform/OTAImageProcessor.h>
+
+using namespace chip;
+using namespace chip::DeviceLayer;
+using namespace esp_matter;
+
+static const char *TAG = "ota";
+
+// Largest BDX block the requestor asks for
+#define OTA_BLOCK_MAX 1024
+// Leave time for the status report to reach the provider before rebooting
+#define OTA_APPLY_DELAY_MS 2000
+
+static OTADownloader *downloader;
+
+// Commands from the CHIP task to the ota task, the queue keeps them in order
+// so finalize only runs once the last block is in flash
+enum ota_cmd_t : uint8_t {
+    OTA_CMD_PREPARE,
+    OTA_CMD_BLOCK,
+    OTA_CMD_FINALIZE,
+    OTA_CMD_APPLY,
+    OTA_CMD_ABORT,
+};
+#define OTA_QUEUE_LEN 4
+
+static QueueHandle_t ota_queue;
+// Set by the CHIP task on abort, the ota task drops queued blocks and fails
+// flash accesses so a long delta copy stops early. Cleared by the next prepare.
+static bool abort_requested;
+
+// Whether the update partition holds a verified image. Finalize() moves it to
+// pending, the ota task to ready or failed; Apply() only boots a ready image.
+enum ota_image_t : uint8_t {
+    OTA_IMAGE_NONE,
+    OTA_IMAGE_PENDING,
+    OTA_IMAGE_READY,
+    OTA_IMAGE_FAILED,
+};
+static uint8_t image_state;
+
+// Download state, only touched by the ota task
+static bool ota_active;
+static esp_ota_handle_t update_handle;
+static OTAImageHeaderParser header_parser;
+// Allocated per download, it carries the 4 KB decompression window
+static ota_stream_t *stream;
+static int64_t download_start_us;
+
+// One block handed from ProcessBlock to the ota task. block_free is given back
+// once the ota task is done with it, only then may the CHIP task refill it.
+static uint8_t block_buf[OTA_BLOCK_MAX];
+static size_t block_len;
+static SemaphoreHandle_t block_free;
+
+
+static bool ota_aborting() {
+    return __atomic_load_n(&abort_requested, __ATOMIC_ACQUIRE);
+}
+
+static bool read_running(void *ctx, uint32_t offset, void *buf, size_t len) {
+    return !ota_aborting() && esp_partition_read(esp_ota_get_running_partition(), offset, buf, len) == ESP_OK;
+}
+
+static bool write_update(void *ctx, const void *buf, size_t len) {
+    return !ota_aborting() && esp_ota_write(update_handle, buf, len) == ESP_OK;
+}
+
+// Runs on the CHIP task, context tells whether the last block went into flash
+static void fetch_next_work(intptr_t context) {
+    if (ota_aborting()) {
+        return;
+    }
+    if (context) {
+        downloader->FetchNextData();
+    } else {
+        downloader->EndDownload(CHIP_ERROR_WRITE_FAILED);
+    }
+}
+
+// Runs on the CHIP task, context is the esp_err_t of the prepare
+static void prepared_work(intptr_t context) {
+    esp_err_t err = static_cast<esp_err_t>(context);
+    downloader->OnPreparedForDownload(err == ESP_OK ? CHIP_NO_ERROR
+                                      : err == ESP_ERR_NO_MEM ? CHIP_ERROR_NO_MEMORY : CHIP_ERROR_INTERNAL);
+}
+
+static void image_set(ota_image_t state) {
+    __atomic_store_n(&image_state, state, __ATOMIC_RELEASE);
+}
+
+static ota_image_t image_get() {
+    return static_cast<ota_image_t>(__atomic_load_n(&image_state, __ATOMIC_ACQUIRE));
+}
+
+// Runs on the CHIP task. The requestor already counts the download as done,
+// so a rejected image has to cancel the update instead of being applied.
+static void image_failed_work(intptr_t context) {
+    DeviceLayer::ChipDeviceEvent event;
+    event.Type = DeviceLayer::DeviceEventType::kOtaStateChanged;
+    event.OtaStateChanged.newState = DeviceLayer::kOtaDownloadFailed;
+    PlatformMgr().PostEvent(&event);
+
+    OTARequestorInterface *requestor = GetRequestorInstance();
+    if (requestor != nullptr) {
+        requestor->CancelImageUpdate();
+    }
+}
+
+// Runs on the CHIP task once the new image is the boot partition
+static void apply_work(intptr_t context) {
+    ESP_LOGI(TAG, "Rebooting into the new image");
+    SystemLayer().StartTimer(System::Clock::Milliseconds32(OTA_APPLY_DELAY_MS),
+                             [](System::Layer *, void *) { esp_restart(); }, nullptr);
+}
+
+static void ota_stop() {
+    if (ota_active) {
+        esp_ota_abort(update_handle);
+        ota_active = false;
+    }
+    header_parser.Clear();
+    free(stream);
+    stream = NULL;
+}
+
+static esp_err_t ota_prepare() {
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+
+    ota_stop();
+    image_set(OTA_IMAGE_NONE);
+    __atomic_store_n(&abort_requested, false, __ATOMIC_RELEASE);
+    stream = static_cast<ota_stream_t *>(malloc(sizeof(ota_stream_t)));
+    esp_err_t err = stream == NULL ? ESP_ERR_NO_MEM
+        : partition == NULL ? ESP_ERR_NOT_FOUND
+        : esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot start the download: %s", esp_err_to_name(err));
+        ota_stop();
+        return err;
+    }
+    const ota_stream_io_t io = { read_running, write_update, NULL };
+    ota_stream_init(stream, &io);
+    header_parser.Init();
+    ota_active = true;
+    download_start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Downloading into %s", partition->label);
+    return ESP_OK;
+}
+
+// Decode one block into the update partition
+static bool ota_process_block() {
+    ByteSpan block(block_buf, block_len);
+
+    if (!ota_active) {
+        return false;
+    }
+
+    // The Matter OTA header comes first, the payload follows in the same blocks
+    if (header_parser.IsInitialized()) {
+        OTAImageHeader header;
+        CHIP_ERROR err = header_parser.AccumulateAndDecode(block, header);
+        if (err == CHIP_ERROR_BUFFER_TOO_SMALL) {
+            return true;
+        }
+        if (err != CHIP_NO_ERROR) {
+            ESP_LOGE(TAG, "Bad OTA image header: %" CHIP_ERROR_FORMAT, err.Format());
+            return false;
+        }
+        ESP_LOGI(TAG, "Image version %lu (%s), payload %llu bytes", (unsigned long)header.mSoftwareVersion,
+                 NullTerminated(header.mSoftwareVersionString).c_str(), (unsigned long long)header.mPayloadSize);
+        header_parser.Clear();
+    }
+
+    if (block.size() > 0) {
+        ota_stream_err_t err = ota_stream_feed(stream, block.data(), block.size());
+        if (err != OTA_STREAM_OK) {
+            if (!ota_aborting()) {
+                ESP_LOGE(TAG, "Payload rejected after %lu bytes: %s", (unsigned long)stream->received,
+                         ota_stream_err_name(err));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ota_finalize() {
+    ota_stream_err_t stream_err = ota_active ? ota_stream_finish(stream) : OTA_STREAM_ERR_TRUNCATED;
+    // Also checks the checksum and hash of the image that was written
+    esp_err_t err = stream_err == OTA_STREAM_OK ? esp_ota_end(update_handle) : ESP_FAIL;
+    if (stream_err != OTA_STREAM_OK && ota_active) {
+        esp_ota_abort(update_handle);
+    }
+    ota_active = false;
+    bool compressed = stream != NULL && stream->compressed;
+    bool delta = stream != NULL && stream->format == OTA_FORMAT_DELTA;
+    uint32_t received = stream != NULL ? stream->received : 0;
+    uint32_t written = stream != NULL ? stream->written : 0;
+    free(stream);
+    stream = NULL;
+
+    if (stream_err != OTA_STREAM_OK || err != ESP_OK) {
+        ESP_LOGE(TAG, "Image rejected: %s", stream_err != OTA_STREAM_OK ? ota_stream_err_name(stream_err) : esp_err_to_name(err));
+        image_set(OTA_IMAGE_FAILED);
+        PlatformMgr().ScheduleWork(image_failed_work);
+        return;
+    }
+    image_set(OTA_IMAGE_READY);
+    ESP_LOGI(TAG, "%s%s payload of %lu bytes gave a %lu byte image in %lld ms", compressed ? "Compressed " : "",
+             delta ? "delta" : "full image", (unsigned long)received, (unsigned long)written,
+             (esp_timer_get_time() - download_start_us) / 1000);
+}
+
+// Switch the boot partition, only to an image that finalized
+static void ota_apply() {
+    if (image_get() != OTA_IMAGE_READY) {
+        ESP_LOGE(TAG, "Image not verified, not applying it");
+        PlatformMgr().ScheduleWork(image_failed_work);
+        return;
+    }
+    esp_err_t err = esp_ota_set_boot_partition(esp_ota_get_next_update_partition(NULL));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        image_set(OTA_IMAGE_FAILED);
+        PlatformMgr().ScheduleWork(image_failed_work);
+        return;
+    }
+    PlatformMgr().ScheduleWork(apply_work);
+}
+
+static void ota_task(void *pvParameters) {
+    ota_cmd_t cmd;
+    while (1) {
+        if (xQueueReceive(ota_queue, &cmd, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+        switch (cmd) {
+            case OTA_CMD_PREPARE: {
+                esp_err_t err = ota_prepare();
+                PlatformMgr().ScheduleWork(prepared_work, err);
+                break;
+            }
+            case OTA_CMD_BLOCK: {
+                bool ok = !ota_aborting() && ota_process_block();
+                xSemaphoreGive(block_free);
+                // Ask for the next block only once this one is in flash
+                PlatformMgr().ScheduleWork(fetch_next_work, ok);
+                break;
+            }
+            case OTA_CMD_FINALIZE:
+                ota_finalize();
+                break;
+            case OTA_CMD_APPLY:
+                ota_apply();
+                break;
+            case OTA_CMD_ABORT:
+                ota_stop();
+                image_set(OTA_IMAGE_NONE);
+                break;
+        }
+    }
+}
+
+// Called on the CHIP task, never waits for the ota task
+static CHIP_ERROR ota_send(ota_cmd_t cmd) {
+    if (xQueueSend(ota_queue, &cmd, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Command queue full");
+        return CHIP_ERROR_NO_MEMORY;
+    }
+    return CHIP_NO_ERROR;
+}
+
+
+class PurifierOtaProcessor : public OTAImageProcessorInterface {
+public:
+    void SetDownloader(OTADownloader *ota_downloader) {
+        downloader = ota_downloader;
+    }
+
+    CHIP_ERROR PrepareDownload() override {
+        mParams.downloadedBytes = 0;
+        return ota_send(OTA_CMD_PREPARE);
+    }
+
+    CHIP_ERROR Finalize() override {
+        image_set(OTA_IMAGE_PENDING);
+        return ota_send(OTA_CMD_FINALIZE);
+    }
+
+    // Queued behind the finalize, a pending image is checked by the ota task
+    CHIP_ERROR Apply() override {
+        ota_image_t image = image_get();
+        if (image != OTA_IMAGE_PENDING && image != OTA_IMAGE_READY) {
+            ESP_LOGE(TAG, "No verified image to apply");
+            return CHIP_ERROR_INCORRECT_STATE;
+        }
+        return ota_send(OTA_CMD_APPLY);
+    }
+
+    CHIP_ERROR Abort() override {
+        ESP_LOGW(TAG, "Download aborted");
+        __atomic_store_n(&abort_requested, true, __ATOMIC_RELEASE);
+        return ota_send(OTA_CMD_ABORT);
+    }
+
+    // Runs on the CHIP task, the block is only valid during the call
+    CHIP_ERROR ProcessBlock(ByteSpan &block) override {
+        if (block.size() > sizeof(block_buf)) {
+            return CHIP_ERROR_BUFFER_TOO_SMALL;
+        }
+        // The next block is only fetched once the ota task gave the last one back
+        if (xSemaphoreTake(block_free, 0) != pdTRUE) {
+            return CHIP_ERROR_BUSY;
+        }
+        memcpy(block_buf, block.data(), block.size());
+        block_len = block.size();
+        CHIP_ERROR err = ota_send(OTA_CMD_BLOCK);
+        if (err != CHIP_NO_ERROR) {
+            xSemaphoreGive(block_free);
+            return err;
+        }
+        mParams.downloadedBytes += block.size();
+        return CHIP_NO_ERROR;
+    }
+
+    bool IsFirstImageRun() override {
+        OTARequestorInterface *requestor = GetRequestorInstance();
+        return requestor != nullptr
+            && requestor->GetCurrentUpdateState() == OTARequestorInterface::OTAUpdateStateEnum::kApplying;
+    }
+
+    CHIP_ERROR ConfirmCurrentImage() override {
+        OTARequestorInterface *requestor = GetRequestorInstance();
+        uint32_t version;
+        if (requestor == nullptr || ConfigurationMgr().GetSoftwareVersion(version) != CHIP_NO_ERROR) {
+            return CHIP_ERROR_INTERNAL;
+        }
+        if (version != requestor->GetTargetVersion()) {
+            return CHIP_ERROR_INCORRECT_STATE;
+        }
+#if CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+        esp_ota_mark_app_valid_cancel_rollback();
+#endif
+        return CHIP_NO_ERROR;
+    }
+};
+
+static DefaultOTARequestor requestor_core;
+static DefaultOTARequestorStorage requestor_storage;
+static ExtendedOTARequestorDriver requestor_driver;
+static BDXDownloader bdx_downloader;
+static PurifierOtaProcessor image_processor;
+
+
+esp_err_t ota_create(node_t *node) {
+    endpoint_t *root = endpoint::get(node, 0);
+    cluster::ota_requestor::config_t config;
+    cluster_t *requestor = cluster::ota_requestor::create(root, &config, CLUSTER_FLAG_SERVER);
+    cluster_t *provider = cluster::ota_provider::create(root, NULL, CLUSTER_FLAG_CLIENT);
+    return requestor != nullptr && provider != nullptr ? ESP_OK : ESP_FAIL;
+}
+
+static void ota_init_work(intptr_t context) {
+    SetRequestorInstance(&requestor_core);
+    requestor_storage.Init(Server::GetInstance().GetPersistentStorage());
+    requestor_core.Init(Server::GetInstance(), requestor_storage, requestor_driver, bdx_downloader);
+    image_processor.SetDownloader(&bdx_downloader);
+    bdx_downloader.SetImageProcessorDelegate(&image_processor);
+    requestor_driver.Init(&requestor_core, &image_processor);
+}
+
+void ota_init() {
+    ota_queue = xQueueCreate(OTA_QUEUE_LEN, sizeof(ota_cmd_t));
+    block_free = xSemaphoreCreateBinary();
+    xSemaphoreGive(block_free);
+    app_task_create(APP_TASK_OTA, ota_task, NULL, NULL);
+    PlatformMgr().ScheduleWork(ota_init_work);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_matter.h>
+
+// Matter OTA requestor. The image processor takes plain application images
+// and deltas against the running image (ota_stream.h, tools/ota_delta.py),
+// either one optionally LZSS compressed (tools/ota_compress.py).
+// Decoding and flash writes run in their own task, a delta block can expand
+// into a megabyte of flash writes and the CHIP task must not wait for that.
+// The CHIP task only queues commands to it and never takes its locks.
+
+// Add the OTA requestor and provider client clusters, call before Matter start
+esp_err_t ota_create(esp_matter::node_t *node);
+
+// Set up the requestor, call after Matter start
+void ota_init();
@@ -0,0 +1,268 @@
+#include "ota_stream.h"
+
+#include <string.h>
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static ota_stream_err_t fail(ota_stream_t *stream, ota_stream_err_t err) {
+    if (stream->err == OTA_STREAM_OK) {
+        stream->err = err;
+    }
+    return stream->err;
+}
+
+static ota_stream_err_t emit(ota_stream_t *stream, const void *data, size_t len) {
+    if (stream->format == OTA_FORMAT_DELTA && len > stream->new_size - stream->written) {
+        return fail(stream, OTA_STREAM_ERR_FORMAT);
+    }
+    if (!stream->io.write(stream->io.ctx, data, len)) {
+        return fail(stream, OTA_STREAM_ERR_IO);
+    }
+    sha256_update(&stream->sha, data, len);
+    stream->written += len;
+    return OTA_STREAM_OK;
+}
+
+// Hash the running image before writing anything, a delta for another base would produce garbage
+static ota_stream_err_t check_base(ota_stream_t *stream, const uint8_t *expected_sha) {
+    sha256_t sha;
+    sha256_init(&sha);
+    for (uint32_t offset = 0; offset < stream->base_size; offset += OTA_STREAM_CHUNK) {
+        uint32_t n = stream->base_size - offset < OTA_STREAM_CHUNK ? stream->base_size - offset : OTA_STREAM_CHUNK;
+        if (!stream->io.read_base(stream->io.ctx, offset, stream->chunk, n)) {
+            return fail(stream, OTA_STREAM_ERR_IO);
+        }
+        sha256_update(&sha, stream->chunk, n);
+    }
+    uint8_t digest[SHA256_SIZE];
+    sha256_final(&sha, digest);
+    return memcmp(digest, expected_sha, SHA256_SIZE) == 0 ? OTA_STREAM_OK : fail(stream, OTA_STREAM_ERR_BASE);
+}
+
+static ota_stream_err_t copy_base(ota_stream_t *stream, uint32_t offset, uint32_t len) {
+    if (offset > stream->base_size || len > stream->base_size - offset) {
+        return fail(stream, OTA_STREAM_ERR_FORMAT);
+    }
+    while (len > 0) {
+        uint32_t n = len < OTA_STREAM_CHUNK ? len : OTA_STREAM_CHUNK;
+        if (!stream->io.read_base(stream->io.ctx, offset, stream->chunk, n)) {
+            return fail(stream, OTA_STREAM_ERR_IO);
+        }
+        if (emit(stream, stream->chunk, n) != OTA_STREAM_OK) {
+            return stream->err;
+        }
+        offset += n;
+        len -= n;
+    }
+    return OTA_STREAM_OK;
+}
+
+static size_t op_size(uint8_t op) {
+    switch (op) {
+        case OTA_OP_END:
+            return 1;
+        case OTA_OP_COPY:
+            return 9;
+        case OTA_OP_INSERT:
+            return 5;
+        default:
+            return 0;
+    }
+}
+
+static void feed_delta(ota_stream_t *stream, const uint8_t *data, size_t len) {
+    size_t used = 0;
+
+    if (!stream->header_done) {
+        size_t n = OTA_DELTA_HEADER_SIZE - stream->header_len;
+        n = n < len ? n : len;
+        memcpy(&stream->header[stream->header_len], data, n);
+        stream->header_len += n;
+        used += n;
+        if (stream->header_len < OTA_DELTA_HEADER_SIZE) {
+            return;
+        }
+        if (memcmp(stream->header, OTA_DELTA_MAGIC, 4) != 0) {
+            fail(stream, OTA_STREAM_ERR_FORMAT);
+            return;
+        }
+        stream->base_size = get_u32(&stream->header[4]);
+        stream->new_size = get_u32(&stream->header[8 + SHA256_SIZE]);
+        memcpy(stream->new_sha, &stream->header[12 + SHA256_SIZE], SHA256_SIZE);
+        stream->header_done = true;
+        if (check_base(stream, &stream->header[8]) != OTA_STREAM_OK) {
+            return;
+        }
+    }
+
+    while (used < len && stream->err == OTA_STREAM_OK) {
+        if (stream->ended) {
+            // Nothing may follow END
+            fail(stream, OTA_STREAM_ERR_FORMAT);
+            break;
+        }
+
+        if (stream->insert_left > 0) {
+            size_t n = len - used < stream->insert_left ? len - used : stream->insert_left;
+            emit(stream, &data[used], n);
+            stream->insert_left -= n;
+            used += n;
+            continue;
+        }
+
+        stream->op[stream->op_len++] = data[used++];
+        size_t need = op_size(stream->op[0]);
+        if (need == 0) {
+            fail(stream, OTA_STREAM_ERR_FORMAT);
+            break;
+        }
+        if (stream->op_len < need) {
+            continue;
+        }
+        stream->op_len = 0;
+
+        switch (stream->op[0]) {
+            case OTA_OP_END:
+                stream->ended = true;
+                break;
+            case OTA_OP_COPY:
+                copy_base(stream, get_u32(&stream->op[1]), get_u32(&stream->op[5]));
+                break;
+            case OTA_OP_INSERT:
+                stream->insert_left = get_u32(&stream->op[1]);
+                break;
+        }
+    }
+}
+
+// Plain image or delta, after decompression if there was any
+static ota_stream_err_t feed_payload(ota_stream_t *stream, const uint8_t *data, size_t len) {
+    if (stream->format == OTA_FORMAT_UNKNOWN) {
+        if (data[0] == OTA_IMAGE_MAGIC) {
+            stream->format = OTA_FORMAT_RAW;
+        } else if (data[0] == OTA_DELTA_MAGIC[0]) {
+            stream->format = OTA_FORMAT_DELTA;
+        } else {
+            return fail(stream, OTA_STREAM_ERR_FORMAT);
+        }
+    }
+
+    if (stream->format == OTA_FORMAT_RAW) {
+        return emit(stream, data, len);
+    }
+
+    feed_delta(stream, data, len);
+    return stream->err;
+}
+
+static bool decoded_sink(void *ctx, const uint8_t *data, size_t len) {
+    ota_stream_t *stream = static_cast<ota_stream_t *>(ctx);
+    if (len > stream->decoded_size - stream->decoded) {
+        fail(stream, OTA_STREAM_ERR_FORMAT);
+        return false;
+    }
+    stream->decoded += len;
+    sha256_update(&stream->decoded_sha, data, len);
+    return feed_payload(stream, data, len) == OTA_STREAM_OK;
+}
+
+static void feed_compressed(ota_stream_t *stream, const uint8_t *data, size_t len) {
+    if (stream->lzss_header_len < OTA_LZSS_HEADER_SIZE) {
+        size_t n = OTA_LZSS_HEADER_SIZE - stream->lzss_header_len;
+        n = n < len ? n : len;
+        memcpy(&stream->lzss_header[stream->lzss_header_len], data, n);
+        stream->lzss_header_len += n;
+        data += n;
+        len -= n;
+        if (stream->lzss_header_len < OTA_LZSS_HEADER_SIZE) {
+            return;
+        }
+        if (memcmp(stream->lzss_header, OTA_LZSS_MAGIC, 4) != 0) {
+            fail(stream, OTA_STREAM_ERR_FORMAT);
+            return;
+        }
+        stream->decoded_size = get_u32(&stream->lzss_header[4]);
+    }
+    if (len > 0 && !lzss_decode(&stream->lzss, data, len, decoded_sink, stream)) {
+        fail(stream, OTA_STREAM_ERR_FORMAT);
+    }
+}
+
+void ota_stream_init(ota_stream_t *stream, const ota_stream_io_t *io) {
+    memset(stream, 0, sizeof(*stream));
+    stream->io = *io;
+    sha256_init(&stream->sha);
+    sha256_init(&stream->decoded_sha);
+    lzss_init(&stream->lzss);
+}
+
+ota_stream_err_t ota_stream_feed(ota_stream_t *stream, const uint8_t *data, size_t len) {
+    if (stream->err != OTA_STREAM_OK || len == 0) {
+        return stream->err;
+    }
+    stream->received += len;
+
+    if (!stream->detected) {
+        stream->compressed = data[0] == OTA_LZSS_MAGIC[0];
+        stream->detected = true;
+    }
+    if (stream->compressed) {
+        feed_compressed(stream, data, len);
+        return stream->err;
+    }
+    return feed_payload(stream, data, len);
+}
+
+ota_stream_err_t ota_stream_finish(ota_stream_t *stream) {
+    if (stream->err != OTA_STREAM_OK) {
+        return stream->err;
+    }
+    uint8_t digest[SHA256_SIZE];
+
+    // Check the decompressed stream first, a mismatch there explains everything after it
+    if (stream->compressed) {
+        if (stream->lzss_header_len < OTA_LZSS_HEADER_SIZE || !lzss_complete(&stream->lzss)
+                || stream->decoded != stream->decoded_size) {
+            return fail(stream, OTA_STREAM_ERR_TRUNCATED);
+        }
+        sha256_final(&stream->decoded_sha, digest);
+        if (memcmp(digest, &stream->lzss_header[8], SHA256_SIZE) != 0) {
+            return fail(stream, OTA_STREAM_ERR_HASH);
+        }
+    }
+
+    sha256_final(&stream->sha, digest);
+
+    if (stream->format == OTA_FORMAT_DELTA) {
+        if (!stream->ended || stream->insert_left > 0 || stream->written != stream->new_size) {
+            return fail(stream, OTA_STREAM_ERR_TRUNCATED);
+        }
+        if (memcmp(digest, stream->new_sha, SHA256_SIZE) != 0) {
+            return fail(stream, OTA_STREAM_ERR_HASH);
+        }
+    } else if (stream->format != OTA_FORMAT_RAW) {
+        return fail(stream, OTA_STREAM_ERR_TRUNCATED);
+    }
+    // Plain images carry their own checksum, esp_ota_end() verifies it
+    return OTA_STREAM_OK;
+}
+
+const char *ota_stream_err_name(ota_stream_err_t err) {
+    switch (err) {
+        case OTA_STREAM_OK:
+            return "ok";
+        case OTA_STREAM_ERR_IO:
+            return "flash i/o failed";
+        case OTA_STREAM_ERR_FORMAT:
+            return "bad payload";
+        case OTA_STREAM_ERR_BASE:
+            return "delta does not match the running image";
+        case OTA_STREAM_ERR_TRUNCATED:
+            return "payload incomplete";
+        case OTA_STREAM_ERR_HASH:
+            return "image hash mismatch";
+    }
+    return "unknown";
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "lzss.h"
+#include "sha256.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Turns the payload of a Matter OTA image into the new application image as
+// it arrives. The payload is either a plain application image or a delta
+// against the running image made by tools/ota_delta.py, either one possibly
+// LZSS compressed by tools/ota_compress.py. RAM use is fixed, the delta
+// refers to the running partition instead of buffering anything and the
+// decompressor keeps only its window. Pure logic, also built into the host
+// tools.
+
+// Delta layout, little endian:
+//   "PDL1", u32 base size, base SHA-256, u32 new size, new SHA-256
+//   ops until END:
+//     COPY   u8 1, u32 base offset, u32 length
+//     INSERT u8 2, u32 length, length literal bytes
+//     END    u8 0
+#define OTA_DELTA_MAGIC "PDL1"
+#define OTA_DELTA_HEADER_SIZE (4 + 4 + SHA256_SIZE + 4 + SHA256_SIZE)
+
+#define OTA_OP_END 0
+#define OTA_OP_COPY 1
+#define OTA_OP_INSERT 2
+
+// Compressed layout: "LZS1", u32 decoded size, decoded SHA-256, LZSS stream
+// (lzss.h). The decoded bytes are a plain image or a delta.
+#define OTA_LZSS_MAGIC "LZS1"
+#define OTA_LZSS_HEADER_SIZE (4 + 4 + SHA256_SIZE)
+
+// First byte of an ESP application image
+#define OTA_IMAGE_MAGIC 0xE9
+
+// Reads from the base image go through this buffer
+#define OTA_STREAM_CHUNK 256
+
+enum ota_stream_format_t : uint8_t {
+    OTA_FORMAT_UNKNOWN,
+    OTA_FORMAT_RAW,
+    OTA_FORMAT_DELTA,
+};
+
+enum ota_stream_err_t : int8_t {
+    OTA_STREAM_OK = 0,
+    OTA_STREAM_ERR_IO = -1,
+    // Not an image or a corrupt delta
+    OTA_STREAM_ERR_FORMAT = -2,
+    // Delta made against a different image than the running one
+    OTA_STREAM_ERR_BASE = -3,
+    OTA_STREAM_ERR_TRUNCATED = -4,
+    OTA_STREAM_ERR_HASH = -5,
+};
+
+struct ota_stream_io_t {
+    // Read from the image the delta applies to
+    bool (*read_base)(void *ctx, uint32_t offset, void *buf, size_t len);
+    // Append to the new image
+    bool (*write)(void *ctx, const void *buf, size_t len);
+    void *ctx;
+};
+
+struct ota_stream_t {
+    ota_stream_io_t io;
+    // Of the decoded payload
+    ota_stream_format_t format;
+    ota_stream_err_t err;
+    bool compressed;
+    bool detected;
+
+    // Delta header, then the header of the current op
+    uint8_t header[OTA_DELTA_HEADER_SIZE];
+    uint8_t header_len;
+    bool header_done;
+    uint8_t op[9];
+    uint8_t op_len;
+    // Literal bytes left in the current INSERT
+    uint32_t insert_left;
+    bool ended;
+
+    uint32_t base_size;
+    uint32_t new_size;
+    uint8_t new_sha[SHA256_SIZE];
+
+    uint32_t received;
+    uint32_t written;
+    sha256_t sha;
+    uint8_t chunk[OTA_STREAM_CHUNK];
+
+    // Compressed payloads only
+    uint8_t lzss_header[OTA_LZSS_HEADER_SIZE];
+    uint8_t lzss_header_len;
+    uint32_t decoded;
+    uint32_t decoded_size;
+    sha256_t decoded_sha;
+    lzss_t lzss;
+};
+
+void ota_stream_init(ota_stream_t *stream, const ota_stream_io_t *io);
+
+// Feed the next payload bytes, the first error sticks
+ota_stream_err_t ota_stream_feed(ota_stream_t *stream, const uint8_t *data, size_t len);
+
+// Check that the payload was complete and the output matches its hash
+ota_stream_err_t ota_stream_finish(ota_stream_t *stream);
+
+const char *ota_stream_err_name(ota_stream_err_t err);
@@ -0,0 +1,96 @@
+#include "pm_filter.h"
+
+// 1.4826 in Q8, scales MAD to the standard deviation of normally distributed noise
+#define MAD_SCALE_Q8 380
+
+
+static void sort_small(uint16_t *data, uint8_t len) {
+    // Insertion sort, the window is tiny
+    for (uint8_t i = 1; i < len; i++) {
+        uint16_t value = data[i];
+        uint8_t j = i;
+        while (j > 0 && data[j - 1] > value) {
+            data[j] = data[j - 1];
+            j--;
+        }
+        data[j] = value;
+    }
+}
+
+void pm_filter_init(pm_filter_t *filter, const pm_filter_config_t *config) {
+    filter->config = *config;
+    if (filter->config.window > PM_FILTER_MAX_WINDOW) {
+        filter->config.window = PM_FILTER_MAX_WINDOW;
+    }
+    if (filter->config.window == 0) {
+        filter->config.window = 1;
+    }
+    if (filter->config.ema_alpha_q8 == 0 || filter->config.ema_alpha_q8 > 256) {
+        filter->config.ema_alpha_q8 = 256;
+    }
+    pm_filter_reset(filter);
+}
+
+void pm_filter_reset(pm_filter_t *filter) {
+    filter->count = 0;
+    filter->pos = 0;
+    filter->ema_q8 = 0;
+}
+
+static uint16_t reject_outlier(pm_filter_t *filter, uint16_t raw) {
+    const pm_filter_config_t &config = filter->config;
+    uint16_t sorted[PM_FILTER_MAX_WINDOW] = {};
+
+    for (uint8_t i = 0; i < filter->count; i++) {
+        sorted[i] = filter->samples[i];
+    }
+    sort_small(sorted, filter->count);
+    uint16_t median = sorted[filter->count / 2];
+
+    if (config.outlier == PM_FILTER_MEDIAN) {
+        return median;
+    }
+
+    // Median absolute deviation
+    for (uint8_t i = 0; i < filter->count; i++) {
+        sorted[i] = filter->samples[i] > median ? filter->samples[i] - median : median - filter->samples[i];
+    }
+    sort_small(sorted, filter->count);
+    uint32_t mad = sorted[filter->count / 2];
+
+    // 64-bit, the product passes 32 bits once the MAD is above ~14.7k at k = 3
+    uint64_t limit = (static_cast<uint64_t>(mad) * MAD_SCALE_Q8 * config.hampel_k_q8) >> 16;
+    if (limit < config.hampel_min_dev) {
+        limit = config.hampel_min_dev;
+    }
+    uint32_t deviation = raw > median ? raw - median : median - raw;
+    return deviation > limit ? median : raw;
+}
+
+uint16_t pm_filter_update(pm_filter_t *filter, uint16_t raw) {
+    const pm_filter_config_t &config = filter->config;
+    bool first = filter->count == 0;
+
+    filter->samples[filter->pos] = raw;
+    filter->pos = (filter->pos + 1) % config.window;
+    if (filter->count < config.window) {
+        filter->count++;
+    }
+
+    uint16_t value = raw;
+    if (config.outlier != PM_FILTER_NONE) {
+        value = reject_outlier(filter, raw);
+    }
+
+    uint32_t value_q8 = static_cast<uint32_t>(value) << 8;
+    if (first) {
+        filter->ema_q8 = value_q8;
+    } else {
+        int32_t delta = static_cast<int32_t>(value_q8) - static_cast<int32_t>(filter->ema_q8);
+        // A full scale jump in Q8 times alpha 256 does not fit in 32 bits
+        filter->ema_q8 += static_cast<int32_t>(static_cast<int64_t>(delta) * config.ema_alpha_q8 / 256);
+    }
+
+    // Round to nearest
+    return static_cast<uint16_t>((filter->ema_q8 + 128) >> 8);
+}
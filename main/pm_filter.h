@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+// Outlier rejection stage in front of the EMA
+#define PM_FILTER_NONE   0
+// Output the median of the last N samples
+#define PM_FILTER_MEDIAN 1
+// Replace samples further than k * MAD from the window median
+#define PM_FILTER_HAMPEL 2
+
+#define PM_FILTER_MAX_WINDOW 9
+
+struct pm_filter_config_t {
+    uint8_t outlier;
+    // Odd number of samples, up to PM_FILTER_MAX_WINDOW
+    uint8_t window;
+    // Hampel threshold in scaled MADs, Q8 fixed point
+    uint16_t hampel_k_q8;
+    // Deviations up to this many ug/m3 are never treated as outliers
+    uint16_t hampel_min_dev;
+    // EMA weight of the new sample, Q8 fixed point (256 disables smoothing)
+    uint16_t ema_alpha_q8;
+};
+
+// All state is inline, no heap
+struct pm_filter_t {
+    pm_filter_config_t config;
+    uint16_t samples[PM_FILTER_MAX_WINDOW];
+    uint8_t count;
+    uint8_t pos;
+    // EMA state, Q8 fixed point
+    uint32_t ema_q8;
+};
+
+void pm_filter_init(pm_filter_t *filter, const pm_filter_config_t *config);
+
+// Forget the history, the next sample passes through unchanged
+void pm_filter_reset(pm_filter_t *filter);
+
+// Feed one raw sample, returns the filtered value
+uint16_t pm_filter_update(pm_filter_t *filter, uint16_t raw);
@@ -0,0 +1,275 @@
+#include "pm_history.h"
+#include "app_console.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <esp_timer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Samples are stored in blocks. Each block keeps the first value and a summary
+// (min, max, sum) in its header, the rest of the samples are zigzag varint
+// deltas. Gaps in the data start a new block, so timestamps stay implicit.
+#define PM_HISTORY_BLOCK_SAMPLES 32
+// Worst case encoded size of one 16-bit delta
+#define PM_HISTORY_MAX_DELTA_BYTES 3
+// Room for a full block of worst case deltas, every block holds
+// PM_HISTORY_BLOCK_SAMPLES and the tier capacities below give the retention
+// of pm_history.h however noisy the data is
+#define PM_HISTORY_BLOCK_BYTES   ((PM_HISTORY_BLOCK_SAMPLES - 1) * PM_HISTORY_MAX_DELTA_BYTES)
+
+
+struct pm_history_block_t {
+    uint32_t start_s;
+    uint16_t first;
+    uint16_t last;
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+    uint8_t count;
+    uint8_t used;
+    uint8_t payload[PM_HISTORY_BLOCK_BYTES];
+};
+
+struct pm_history_tier_t {
+    uint32_t interval_s;
+    pm_history_block_t *blocks;
+    uint8_t capacity;
+    // Index of the oldest block and number of blocks in use
+    uint8_t head;
+    uint8_t len;
+    // Samples of the interval that is still running
+    uint32_t bucket;
+    uint32_t bucket_sum;
+    uint16_t bucket_count;
+};
+
+// Capacity is one block more than the retention, the oldest block may be partly expired
+static pm_history_block_t seconds_blocks[600 / PM_HISTORY_BLOCK_SAMPLES + 2];
+static pm_history_block_t minutes_blocks[1440 / PM_HISTORY_BLOCK_SAMPLES + 1];
+static pm_history_block_t quarters_blocks[672 / PM_HISTORY_BLOCK_SAMPLES + 1];
+
+static pm_history_tier_t tiers[PM_HISTORY_TIERS] = {
+    { .interval_s = 1, .blocks = seconds_blocks, .capacity = sizeof(seconds_blocks) / sizeof(seconds_blocks[0]) },
+    { .interval_s = 60, .blocks = minutes_blocks, .capacity = sizeof(minutes_blocks) / sizeof(minutes_blocks[0]) },
+    { .interval_s = 900, .blocks = quarters_blocks, .capacity = sizeof(quarters_blocks) / sizeof(quarters_blocks[0]) },
+};
+
+static SemaphoreHandle_t history_mutex;
+
+
+static uint8_t varint_put(uint8_t *out, int32_t delta) {
+    uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+    uint8_t len = 0;
+    while (zigzag >= 0x80) {
+        out[len++] = static_cast<uint8_t>(zigzag) | 0x80;
+        zigzag >>= 7;
+    }
+    out[len++] = static_cast<uint8_t>(zigzag);
+    return len;
+}
+
+static int32_t varint_get(const uint8_t *in, uint8_t *pos) {
+    uint32_t zigzag = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+    do {
+        byte = in[(*pos)++];
+        zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+}
+
+// Decode a block, calls fn(time_s, value) for every sample
+template <typename Fn>
+static void block_for_each(const pm_history_tier_t *tier, const pm_history_block_t *block, Fn fn) {
+    uint16_t value = block->first;
+    uint8_t pos = 0;
+    fn(block->start_s, value);
+    for (uint8_t i = 1; i < block->count; i++) {
+        value += varint_get(block->payload, &pos);
+        fn(block->start_s + i * tier->interval_s, value);
+    }
+}
+
+static pm_history_block_t *tier_block(pm_history_tier_t *tier, uint8_t n) {
+    return &tier->blocks[(tier->head + n) % tier->capacity];
+}
+
+static pm_history_block_t *tier_new_block(pm_history_tier_t *tier) {
+    if (tier->len == tier->capacity) {
+        // Drop the oldest block
+        tier->head = (tier->head + 1) % tier->capacity;
+        tier->len--;
+    }
+    tier->len++;
+    pm_history_block_t *block = tier_block(tier, tier->len - 1);
+    memset(block, 0, sizeof(*block));
+    return block;
+}
+
+static void tier_append(pm_history_tier_t *tier, uint32_t time_s, uint16_t value) {
+    pm_history_block_t *block = tier->len > 0 ? tier_block(tier, tier->len - 1) : nullptr;
+
+    bool contiguous = block != nullptr
+        && block->start_s + block->count * tier->interval_s == time_s;
+    bool full = block != nullptr && block->count == PM_HISTORY_BLOCK_SAMPLES;
+
+    if (!contiguous || full) {
+        block = tier_new_block(tier);
+        block->start_s = time_s;
+        block->first = value;
+        block->min = value;
+        block->max = value;
+    } else {
+        block->used += varint_put(&block->payload[block->used], value - block->last);
+    }
+
+    block->last = value;
+    block->sum += value;
+    block->count++;
+    if (value < block->min) {
+        block->min = value;
+    }
+    if (value > block->max) {
+        block->max = value;
+    }
+}
+
+void pm_history_add(uint32_t time_s, uint16_t pm25) {
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < PM_HISTORY_TIERS; i++) {
+        pm_history_tier_t *tier = &tiers[i];
+        uint32_t bucket = time_s / tier->interval_s;
+
+        // Close the running interval once a sample of a later one arrives
+        if (tier->bucket_count > 0 && bucket != tier->bucket) {
+            uint16_t avg = (tier->bucket_sum + tier->bucket_count / 2) / tier->bucket_count;
+            tier_append(tier, tier->bucket * tier->interval_s, avg);
+            tier->bucket_sum = 0;
+            tier->bucket_count = 0;
+        }
+        tier->bucket = bucket;
+        tier->bucket_sum += pm25;
+        tier->bucket_count++;
+    }
+    xSemaphoreGive(history_mutex);
+}
+
+void pm_history_query(uint8_t tier_index, uint32_t from_s, uint32_t to_s, pm_history_stats_t *stats) {
+    uint32_t sum = 0;
+    stats->min = UINT16_MAX;
+    stats->max = 0;
+    stats->count = 0;
+
+    if (tier_index >= PM_HISTORY_TIERS) {
+        stats->min = 0;
+        stats->avg = 0;
+        return;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    pm_history_tier_t *tier = &tiers[tier_index];
+    for (uint8_t n = 0; n < tier->len; n++) {
+        const pm_history_block_t *block = tier_block(tier, n);
+        uint32_t block_end_s = block->start_s + (block->count - 1) * tier->interval_s;
+
+        if (block_end_s < from_s || block->start_s > to_s) {
+            continue;
+        }
+        if (block->start_s >= from_s && block_end_s <= to_s) {
+            // Whole block in range, use the summary
+            sum += block->sum;
+            stats->count += block->count;
+            stats->min = block->min < stats->min ? block->min : stats->min;
+            stats->max = block->max > stats->max ? block->max : stats->max;
+            continue;
+        }
+        block_for_each(tier, block, [&](uint32_t time_s, uint16_t value) {
+            if (time_s < from_s || time_s > to_s) {
+                return;
+            }
+            sum += value;
+            stats->count++;
+            stats->min = value < stats->min ? value : stats->min;
+            stats->max = value > stats->max ? value : stats->max;
+        });
+    }
+    xSemaphoreGive(history_mutex);
+
+    if (stats->count == 0) {
+        stats->min = 0;
+        stats->avg = 0;
+    } else {
+        stats->avg = (sum + stats->count / 2) / stats->count;
+    }
+}
+
+void pm_history_dump(uint8_t tier_index) {
+    if (tier_index >= PM_HISTORY_TIERS) {
+        return;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    pm_history_tier_t *tier = &tiers[tier_index];
+    printf("# tier %u, interval %lu s, %u blocks\n", tier_index,
+           (unsigned long)tier->interval_s, tier->len);
+    printf("time_s,pm25\n");
+    for (uint8_t n = 0; n < tier->len; n++) {
+        block_for_each(tier, tier_block(tier, n), [](uint32_t time_s, uint16_t value) {
+            printf("%lu,%u\n", (unsigned long)time_s, value);
+        });
+    }
+    xSemaphoreGive(history_mutex);
+}
+
+void pm_history_init() {
+    history_mutex = xSemaphoreCreateMutex();
+}
+
+
+static esp_err_t history_dump_handler(int argc, char **argv) {
+    uint8_t tier = argc > 0 ? atoi(argv[0]) : PM_HISTORY_TIER_SECONDS;
+    if (tier >= PM_HISTORY_TIERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pm_history_dump(tier);
+    return ESP_OK;
+}
+
+static esp_err_t history_stats_handler(int argc, char **argv) {
+    if (argc < 1) {
+        printf("Usage: history-stats <last_seconds> [tier]\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t span_s = strtoul(argv[0], NULL, 10);
+    uint8_t tier = argc > 1 ? atoi(argv[1]) : PM_HISTORY_TIER_MINUTES;
+
+    uint32_t now_s = esp_timer_get_time() / 1000000;
+    uint32_t from_s = span_s < now_s ? now_s - span_s : 0;
+
+    pm_history_stats_t stats;
+    pm_history_query(tier, from_s, now_s, &stats);
+    printf("samples: %lu, min: %u, avg: %u, max: %u\n",
+           (unsigned long)stats.count, stats.min, stats.avg, stats.max);
+    return ESP_OK;
+}
+
+void pm_history_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "history-dump",
+            .description = "Print stored PM2.5 samples as CSV. Usage: history-dump [tier 0=1s|1=1min|2=15min].",
+            .handler = history_dump_handler,
+        },
+        {
+            .name = "history-stats",
+            .description = "Min/avg/max PM2.5 over the last seconds. Usage: history-stats <last_seconds> [tier].",
+            .handler = history_stats_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Resolutions kept in RAM, each tier averages the raw samples over its interval.
+// Plain RAM, the history starts over after every reset or power cycle.
+#define PM_HISTORY_TIER_SECONDS  0  // 1 s for the last 10 minutes
+#define PM_HISTORY_TIER_MINUTES  1  // 1 min for the last 24 hours
+#define PM_HISTORY_TIER_QUARTERS 2  // 15 min for the last week
+#define PM_HISTORY_TIERS 3
+
+struct pm_history_stats_t {
+    uint16_t min;
+    uint16_t max;
+    uint16_t avg;
+    // Number of stored samples in the range, 0 if there is no data
+    uint32_t count;
+};
+
+void pm_history_init();
+
+// Record a PM2.5 sample taken at time_s (seconds since boot)
+void pm_history_add(uint32_t time_s, uint16_t pm25);
+
+// Min/avg/max over [from_s, to_s] using the given tier
+// Only blocks crossing the range boundaries are decoded
+void pm_history_query(uint8_t tier, uint32_t from_s, uint32_t to_s, pm_history_stats_t *stats);
+
+// Print all samples of a tier as CSV (time_s,pm25)
+void pm_history_dump(uint8_t tier);
+
+void pm_history_register_commands();
@@ -1,13 +1,21 @@
 #include "pms.h"
+#include "pms_frame.h"
+#include "trace.h"
+#include "capture.h"
 
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
 #include "led.h"
 #include "hw_conf.h"
+#include "pm_filter.h"
+#include "auto_control.h"
+#include "tasks.h"
+#include "power_mgmt.h"
 
 #include <esp_matter_cluster.h>
 
@@ -16,73 +24,225 @@ using namespace chip::app::Clusters::AirQuality;
 #define PMS_BAUD_RATE  9600
 #define BUF_SIZE        1024
 
+// Recovery escalation, counted in consecutive failed frames (one frame per second)
+#define PMS_FLUSH_AFTER_FAILS       3
+#define PMS_REINIT_AFTER_FAILS      10
+#define PMS_POWER_CYCLE_AFTER_FAILS 30
+// Power cycles are repeated with exponential backoff while the sensor stays dead
+#define PMS_POWER_CYCLE_BACKOFF_MIN_MS (30 * 1000)
+#define PMS_POWER_CYCLE_BACKOFF_MAX_MS (15 * 60 * 1000)
+#define PMS_POWER_OFF_TIME_MS       1000
+#define PMS_POWER_ON_SETTLE_MS      2000
+
+// Error rate is computed over the last 64 frames
+#define PMS_HEALTH_WINDOW           64
+#define PMS_DEGRADED_ERROR_PERMILLE 100
+
+static const char *TAG = "pms";
+
 // Command to request PM2.5 value
 static const char PMS_CMD[] = {0x11, 0x02, 0x0b, 0x01, 0xe1};
 
 static QueueHandle_t air_quality_queue;
 
-// According to Chinese IAQI standard (also used by Xiaomi in original firmware)
-static int pm25_to_aq_enum(int pm25) {
-    if (pm25 < 35) {
-        return static_cast<int>(AirQualityEnum::kGood);
+static pms_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Bit set for every failed frame, newest in bit 0
+static uint64_t error_history;
+static uint8_t error_history_len;
+
+static pm_filter_t pm25_filter;
+
+static TickType_t next_power_cycle;
+static uint32_t power_cycle_backoff_ms = PMS_POWER_CYCLE_BACKOFF_MIN_MS;
+
+static_assert(AQ_GOOD == static_cast<uint8_t>(AirQualityEnum::kGood)
+    && AQ_EXTREMELY_POOR == static_cast<uint8_t>(AirQualityEnum::kExtremelyPoor),
+    "aq_level_t must match the Matter AirQualityEnum");
+
+static void pms_uart_init() {
+    const uart_config_t uart_config = {
+        .baud_rate = PMS_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        // Survives frequency scaling, the driver keeps an APB lock otherwise
+#if SOC_UART_SUPPORT_REF_TICK
+        .source_clk = UART_SCLK_REF_TICK,
+#else
+        .source_clk = UART_SCLK_XTAL,
+#endif
+    };
+
+    ESP_ERROR_CHECK(uart_param_config(UART_PMS, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(UART_PMS, GPIO_PMS_TX, GPIO_PMS_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+    ESP_ERROR_CHECK(uart_driver_install(UART_PMS, BUF_SIZE, 0, 0, NULL, 0));
+}
+
+static void pms_power_cycle() {
+    gpio_set_level(GPIO_PMS_5V, !PMS_5V_ON_LEVEL);
+    vTaskDelay(pdMS_TO_TICKS(PMS_POWER_OFF_TIME_MS));
+    gpio_set_level(GPIO_PMS_5V, PMS_5V_ON_LEVEL);
+    vTaskDelay(pdMS_TO_TICKS(PMS_POWER_ON_SETTLE_MS));
+    // Drop whatever the sensor sent while booting
+    uart_flush_input(UART_PMS);
+}
+
+// Escalate from the cheapest recovery action to the most disruptive one
+static void pms_recover(uint16_t consecutive_failures) {
+    if (consecutive_failures == PMS_FLUSH_AFTER_FAILS) {
+        ESP_LOGW(TAG, "No valid frame for %u reads, flushing UART", consecutive_failures);
+        TRACE(TRACE_SENSOR_RECOVERY, 1, consecutive_failures);
+        uart_flush_input(UART_PMS);
+        taskENTER_CRITICAL(&stats_lock);
+        stats.uart_flushes++;
+        taskEXIT_CRITICAL(&stats_lock);
+
+    } else if (consecutive_failures == PMS_REINIT_AFTER_FAILS) {
+        ESP_LOGW(TAG, "No valid frame for %u reads, reinitializing UART", consecutive_failures);
+        TRACE(TRACE_SENSOR_RECOVERY, 2, consecutive_failures);
+        uart_driver_delete(UART_PMS);
+        pms_uart_init();
+        taskENTER_CRITICAL(&stats_lock);
+        stats.uart_reinits++;
+        taskEXIT_CRITICAL(&stats_lock);
+
+    } else if (consecutive_failures >= PMS_POWER_CYCLE_AFTER_FAILS) {
+        TickType_t now = xTaskGetTickCount();
+        if (consecutive_failures > PMS_POWER_CYCLE_AFTER_FAILS
+                && (int32_t)(now - next_power_cycle) < 0) {
+            return;
+        }
+        ESP_LOGE(TAG, "Sensor dead, power cycling (next attempt in %lu s)",
+                 (unsigned long)(power_cycle_backoff_ms / 1000));
+        TRACE(TRACE_SENSOR_RECOVERY, 3, consecutive_failures);
+        pms_power_cycle();
+        // History from before the outage says nothing about the current air
+        pm_filter_reset(&pm25_filter);
+        next_power_cycle = xTaskGetTickCount() + pdMS_TO_TICKS(power_cycle_backoff_ms);
+        power_cycle_backoff_ms *= 2;
+        if (power_cycle_backoff_ms > PMS_POWER_CYCLE_BACKOFF_MAX_MS) {
+            power_cycle_backoff_ms = PMS_POWER_CYCLE_BACKOFF_MAX_MS;
+        }
+        taskENTER_CRITICAL(&stats_lock);
+        stats.power_cycles++;
+        taskEXIT_CRITICAL(&stats_lock);
     }
-    if (pm25 < 75) {
-        return static_cast<int>(AirQualityEnum::kFair);
+}
+
+// Update counters with the result of one read, returns the new health state
+static pms_health_t pms_health_update(pms_frame_result_t result) {
+    bool failed = result != PMS_FRAME_OK;
+
+    error_history = (error_history << 1) | (failed ? 1 : 0);
+    if (error_history_len < PMS_HEALTH_WINDOW) {
+        error_history_len++;
     }
-    if (pm25 < 115) {
-        return static_cast<int>(AirQualityEnum::kModerate);
+    uint16_t error_rate = __builtin_popcountll(error_history) * 1000 / error_history_len;
+
+    taskENTER_CRITICAL(&stats_lock);
+    switch (result) {
+        case PMS_FRAME_OK:
+            stats.frames_ok++;
+            break;
+        case PMS_FRAME_TIMEOUT:
+            stats.timeouts++;
+            break;
+        case PMS_FRAME_BAD:
+            stats.bad_frames++;
+            break;
+        case PMS_FRAME_CHECKSUM:
+            stats.checksum_errors++;
+            break;
     }
-    if (pm25 < 150) {
-        return static_cast<int>(AirQualityEnum::kPoor);
+    // Saturate, a wrap would report the dead sensor as OK and replay the whole escalation
+    if (!failed) {
+        stats.consecutive_failures = 0;
+    } else if (stats.consecutive_failures < UINT16_MAX) {
+        stats.consecutive_failures++;
     }
-    if (pm25 <= 500) {
-        return static_cast<int>(AirQualityEnum::kVeryPoor);
+    stats.error_rate_permille = error_rate;
+
+    if (stats.consecutive_failures >= PMS_POWER_CYCLE_AFTER_FAILS) {
+        stats.health = PMS_HEALTH_DEAD;
+    } else if (stats.consecutive_failures >= PMS_FLUSH_AFTER_FAILS
+            || error_rate >= PMS_DEGRADED_ERROR_PERMILLE) {
+        stats.health = PMS_HEALTH_DEGRADED;
+    } else {
+        stats.health = PMS_HEALTH_OK;
     }
-    
-    return static_cast<int>(AirQualityEnum::kExtremelyPoor);
-}
+    pms_health_t health = stats.health;
+    uint16_t consecutive_failures = stats.consecutive_failures;
+    taskEXIT_CRITICAL(&stats_lock);
 
-static bool validate_checksum(const uint8_t *data, int len) {
-    uint8_t sum = 0;
-    for (int i = 0; i < len; i++) {
-        sum += data[i];
+    if (failed) {
+        pms_recover(consecutive_failures);
+    } else {
+        power_cycle_backoff_ms = PMS_POWER_CYCLE_BACKOFF_MIN_MS;
     }
-    return sum == 0;
+    return health;
+}
+
+void pms_get_stats(pms_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
 }
 
 // Task to communicate with the PMS sensor
 static void pms_task(void *pvParameters) {
     static uint8_t uart_recv_buffer[BUF_SIZE];
     static aq_queue_item_t aq_queue_item;
-    
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t prev_start_us = 0;
 
     while (1) {
+        int64_t start_us = esp_timer_get_time();
+        if (prev_start_us != 0) {
+            app_task_record_jitter(APP_TASK_PMS, static_cast<int32_t>(start_us - prev_start_us - 1000000));
+        }
+        prev_start_us = start_us;
+
+        // The UART stops in light sleep, stay awake for the exchange
+        power_hold(POWER_LOCK_PMS_UART, true);
+
         // Send command to PMS sensor
         uart_write_bytes(UART_PMS, PMS_CMD, sizeof(PMS_CMD));
 
         // Read response from PMS sensor
         int len = uart_read_bytes(UART_PMS, uart_recv_buffer, BUF_SIZE, pdMS_TO_TICKS(100));
+        power_hold(POWER_LOCK_PMS_UART, false);
+        capture_uart(uart_recv_buffer, len);
 
         // Validate response and parse PM2.5 value
-        bool valid = len >= 20;
-        valid &= uart_recv_buffer[0] == 0x16;
-        valid &= uart_recv_buffer[1] == 0x11;
-        valid &= uart_recv_buffer[2] == 0x0b;
-        valid &= validate_checksum(uart_recv_buffer, 20);
-
-        if (valid) {
-            int pm25_value = (uart_recv_buffer[15] << 8) | uart_recv_buffer[16];
-            aq_queue_item.pm25 = pm25_value;
-            aq_queue_item.air_quality_enum = pm25_to_aq_enum(pm25_value);
+        pms_frame_result_t result = pms_frame_check(uart_recv_buffer, len);
+        TRACE(TRACE_SENSOR_FRAME, result, len);
+
+        if (result == PMS_FRAME_OK) {
+            int pm25_value = pms_frame_pm25(uart_recv_buffer);
+            aq_queue_item.pm25_raw = pm25_value;
+            aq_queue_item.pm25 = pm_filter_update(&pm25_filter, pm25_value);
+            TRACE(TRACE_SENSOR_FILTERED, pm25_value, aq_queue_item.pm25);
+            aq_queue_item.air_quality_enum = pm25_to_aq_level(aq_queue_item.pm25);
         } else {
             aq_queue_item.air_quality_enum = static_cast<int>(AirQualityEnum::kUnknown);
         }
+        aq_queue_item.health = pms_health_update(result);
+        // After the read and parse, so the controller latency covers all of it
+        aq_queue_item.timestamp_us = esp_timer_get_time();
 
         // Send the data to the queue
         xQueueSend(air_quality_queue, &aq_queue_item, portMAX_DELAY);
 
-        // Delay for 1 second
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Run once per second, history buckets rely on a steady period. After a
+        // stall (a sensor power cycle takes 3 s) start a new period from now
+        // instead of catching up with back-to-back reads.
+        if (xTaskGetTickCount() - last_wake >= pdMS_TO_TICKS(1000)) {
+            last_wake = xTaskGetTickCount();
+        }
+        xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(1000));
     }
 }
 
@@ -90,23 +250,22 @@ static void pms_task(void *pvParameters) {
 void pms_init(QueueHandle_t queue) {
     // Initialize GPIO for PMS sensor power
     gpio_set_direction(GPIO_PMS_5V, GPIO_MODE_OUTPUT);
-    gpio_set_level(GPIO_MOTOR_BRK, 0);
+    gpio_set_level(GPIO_PMS_5V, PMS_5V_ON_LEVEL);
 
-    const uart_config_t uart_config = {
-        .baud_rate = PMS_BAUD_RATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_DISABLE,
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-    };
+    pms_uart_init();
 
-    ESP_ERROR_CHECK(uart_param_config(UART_PMS, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(UART_PMS, GPIO_PMS_TX, GPIO_PMS_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    ESP_ERROR_CHECK(uart_driver_install(UART_PMS, BUF_SIZE, 0, 0, NULL, 0));
+    const pm_filter_config_t filter_config = {
+        .outlier = PM_FILTER_OUTLIER,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = PM_FILTER_EMA_ALPHA_Q8,
+    };
+    pm_filter_init(&pm25_filter, &filter_config);
 
     // Save the queue handle
     air_quality_queue = queue;
 
     // Create the PMS task
-    xTaskCreate(pms_task, "pms_task", 2048, NULL, 5, NULL);
+    app_task_create(APP_TASK_PMS, pms_task, NULL, NULL);
 }
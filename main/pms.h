@@ -3,11 +3,48 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
+#include <cstdint>
+
+// Overall condition of the particle sensor link
+enum pms_health_t : uint8_t {
+    PMS_HEALTH_OK = 0,
+    // Intermittent errors, values still get through
+    PMS_HEALTH_DEGRADED = 1,
+    // No valid frame for a long time, recovery is in progress
+    PMS_HEALTH_DEAD = 2,
+};
+
+// Counters kept by the sensor task, exported as Matter diagnostics
+struct pms_stats_t {
+    uint32_t frames_ok;
+    // No response or a response too short to be a frame
+    uint32_t timeouts;
+    // Wrong frame header
+    uint32_t bad_frames;
+    uint32_t checksum_errors;
+    // Recovery actions taken so far
+    uint32_t uart_flushes;
+    uint32_t uart_reinits;
+    uint32_t power_cycles;
+    uint16_t consecutive_failures;
+    // Failed frames per 1000 over the recent window
+    uint16_t error_rate_permille;
+    pms_health_t health;
+};
+
 // Structure to hold the PM2.5 value and air quality enum
 struct aq_queue_item_t {
+    // Filtered value, used for the air quality enum
     int pm25;
+    // Last value read from the sensor
+    int pm25_raw;
     int air_quality_enum;
+    pms_health_t health;
+    // esp_timer time the reading was parsed and queued
+    int64_t timestamp_us;
 };
 
 
 void pms_init(QueueHandle_t queue);
+
+void pms_get_stats(pms_stats_t *stats);
@@ -0,0 +1,38 @@
+#include "pms_frame.h"
+
+#include <string.h>
+
+static const uint8_t frame_header[] = { 0x16, 0x11, 0x0b };
+
+static uint8_t frame_sum(const uint8_t *data, int len) {
+    uint8_t sum = 0;
+    for (int i = 0; i < len; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+pms_frame_result_t pms_frame_check(const uint8_t *data, int len) {
+    if (len < PMS_FRAME_SIZE) {
+        return PMS_FRAME_TIMEOUT;
+    }
+    if (memcmp(data, frame_header, sizeof(frame_header)) != 0) {
+        return PMS_FRAME_BAD;
+    }
+    if (frame_sum(data, PMS_FRAME_SIZE) != 0) {
+        return PMS_FRAME_CHECKSUM;
+    }
+    return PMS_FRAME_OK;
+}
+
+uint16_t pms_frame_pm25(const uint8_t *data) {
+    return (data[15] << 8) | data[16];
+}
+
+void pms_frame_build(uint16_t pm25, uint8_t *frame) {
+    memset(frame, 0, PMS_FRAME_SIZE);
+    memcpy(frame, frame_header, sizeof(frame_header));
+    frame[15] = pm25 >> 8;
+    frame[16] = pm25 & 0xFF;
+    frame[PMS_FRAME_SIZE - 1] = -frame_sum(frame, PMS_FRAME_SIZE - 1);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// PM1006 style response frames: 16 11 0B, 16 data bytes, checksum. Pure
+// logic, also built into the host tools, which build frames to feed a
+// simulated sensor through the same checks.
+
+#define PMS_FRAME_SIZE 20
+
+enum pms_frame_result_t {
+    PMS_FRAME_OK,
+    PMS_FRAME_TIMEOUT,
+    PMS_FRAME_BAD,
+    PMS_FRAME_CHECKSUM,
+};
+
+pms_frame_result_t pms_frame_check(const uint8_t *data, int len);
+
+// PM2.5 in ug/m3 from a frame that passed pms_frame_check()
+uint16_t pms_frame_pm25(const uint8_t *data);
+
+// A valid frame carrying pm25, for simulations
+void pms_frame_build(uint16_t pm25, uint8_t *frame);
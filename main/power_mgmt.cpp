@@ -0,0 +1,213 @@
+#include "power_mgmt.h"
+#include "app_console.h"
+#include "buttons.h"
+#include "hw_conf.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define POWER_STATS_PERIOD_US (60 * 1000 * 1000LL)
+
+static const char *TAG = "power";
+
+#if CONFIG_PM_ENABLE && POWER_MGMT_ENABLE
+static const struct {
+    const char *name;
+    esp_pm_lock_type_t type;
+} lock_configs[POWER_LOCK_COUNT] = {
+    { "fan", ESP_PM_APB_FREQ_MAX },
+    { "rgb", ESP_PM_APB_FREQ_MAX },
+    { "buzzer", ESP_PM_APB_FREQ_MAX },
+    { "pms_uart", ESP_PM_NO_LIGHT_SLEEP },
+    { "buttons", ESP_PM_NO_LIGHT_SLEEP },
+};
+
+static esp_pm_lock_handle_t locks[POWER_LOCK_COUNT];
+#endif
+
+static bool pm_enabled;
+static uint8_t held_mask;
+static portMUX_TYPE held_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Counted in the light sleep exit callback
+static volatile uint32_t wakeups;
+static volatile int64_t slept_us;
+
+static power_stats_t last_minute;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void IRAM_ATTR power_hold(power_lock_id_t id, bool hold) {
+#if CONFIG_PM_ENABLE && POWER_MGMT_ENABLE
+    if (locks[id] == NULL) {
+        return;
+    }
+    uint8_t bit = 1 << id;
+
+    // The esp_pm lock changes inside the critical section too, otherwise a
+    // release could overtake the acquire it undoes and find the lock not held.
+    // Both calls are ISR safe and only nest esp_pm's own spinlock.
+    portENTER_CRITICAL_SAFE(&held_lock);
+    if (((held_mask & bit) != 0) != hold) {
+        held_mask ^= bit;
+        if (hold) {
+            esp_pm_lock_acquire(locks[id]);
+        } else {
+            esp_pm_lock_release(locks[id]);
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&held_lock);
+#endif
+}
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS && POWER_MGMT_ENABLE
+// GPIO edge interrupts do not fire in light sleep, wake on the button level instead
+static esp_err_t sleep_enter_cb(int64_t sleep_time_us, void *arg) {
+    buttons_set_wakeup(true);
+    return ESP_OK;
+}
+
+static esp_err_t sleep_exit_cb(int64_t sleep_time_us, void *arg) {
+    // The level interrupt that woke us stays pending, the button ISR sees the press
+    buttons_set_wakeup(false);
+    wakeups = wakeups + 1;
+    slept_us = slept_us + sleep_time_us;
+    return ESP_OK;
+}
+#endif
+
+// Snapshot once a minute so the numbers do not depend on when they are read
+static void stats_timer_cb(void *arg) {
+    static uint32_t prev_wakeups;
+    static int64_t prev_slept_us;
+
+    uint32_t now_wakeups = wakeups;
+    int64_t now_slept_us = slept_us;
+    uint32_t sleep_permille = (now_slept_us - prev_slept_us) * 1000 / POWER_STATS_PERIOD_US;
+    if (sleep_permille > 1000) {
+        sleep_permille = 1000;
+    }
+
+    taskENTER_CRITICAL(&stats_lock);
+    last_minute.wakeups_per_min = now_wakeups - prev_wakeups;
+    last_minute.sleep_permille = sleep_permille;
+    last_minute.est_current_ua = (sleep_permille * POWER_EST_LIGHT_SLEEP_UA
+        + (1000 - sleep_permille) * POWER_EST_ACTIVE_UA) / 1000;
+    taskEXIT_CRITICAL(&stats_lock);
+
+    prev_wakeups = now_wakeups;
+    prev_slept_us = now_slept_us;
+}
+
+void power_mgmt_init() {
+#if CONFIG_PM_ENABLE && POWER_MGMT_ENABLE
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        ESP_ERROR_CHECK(esp_pm_lock_create(lock_configs[i].type, 0, lock_configs[i].name, &locks[i]));
+    }
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MIN_CPU_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+        return;
+    }
+    pm_enabled = true;
+
+    esp_sleep_enable_gpio_wakeup();
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs_config = {
+        .enter_cb = sleep_enter_cb,
+        .exit_cb = sleep_exit_cb,
+    };
+    esp_pm_light_sleep_register_cbs(&cbs_config);
+#endif
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = stats_timer_cb,
+        .name = "power_stats",
+    };
+    esp_timer_handle_t stats_timer;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &stats_timer));
+    esp_timer_start_periodic(stats_timer, POWER_STATS_PERIOD_US);
+
+    ESP_LOGI(TAG, "DFS %d..%d MHz, light sleep %s", POWER_MIN_CPU_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+             pm_config.light_sleep_enable ? "on" : "off");
+#else
+    ESP_LOGI(TAG, "Power management disabled");
+#endif
+}
+
+void power_mgmt_start() {
+#if CONFIG_PM_ENABLE && POWER_MGMT_ENABLE
+    // Light sleep needs the modem asleep between beacons. The listen interval
+    // has to stay below the MRP idle retry interval so peers reach us on the
+    // first retransmission, that also bounds subscription report latency.
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK && config.sta.listen_interval != POWER_WIFI_LISTEN_INTERVAL) {
+        config.sta.listen_interval = POWER_WIFI_LISTEN_INTERVAL;
+        esp_wifi_set_config(WIFI_IF_STA, &config);
+    }
+    esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+#endif
+}
+
+void power_get_stats(power_stats_t *stats) {
+    taskENTER_CRITICAL(&stats_lock);
+    *stats = last_minute;
+    taskEXIT_CRITICAL(&stats_lock);
+    stats->enabled = pm_enabled;
+    stats->held_mask = held_mask;
+}
+
+
+static esp_err_t power_handler(int argc, char **argv) {
+    power_stats_t stats;
+    power_get_stats(&stats);
+
+    if (!stats.enabled) {
+        printf("Power management disabled\n");
+        return ESP_OK;
+    }
+    printf("DFS %d..%d MHz\n", POWER_MIN_CPU_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    printf("last minute: %lu wakeups, asleep %u.%u%%, est. %lu.%03lu mA\n", (unsigned long)stats.wakeups_per_min,
+           stats.sleep_permille / 10, stats.sleep_permille % 10,
+           (unsigned long)(stats.est_current_ua / 1000), (unsigned long)(stats.est_current_ua % 1000));
+#if CONFIG_PM_ENABLE && POWER_MGMT_ENABLE
+    printf("held:");
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        if (stats.held_mask & (1 << i)) {
+            printf(" %s", lock_configs[i].name);
+        }
+    }
+    printf("%s\n", stats.held_mask == 0 ? " none" : "");
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);
+#endif
+#endif
+    return ESP_OK;
+}
+
+void power_mgmt_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "power",
+            .description = "Show wakeups, time asleep, estimated current and held PM locks.",
+            .handler = power_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// Dynamic frequency scaling and automatic light sleep. Anything that needs
+// the clocks running holds its lock only while it is active, so the chip
+// sleeps between sensor reads once the fan and the LEDs are off.
+enum power_lock_id_t : uint8_t {
+    // LEDC outputs, need a stable APB clock
+    POWER_LOCK_FAN,
+    POWER_LOCK_RGB,
+    POWER_LOCK_BUZZER,
+    // UART on REF_TICK, only light sleep has to be held off
+    POWER_LOCK_PMS_UART,
+    // A held button, its release would be missed while asleep
+    POWER_LOCK_BUTTONS,
+    POWER_LOCK_COUNT,
+};
+
+struct power_stats_t {
+    bool enabled;
+    // Over the last full minute
+    uint32_t wakeups_per_min;
+    uint16_t sleep_permille;
+    uint32_t est_current_ua;
+    // Bit per power_lock_id_t currently held
+    uint8_t held_mask;
+};
+
+// Configure esp_pm, call before the drivers are initialized
+void power_mgmt_init();
+
+// Wi-Fi modem sleep, call once Matter has started the station
+void power_mgmt_start();
+
+// Hold or release the lock of one consumer, repeated calls are ignored. Safe from ISRs.
+void power_hold(power_lock_id_t id, bool hold);
+
+void power_get_stats(power_stats_t *stats);
+
+void power_mgmt_register_commands();
@@ -0,0 +1,20 @@
+#include "power_model.h"
+
+uint32_t power_model_fan_mw(const power_model_t *model, uint8_t fan_percentage) {
+    if (fan_percentage == 0) {
+        return 0;
+    }
+    if (fan_percentage > 100) {
+        fan_percentage = 100;
+    }
+    // Fan laws, shaft power grows with the cube of the speed
+    float x = fan_percentage / 100.0f;
+    return model->fan_min_mw + static_cast<uint32_t>((model->fan_max_mw - model->fan_min_mw) * x * x * x + 0.5f);
+}
+
+uint32_t power_model_estimate(const power_model_t *model, uint8_t fan_percentage, uint8_t led_level) {
+    if (led_level >= POWER_MODEL_LED_LEVELS) {
+        led_level = POWER_MODEL_LED_LEVELS - 1;
+    }
+    return model->base_mw + power_model_fan_mw(model, fan_percentage) + model->led_mw[led_level];
+}
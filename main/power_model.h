@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Electrical input power of the purifier estimated from what it is doing.
+// Pure logic, also built into the host tools.
+
+#define POWER_MODEL_LED_LEVELS 4
+
+struct power_model_t {
+    // ESP32, sensor and supply losses, always drawn
+    uint32_t base_mw;
+    // Motor at 1 % and at 100 %, in between power follows the cube of the speed
+    uint32_t fan_min_mw;
+    uint32_t fan_max_mw;
+    // RGB and indicator LEDs per led_set_brightness() level
+    uint32_t led_mw[POWER_MODEL_LED_LEVELS];
+};
+
+// Motor only, 0 when it is off
+uint32_t power_model_fan_mw(const power_model_t *model, uint8_t fan_percentage);
+
+// Whole device
+uint32_t power_model_estimate(const power_model_t *model, uint8_t fan_percentage, uint8_t led_level);
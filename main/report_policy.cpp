@@ -0,0 +1,26 @@
+#include "report_policy.h"
+#include "hw_conf.h"
+
+bool report_policy_power_due(const report_policy_t *policy, uint32_t power_mw) {
+    if (!policy->power_reported) {
+        return true;
+    }
+    uint32_t threshold = policy->power_mw * ENERGY_POWER_REPORT_PERCENT / 100;
+    threshold = threshold > ENERGY_POWER_REPORT_MW ? threshold : ENERGY_POWER_REPORT_MW;
+    uint32_t delta = power_mw > policy->power_mw ? power_mw - policy->power_mw : policy->power_mw - power_mw;
+    return delta >= threshold;
+}
+
+bool report_policy_energy_due(const report_policy_t *policy, uint64_t energy_mwh) {
+    return !policy->energy_reported || energy_mwh >= policy->energy_mwh + ENERGY_REPORT_MWH;
+}
+
+void report_policy_power_sent(report_policy_t *policy, uint32_t power_mw) {
+    policy->power_reported = true;
+    policy->power_mw = power_mw;
+}
+
+void report_policy_energy_sent(report_policy_t *policy, uint64_t energy_mwh) {
+    policy->energy_reported = true;
+    policy->energy_mwh = energy_mwh;
+}
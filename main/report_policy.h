@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// When ActivePower and CumulativeEnergyImported are reported: only once they
+// moved past the hw_conf.h thresholds, not on every estimate. Pure logic, the
+// energy module and tools/host/device_sim decide with the same rules.
+
+// What was last reported
+struct report_policy_t {
+    bool power_reported;
+    uint32_t power_mw;
+    bool energy_reported;
+    uint64_t energy_mwh;
+};
+
+// Never reported, or moved by ENERGY_POWER_REPORT_PERCENT of the last report
+// and at least ENERGY_POWER_REPORT_MW
+bool report_policy_power_due(const report_policy_t *policy, uint32_t power_mw);
+
+// Never reported, or grew by ENERGY_REPORT_MWH since the last report
+bool report_policy_energy_due(const report_policy_t *policy, uint64_t energy_mwh);
+
+void report_policy_power_sent(report_policy_t *policy, uint32_t power_mw);
+
+void report_policy_energy_sent(report_policy_t *policy, uint64_t energy_mwh);
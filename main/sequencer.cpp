@@ -0,0 +1,212 @@
+#include "sequencer.h"
+#include "buzzer.h"
+#include "led.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+
+
+static const char *TAG = "sequencer";
+
+static const seq_step_t reset_countdown_steps[] = {
+    SEQ_INDICATORS(LED_IND_WARNING, 0),
+    SEQ_BEEP(0), SEQ_RGB(255, 0, 0, 500), SEQ_RGB(0, 0, 0, 500),
+    SEQ_BEEP(0), SEQ_RGB(255, 0, 0, 500), SEQ_RGB(0, 0, 0, 500),
+    SEQ_BEEP(0), SEQ_RGB(255, 0, 0, 500), SEQ_RGB(0, 0, 0, 500),
+};
+const seq_sequence_t seq_reset_countdown = {
+    reset_countdown_steps, sizeof(reset_countdown_steps) / sizeof(reset_countdown_steps[0]), SEQ_PRIORITY_USER
+};
+
+static const seq_step_t commissioned_steps[] = {
+    SEQ_INDICATORS(LED_IND_WIFI, 0),
+    SEQ_BEEP(150), SEQ_BEEP(0),
+    SEQ_RGB(0, 0, 255, 200), SEQ_RGB(0, 255, 0, 200), SEQ_RGB(255, 0, 0, 400),
+};
+const seq_sequence_t seq_commissioned = {
+    commissioned_steps, sizeof(commissioned_steps) / sizeof(commissioned_steps[0]), SEQ_PRIORITY_EVENT
+};
+
+// Warning indicator, n red flashes, pause
+static seq_step_t error_steps[1 + 2 * SEQ_ERROR_MAX + 1];
+static seq_sequence_t error_sequence = { error_steps, 0, SEQ_PRIORITY_STATUS };
+
+
+static esp_timer_handle_t step_timer;
+static SemaphoreHandle_t seq_mutex;
+
+static const seq_sequence_t *current;
+static uint8_t next_step;
+static seq_done_cb_t current_done;
+// When the pending step is due, callbacks that fire earlier are left over
+// from a cancelled sequence
+static int64_t step_due_us;
+
+
+static void apply_step(const seq_step_t *step) {
+    switch (step->kind) {
+        case SEQ_STEP_RGB:
+            led_rgb_override({ step->arg[0], step->arg[1], step->arg[2] });
+            break;
+        case SEQ_STEP_INDICATORS:
+            led_status_override(step->arg[0]);
+            break;
+        case SEQ_STEP_BEEP:
+            buzzer_beep();
+            break;
+        default:
+            break;
+    }
+}
+
+// Run steps until one needs to wait, returns the callback to call if the sequence ended
+static seq_done_cb_t run_steps() {
+    while (next_step < current->count) {
+        const seq_step_t *step = &current->steps[next_step++];
+        apply_step(step);
+        if (step->duration_ms > 0) {
+            step_due_us = esp_timer_get_time() + step->duration_ms * 1000LL;
+            esp_timer_start_once(step_timer, step->duration_ms * 1000ULL);
+            return NULL;
+        }
+    }
+
+    seq_done_cb_t done = current_done;
+    current = NULL;
+    current_done = NULL;
+    led_release_override();
+    return done;
+}
+
+static void step_timer_cb(void *arg) {
+    seq_done_cb_t done = NULL;
+    bool ended = false;
+
+    xSemaphoreTake(seq_mutex, portMAX_DELAY);
+    if (current != NULL && esp_timer_get_time() >= step_due_us) {
+        done = run_steps();
+        ended = current == NULL;
+    }
+    xSemaphoreGive(seq_mutex);
+
+    if (ended && done != NULL) {
+        done(true);
+    }
+}
+
+// Stop the running sequence, called with the mutex held
+static seq_done_cb_t stop_locked() {
+    if (current == NULL) {
+        return NULL;
+    }
+    esp_timer_stop(step_timer);
+    seq_done_cb_t done = current_done;
+    current = NULL;
+    current_done = NULL;
+    led_release_override();
+    return done;
+}
+
+// Callbacks of a start, run by the caller once the mutex is released
+struct seq_start_t {
+    seq_done_cb_t cancelled;
+    seq_done_cb_t finished;
+    bool started;
+};
+
+// Start a sequence unless a higher priority one plays, called with the mutex held
+static seq_start_t start_locked(const seq_sequence_t *sequence, seq_done_cb_t done) {
+    seq_start_t start = { NULL, NULL, false };
+    if (current != NULL && current->priority > sequence->priority) {
+        start.cancelled = done;
+        return start;
+    }
+    start.cancelled = stop_locked();
+    start.started = true;
+    current = sequence;
+    current_done = done;
+    next_step = 0;
+    seq_done_cb_t finished = run_steps();
+    if (current == NULL) {
+        start.finished = finished;
+    }
+    return start;
+}
+
+static bool finish_start(const seq_start_t &start) {
+    if (start.cancelled != NULL) {
+        start.cancelled(false);
+    }
+    if (start.finished != NULL) {
+        start.finished(true);
+    }
+    return start.started;
+}
+
+bool sequencer_play(const seq_sequence_t *sequence, seq_done_cb_t done) {
+    xSemaphoreTake(seq_mutex, portMAX_DELAY);
+    seq_start_t start = start_locked(sequence, done);
+    xSemaphoreGive(seq_mutex);
+
+    return finish_start(start);
+}
+
+bool sequencer_play_error(uint8_t code) {
+    if (code == 0 || code > SEQ_ERROR_MAX) {
+        ESP_LOGW(TAG, "Invalid error code %u", code);
+        return false;
+    }
+
+    xSemaphoreTake(seq_mutex, portMAX_DELAY);
+    if (current == &error_sequence) {
+        // Not rebuilt while it plays
+        xSemaphoreGive(seq_mutex);
+        return true;
+    }
+    if (current != NULL && current->priority > error_sequence.priority) {
+        xSemaphoreGive(seq_mutex);
+        return false;
+    }
+
+    uint8_t n = 0;
+    error_steps[n++] = SEQ_INDICATORS(LED_IND_WARNING, 0);
+    for (uint8_t i = 0; i < code; i++) {
+        error_steps[n++] = SEQ_RGB(0, 0, 255, 250);
+        error_steps[n++] = SEQ_RGB(0, 0, 0, 250);
+    }
+    error_steps[n++] = SEQ_WAIT(1000);
+    error_sequence.count = n;
+    seq_start_t start = start_locked(&error_sequence, NULL);
+    xSemaphoreGive(seq_mutex);
+
+    return finish_start(start);
+}
+
+void sequencer_cancel() {
+    xSemaphoreTake(seq_mutex, portMAX_DELAY);
+    seq_done_cb_t cancelled = stop_locked();
+    xSemaphoreGive(seq_mutex);
+
+    if (cancelled != NULL) {
+        cancelled(false);
+    }
+}
+
+bool sequencer_running() {
+    return current != NULL;
+}
+
+void sequencer_init() {
+    seq_mutex = xSemaphoreCreateMutex();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = step_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sequencer",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &step_timer));
+}
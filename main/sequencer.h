@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+// Timer driven LED/buzzer/indicator animations. Steps run from an esp_timer
+// callback, so nobody has to sleep while an animation plays. RGB and indicator
+// steps go through the LED overrides and the normal display comes back when
+// the sequence ends or is cancelled.
+
+enum seq_step_kind_t : uint8_t {
+    // Show arg[0..2] on the green, orange and red LEDs (full brightness)
+    SEQ_STEP_RGB,
+    // Light the indicators in arg[0] on top of the normal ones
+    SEQ_STEP_INDICATORS,
+    SEQ_STEP_BEEP,
+    // Only wait
+    SEQ_STEP_WAIT,
+};
+
+struct seq_step_t {
+    seq_step_kind_t kind;
+    uint8_t arg[3];
+    // Time until the next step
+    uint16_t duration_ms;
+};
+
+#define SEQ_RGB(green, orange, red, ms) { SEQ_STEP_RGB, { green, orange, red }, ms }
+#define SEQ_INDICATORS(mask, ms) { SEQ_STEP_INDICATORS, { mask, 0, 0 }, ms }
+#define SEQ_BEEP(ms) { SEQ_STEP_BEEP, { 0, 0, 0 }, ms }
+#define SEQ_WAIT(ms) { SEQ_STEP_WAIT, { 0, 0, 0 }, ms }
+
+// A playing sequence is only replaced by one of the same or a higher
+// priority, lower ones are dropped
+enum seq_priority_t : uint8_t {
+    // Background status such as error codes
+    SEQ_PRIORITY_STATUS,
+    // One-off events such as commissioning
+    SEQ_PRIORITY_EVENT,
+    // Feedback to a held button, cutting it short would abort the action
+    SEQ_PRIORITY_USER,
+};
+
+struct seq_sequence_t {
+    const seq_step_t *steps;
+    uint8_t count;
+    seq_priority_t priority;
+};
+
+// completed is false if the sequence was cancelled, replaced by another one or
+// dropped for a higher priority one.
+// Called from the esp_timer task on completion, from the caller on cancel.
+typedef void (*seq_done_cb_t)(bool completed);
+
+// Factory reset countdown, 3 s
+extern const seq_sequence_t seq_reset_countdown;
+// Played once commissioning completes
+extern const seq_sequence_t seq_commissioned;
+
+// Error codes shown as red flashes
+#define SEQ_ERROR_SENSOR_DEAD 2
+#define SEQ_ERROR_MAX 9
+
+void sequencer_init();
+
+// Start a sequence, a running one of the same or lower priority is cancelled
+// first. Returns false if it was dropped.
+bool sequencer_play(const seq_sequence_t *sequence, seq_done_cb_t done);
+
+// Flash an error code (1..SEQ_ERROR_MAX), lowest priority. Returns false if it
+// was dropped.
+bool sequencer_play_error(uint8_t code);
+
+void sequencer_cancel();
+
+bool sequencer_running();
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SHA-256 for verifying streamed OTA payloads, also built into the host tools
+
+#define SHA256_SIZE 32
+
+struct sha256_t {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    uint8_t block_len;
+};
+
+void sha256_init(sha256_t *ctx);
+
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+
+void sha256_final(sha256_t *ctx, uint8_t digest[SHA256_SIZE]);
@@ -0,0 +1,182 @@
+#include "tasks.h"
+#include "app_console.h"
+#include "hw_conf.h"
+
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <lwip/sockets.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "tasks";
+
+// Indexed by app_task_id_t. Wi-Fi (23) and lwIP (18) stay above everything
+// here, the CHIP task runs at priority 1.
+static const app_task_config_t app_tasks[] = {
+    { "pms_task", 3072, 7, APP_TASK_CORE_CONTROL },
+    { "auto_controller", 4096, 6, APP_TASK_CORE_CONTROL },
+    { "fan_actuator", 4096, 6, APP_TASK_CORE_CONTROL },
+    { "buzzer", 2048, 10, APP_TASK_CORE_CONTROL },
+    { "blink_task", 2048, 3, APP_TASK_CORE_CONTROL },
+    { "wireless_monitor", 4096, 2, APP_TASK_CORE_NETWORK },
+    { "fan_cal", 3072, 2, APP_TASK_CORE_CONTROL },
+    { "ota", 4096, 2, APP_TASK_CORE_NETWORK },
+    // Created by ESP-IDF, stack and core are sdkconfig's (CONFIG_ESP_MAIN_TASK_*), only the priority is applied
+    { "main", CONFIG_ESP_MAIN_TASK_STACK_SIZE, 5, CONFIG_ESP_MAIN_TASK_AFFINITY },
+    { "net_stress", 3072, 4, APP_TASK_CORE_NETWORK },
+    { "httpd_metrics", 4096, 2, APP_TASK_CORE_NETWORK },
+};
+static_assert(sizeof(app_tasks) / sizeof(app_tasks[0]) == APP_TASK_COUNT, "Task table out of sync with app_task_id_t");
+
+static TaskHandle_t task_handles[APP_TASK_COUNT];
+
+static loop_stats_t task_jitter[APP_TASK_COUNT];
+static portMUX_TYPE jitter_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+BaseType_t app_task_create(app_task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle) {
+    const app_task_config_t &config = app_tasks[id];
+    BaseType_t ret = xTaskCreatePinnedToCore(function, config.name, config.stack, arg,
+                                             config.priority, &task_handles[id], config.core);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create task %s", config.name);
+        return ret;
+    }
+    if (handle != NULL) {
+        *handle = task_handles[id];
+    }
+    return ret;
+}
+
+void app_task_adopt_current(app_task_id_t id) {
+    task_handles[id] = xTaskGetCurrentTaskHandle();
+    vTaskPrioritySet(NULL, app_tasks[id].priority);
+}
+
+const app_task_config_t *app_task_get_config(app_task_id_t id) {
+    return &app_tasks[id];
+}
+
+bool app_task_get_stack_free(app_task_id_t id, uint32_t *free_bytes) {
+    if (task_handles[id] == NULL) {
+        return false;
+    }
+    *free_bytes = uxTaskGetStackHighWaterMark(task_handles[id]);
+    return true;
+}
+
+void app_task_log_layout() {
+    ESP_LOGI(TAG, "%-18s %4s %4s %6s", "task", "core", "prio", "stack");
+    for (int i = 0; i < APP_TASK_COUNT; i++) {
+        if (task_handles[i] == NULL) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-18s %4d %4u %6lu", app_tasks[i].name, (int)app_tasks[i].core,
+                 (unsigned)uxTaskPriorityGet(task_handles[i]), (unsigned long)app_tasks[i].stack);
+    }
+}
+
+void app_task_record_jitter(app_task_id_t id, int32_t deviation_us) {
+    loop_stats_t *stats = &task_jitter[id];
+
+    taskENTER_CRITICAL(&jitter_lock);
+    if (stats->samples == 0 || deviation_us < stats->min_us) {
+        stats->min_us = deviation_us;
+    }
+    if (stats->samples == 0 || deviation_us > stats->max_us) {
+        stats->max_us = deviation_us;
+    }
+    stats->sum_abs_us += deviation_us < 0 ? -deviation_us : deviation_us;
+    stats->samples++;
+    taskEXIT_CRITICAL(&jitter_lock);
+}
+
+void app_task_get_jitter(app_task_id_t id, loop_stats_t *stats) {
+    taskENTER_CRITICAL(&jitter_lock);
+    *stats = task_jitter[id];
+    taskEXIT_CRITICAL(&jitter_lock);
+}
+
+static void print_jitter(const char *label, app_task_id_t id) {
+    loop_stats_t stats;
+    app_task_get_jitter(id, &stats);
+    uint32_t mean_abs = stats.samples > 0 ? stats.sum_abs_us / stats.samples : 0;
+    printf("%s: samples %lu, min %ld us, max %ld us, mean |dev| %lu us\n", label,
+           (unsigned long)stats.samples, (long)stats.min_us, (long)stats.max_us, (unsigned long)mean_abs);
+}
+
+
+#if TASK_NET_STRESS
+// Send UDP datagrams to the all-nodes multicast group as fast as lwIP accepts them
+static void net_stress_task(void *pvParameters) {
+    static uint8_t payload[1024];
+    uint32_t sent = 0;
+    TickType_t last_log = xTaskGetTickCount();
+
+    int sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "net_stress: socket failed");
+        vTaskDelete(NULL);
+    }
+
+    struct sockaddr_in6 dest = {};
+    dest.sin6_family = AF_INET6;
+    dest.sin6_port = htons(9);
+    inet6_aton("ff02::1", &dest.sin6_addr);
+    dest.sin6_scope_id = esp_netif_get_netif_impl_index(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
+
+    while (1) {
+        if (sendto(sock, payload, sizeof(payload), 0, (struct sockaddr *)&dest, sizeof(dest)) > 0) {
+            sent++;
+        } else {
+            // TX queue full, let lwIP drain it
+            vTaskDelay(1);
+        }
+
+        if (xTaskGetTickCount() - last_log >= pdMS_TO_TICKS(10000)) {
+            loop_stats_t pms, controller;
+            app_task_get_jitter(APP_TASK_PMS, &pms);
+            app_task_get_jitter(APP_TASK_AUTO_CONTROLLER, &controller);
+            ESP_LOGI(TAG, "net_stress: %lu datagrams, pms period dev %ld..%ld us, controller latency %ld..%ld us",
+                     (unsigned long)sent, (long)pms.min_us, (long)pms.max_us,
+                     (long)controller.min_us, (long)controller.max_us);
+            last_log = xTaskGetTickCount();
+        }
+    }
+}
+#endif
+
+void app_task_start_net_stress() {
+#if TASK_NET_STRESS
+    ESP_LOGW(TAG, "Network stress mode enabled");
+    app_task_create(APP_TASK_NET_STRESS, net_stress_task, NULL, NULL);
+#endif
+}
+
+
+static esp_err_t tasks_handler(int argc, char **argv) {
+    printf("%-18s %4s %4s %6s %10s\n", "task", "core", "prio", "stack", "free stack");
+    for (int i = 0; i < APP_TASK_COUNT; i++) {
+        if (task_handles[i] == NULL) {
+            continue;
+        }
+        printf("%-18s %4d %4u %6lu %10u\n", app_tasks[i].name, (int)app_tasks[i].core,
+               (unsigned)uxTaskPriorityGet(task_handles[i]), (unsigned long)app_tasks[i].stack,
+               (unsigned)uxTaskGetStackHighWaterMark(task_handles[i]));
+    }
+    print_jitter("pms period deviation", APP_TASK_PMS);
+    print_jitter("controller queue latency", APP_TASK_AUTO_CONTROLLER);
+    return ESP_OK;
+}
+
+void app_task_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "tasks",
+            .description = "Show task layout, free stack and control loop jitter.",
+            .handler = tasks_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <cstdint>
+
+// Wi-Fi, lwIP and the CHIP task run on the PRO CPU, sensor and control
+// loops are kept on the APP CPU. Single core builds put everything on core 0.
+#define APP_TASK_CORE_NETWORK 0
+#if CONFIG_FREERTOS_UNICORE
+#define APP_TASK_CORE_CONTROL 0
+#else
+#define APP_TASK_CORE_CONTROL 1
+#endif
+
+enum app_task_id_t {
+    APP_TASK_PMS,
+    APP_TASK_AUTO_CONTROLLER,
+    APP_TASK_FAN_ACTUATOR,
+    APP_TASK_BUZZER,
+    APP_TASK_BLINK,
+    APP_TASK_WIRELESS_MONITOR,
+    APP_TASK_FAN_CAL,
+    APP_TASK_OTA,
+    // Button loop runs in the main task, only its priority is applied
+    APP_TASK_BUTTONS,
+    APP_TASK_NET_STRESS,
+    // esp_http_server task of the metrics endpoint, created by httpd_start()
+    APP_TASK_METRICS,
+    APP_TASK_COUNT,
+};
+
+struct app_task_config_t {
+    const char *name;
+    uint32_t stack;
+    UBaseType_t priority;
+    BaseType_t core;
+};
+
+// Deviation of a periodic loop from its nominal timing
+struct loop_stats_t {
+    uint32_t samples;
+    int32_t min_us;
+    int32_t max_us;
+    uint64_t sum_abs_us;
+};
+
+// Create a task with the stack, priority and core from the task table
+BaseType_t app_task_create(app_task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle);
+
+// Apply the table priority to the calling task
+void app_task_adopt_current(app_task_id_t id);
+
+// Stack, priority and core from the table, for tasks created by other components
+const app_task_config_t *app_task_get_config(app_task_id_t id);
+
+// Lowest free stack in bytes of a task that exists, false otherwise
+bool app_task_get_stack_free(app_task_id_t id, uint32_t *free_bytes);
+
+// Print the resulting task layout
+void app_task_log_layout();
+
+// Record the deviation of one loop iteration, safe to call from any task
+void app_task_record_jitter(app_task_id_t id, int32_t deviation_us);
+
+void app_task_get_jitter(app_task_id_t id, loop_stats_t *stats);
+
+// Saturate the network and log control loop jitter periodically
+void app_task_start_net_stress();
+
+void app_task_register_commands();
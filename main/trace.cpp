@@ -0,0 +1,113 @@
+#include "trace.h"
+#include "app_console.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <esp_attr.h>
+#include <esp_timer.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_RING_MASK (TRACE_RING_RECORDS - 1)
+static_assert((TRACE_RING_RECORDS & TRACE_RING_MASK) == 0, "TRACE_RING_RECORDS must be a power of two");
+
+static DRAM_ATTR trace_record_t trace_ring[TRACE_RING_RECORDS];
+// Total number of records ever claimed, the slot is the low bits
+static DRAM_ATTR uint32_t trace_head;
+// Records before this index were cleared
+static uint32_t trace_tail;
+
+
+void IRAM_ATTR trace_record(trace_event_t event, uint32_t a0, uint32_t a1) {
+    // Read before claiming the slot so records are in time order unless an ISR
+    // or the other core claims one in between
+    uint32_t time_us = static_cast<uint32_t>(esp_timer_get_time());
+    uint32_t index = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+    trace_record_t *record = &trace_ring[index & TRACE_RING_MASK];
+
+    // Invalidate the slot first so a reader never mixes two records
+    __atomic_store_n(&record->seq, static_cast<uint16_t>(~index), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->time_us = time_us;
+    record->event = event;
+    record->flags = (xPortInIsrContext() ? TRACE_FLAG_ISR : 0) | (xPortGetCoreID() ? TRACE_FLAG_CORE : 0);
+    record->a0 = a0;
+    record->a1 = a1;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&record->seq, static_cast<uint16_t>(index), __ATOMIC_RELAXED);
+}
+
+void trace_clear() {
+    // Writers never go back, the dump just starts later
+    trace_tail = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+}
+
+void trace_range(uint32_t *start, uint32_t *end) {
+    uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+    *start = head - trace_tail > TRACE_RING_RECORDS ? head - TRACE_RING_RECORDS : trace_tail;
+    *end = head;
+}
+
+bool trace_format_record(uint32_t index, char *line) {
+    const trace_record_t *slot = &trace_ring[index & TRACE_RING_MASK];
+    trace_record_t record;
+
+    // Copy and check the slot was not rewritten meanwhile
+    uint16_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    memcpy(&record, slot, sizeof(record));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (seq != static_cast<uint16_t>(index) || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&record);
+    line[0] = 'T';
+    line[1] = ' ';
+    for (size_t i = 0; i < sizeof(record); i++) {
+        snprintf(&line[2 + 2 * i], 3, "%02x", bytes[i]);
+    }
+    line[TRACE_LINE_LEN - 1] = '\n';
+    return true;
+}
+
+void trace_dump() {
+    uint32_t start, end;
+    uint32_t skipped = 0;
+    char line[TRACE_LINE_LEN + 1];
+
+    trace_range(&start, &end);
+    printf("# trace %lu records, %lu lost, %u per ring\n", (unsigned long)(end - start),
+           (unsigned long)(start - trace_tail), TRACE_RING_RECORDS);
+    for (uint32_t index = start; index < end; index++) {
+        if (!trace_format_record(index, line)) {
+            skipped++;
+            continue;
+        }
+        line[TRACE_LINE_LEN] = '\0';
+        fputs(line, stdout);
+    }
+    printf("# end, %lu overwritten while dumping\n", (unsigned long)skipped);
+}
+
+
+static esp_err_t trace_dump_handler(int argc, char **argv) {
+    trace_dump();
+    if (argc > 0 && strcmp(argv[0], "clear") == 0) {
+        trace_clear();
+    }
+    return ESP_OK;
+}
+
+void trace_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "trace-dump",
+            .description = "Print the binary event trace, decode with tools/trace_decode.py. Usage: trace-dump [clear].",
+            .handler = trace_dump_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "hw_conf.h"
+
+#include <cstdint>
+
+// Binary event trace. Records are written into a RAM ring without locks, from
+// tasks and ISRs, and dumped as hex with "purifier trace-dump". Decode them on
+// the host with tools/trace_decode.py, which reads the event list below, so
+// keep one X() per line. The format string is evaluated by the decoder with
+// a0 and a1 as the two arguments.
+#define TRACE_EVENTS(X) \
+    X(TRACE_BUTTON,          "pin={a0} state={['released', 'pressed', 'long'][a1]}") \
+    X(TRACE_SENSOR_FRAME,    "result={['ok', 'timeout', 'bad', 'checksum'][a0]} bytes={a1}") \
+    X(TRACE_SENSOR_FILTERED, "pm25_raw={a0} pm25={a1}") \
+    X(TRACE_SENSOR_RECOVERY, "action={['', 'flush', 'reinit', 'power_cycle'][a0]} failures={a1}") \
+    X(TRACE_CONTROLLER,      "pm25={a0} aq={a1 >> 8} percentage={a1 & 0xff}") \
+    X(TRACE_CONTROLLER_LAG,  "queue_latency_us={a0}") \
+    X(TRACE_FAN_WRITE,       "{'mode' if a0 else 'percentage'}={a1}") \
+    X(TRACE_FAN_SET,         "percentage={a0} freq_hz={a1}") \
+    X(TRACE_LED_RGB,         "green={a0 >> 16} orange={(a0 >> 8) & 0xff} red={a0 & 0xff} lightness={a1 >> 16} fade_ms={a1 & 0xffff}") \
+    X(TRACE_LED_STATUS,      "indicators=0x{a0:02x}") \
+    X(TRACE_WIFI_CONNECTED,  "elapsed_ms={a0} directed={a1}") \
+    X(TRACE_WIFI_FALLBACK,   "reason={a0}") \
+    X(TRACE_UI,              "event={['power', 'brightness', 'mode'][a0 >> 16]} mode={(a0 >> 8) & 0xff} brightness={a0 & 0xff} commands=0x{a1:02x}") \
+
+#define TRACE_EVENT_ENUM(name, format) name,
+enum trace_event_t : uint8_t {
+    TRACE_EVENTS(TRACE_EVENT_ENUM)
+    TRACE_EVENT_COUNT,
+};
+#undef TRACE_EVENT_ENUM
+
+// 16 bytes, little endian, decoded as "<IHBBII"
+struct trace_record_t {
+    // esp_timer time, wraps after 71 minutes
+    uint32_t time_us;
+    // Low bits of the write index, tells the reader whether the slot was overwritten
+    uint16_t seq;
+    uint8_t event;
+    // TRACE_FLAG_*
+    uint8_t flags;
+    uint32_t a0;
+    uint32_t a1;
+};
+static_assert(sizeof(trace_record_t) == 16, "Trace records must stay 16 bytes");
+
+#define TRACE_FLAG_ISR  0x01
+#define TRACE_FLAG_CORE 0x02
+
+#if TRACE_ENABLE
+#define TRACE(event, a0, a1) trace_record(event, static_cast<uint32_t>(a0), static_cast<uint32_t>(a1))
+#else
+#define TRACE(event, a0, a1) do { } while (0)
+#endif
+
+// Safe from ISRs and any task, placed in IRAM
+void trace_record(trace_event_t event, uint32_t a0, uint32_t a1);
+
+void trace_clear();
+
+// "T <32 hex digits>\n", the dump and log export format
+#define TRACE_LINE_LEN (2 + 2 * sizeof(trace_record_t) + 1)
+
+// Indexes of the records currently in the ring, [start, end)
+void trace_range(uint32_t *start, uint32_t *end);
+
+// Format one record as a TRACE_LINE_LEN line (not terminated), false if it was overwritten
+bool trace_format_record(uint32_t index, char *line);
+
+// Print the ring as hex records, oldest first
+void trace_dump();
+
+void trace_register_commands();
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Front panel state machine. Every (fan mode, LED brightness, button) maps to
+// a transition holding the commands to run and their arguments, built at
+// compile time and checked with static_asserts below. The driver executes the
+// commands, nothing here touches hardware or Matter, so the table also builds
+// into the host tools (tools/host/ui_table prints it).
+
+// Same values as chip::app::Clusters::FanControl::FanModeEnum,
+// kept here so the table builds without the Matter SDK
+enum ui_mode_t : uint8_t {
+    UI_MODE_OFF = 0,
+    UI_MODE_LOW = 1,
+    UI_MODE_MEDIUM = 2,
+    UI_MODE_HIGH = 3,
+    UI_MODE_ON = 4,
+    UI_MODE_AUTO = 5,
+    UI_MODE_SMART = 6,
+    UI_MODE_COUNT,
+};
+
+// Fan speed for a mode written over Matter or picked with the buttons. Auto
+// starts from the controller's current percentage, modes the purifier does
+// not offer turn it off.
+constexpr uint8_t ui_mode_percentage(ui_mode_t mode, uint8_t auto_percentage) {
+    return mode == UI_MODE_LOW ? 20
+        : mode == UI_MODE_HIGH ? 100
+        : mode == UI_MODE_AUTO ? auto_percentage
+        : 0;
+}
+
+// Mode shown and reported for a speed set directly
+constexpr ui_mode_t ui_mode_from_percentage(uint8_t percentage) {
+    return percentage == 0 ? UI_MODE_OFF
+        : percentage <= 30 ? UI_MODE_LOW
+        : UI_MODE_HIGH;
+}
+
+// Short presses, long presses are gestures of their own (reset, calibration)
+enum ui_event_t : uint8_t {
+    UI_EVENT_POWER,
+    UI_EVENT_BRIGHTNESS,
+    UI_EVENT_MODE,
+    UI_EVENT_COUNT,
+};
+
+// LED brightness levels the buttons step through, 0 (off) is only shown while the fan is off
+#define UI_BRIGHTNESS_MIN 1
+#define UI_BRIGHTNESS_MAX 3
+#define UI_BRIGHTNESS_COUNT (UI_BRIGHTNESS_MAX - UI_BRIGHTNESS_MIN + 1)
+
+// Commands, run in this order
+#define UI_CMD_BEEP           0x01
+// Set the LED brightness to the transition's brightness
+#define UI_CMD_SET_BRIGHTNESS 0x02
+// Turn the fan back on with the mode or speed it had before it was switched off
+#define UI_CMD_RESTORE        0x04
+// Request the transition's fan mode
+#define UI_CMD_SET_MODE       0x08
+
+struct ui_transition_t {
+    uint8_t commands;
+    ui_mode_t mode;
+    uint8_t brightness;
+};
+
+// Mode button: High -> Low -> Auto -> High, anything else goes to High
+constexpr ui_mode_t ui_next_mode(ui_mode_t mode) {
+    return mode == UI_MODE_HIGH ? UI_MODE_LOW
+        : mode == UI_MODE_LOW ? UI_MODE_AUTO
+        : UI_MODE_HIGH;
+}
+
+// The rules, evaluated once per table entry at compile time
+constexpr ui_transition_t ui_rule(ui_mode_t mode, uint8_t brightness, ui_event_t event) {
+    // Off: only power does something, it restores the previous setting
+    if (mode == UI_MODE_OFF) {
+        if (event == UI_EVENT_POWER) {
+            return { UI_CMD_BEEP | UI_CMD_RESTORE, mode, brightness };
+        }
+        return { 0, mode, brightness };
+    }
+    // Dimmed to the power button only: any button lights the panel up first
+    if (brightness <= UI_BRIGHTNESS_MIN) {
+        return { UI_CMD_BEEP | UI_CMD_SET_BRIGHTNESS, mode, UI_BRIGHTNESS_MAX };
+    }
+    switch (event) {
+        case UI_EVENT_POWER:
+            return { UI_CMD_BEEP | UI_CMD_SET_MODE, UI_MODE_OFF, brightness };
+        case UI_EVENT_BRIGHTNESS:
+            return { UI_CMD_BEEP | UI_CMD_SET_BRIGHTNESS, mode, static_cast<uint8_t>(brightness - 1) };
+        case UI_EVENT_MODE:
+            return { UI_CMD_BEEP | UI_CMD_SET_MODE, ui_next_mode(mode), brightness };
+        default:
+            return { 0, mode, brightness };
+    }
+}
+
+#define UI_TABLE_SIZE (UI_MODE_COUNT * UI_BRIGHTNESS_COUNT * UI_EVENT_COUNT)
+
+constexpr size_t ui_index(ui_mode_t mode, uint8_t brightness, ui_event_t event) {
+    return (static_cast<size_t>(mode) * UI_BRIGHTNESS_COUNT + (brightness - UI_BRIGHTNESS_MIN)) * UI_EVENT_COUNT + event;
+}
+
+struct ui_table_t {
+    ui_transition_t entries[UI_TABLE_SIZE];
+};
+
+constexpr ui_table_t ui_build_table() {
+    ui_table_t table = {};
+    for (uint8_t mode = 0; mode < UI_MODE_COUNT; mode++) {
+        for (uint8_t brightness = UI_BRIGHTNESS_MIN; brightness <= UI_BRIGHTNESS_MAX; brightness++) {
+            for (uint8_t event = 0; event < UI_EVENT_COUNT; event++) {
+                table.entries[ui_index(static_cast<ui_mode_t>(mode), brightness, static_cast<ui_event_t>(event))] =
+                    ui_rule(static_cast<ui_mode_t>(mode), brightness, static_cast<ui_event_t>(event));
+            }
+        }
+    }
+    return table;
+}
+
+inline constexpr ui_table_t ui_table = ui_build_table();
+
+// Properties every entry must have, a rule change that breaks one fails the build
+constexpr bool ui_table_valid() {
+    for (size_t i = 0; i < UI_TABLE_SIZE; i++) {
+        const ui_transition_t &t = ui_table.entries[i];
+        ui_mode_t mode = static_cast<ui_mode_t>(i / (UI_BRIGHTNESS_COUNT * UI_EVENT_COUNT));
+        // Brightness stays in the range the buttons step through
+        if (t.brightness < UI_BRIGHTNESS_MIN || t.brightness > UI_BRIGHTNESS_MAX) {
+            return false;
+        }
+        // Every press that does something beeps, every beep does something
+        if (((t.commands & UI_CMD_BEEP) != 0) != ((t.commands & ~UI_CMD_BEEP) != 0)) {
+            return false;
+        }
+        // One fan change per press, and never back to the mode it is in
+        if ((t.commands & UI_CMD_RESTORE) && (t.commands & UI_CMD_SET_MODE)) {
+            return false;
+        }
+        if ((t.commands & UI_CMD_SET_MODE) && t.mode == mode) {
+            return false;
+        }
+        // Restore only makes sense while off
+        if ((t.commands & UI_CMD_RESTORE) && mode != UI_MODE_OFF) {
+            return false;
+        }
+        // The mode field is only meaningful with SET_MODE
+        if (!(t.commands & UI_CMD_SET_MODE) && t.mode != mode) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(ui_table_valid(), "UI transition table violates an invariant");
+
+// Power always switches: off to on, and on to off once the panel is lit
+static_assert(ui_table.entries[ui_index(UI_MODE_OFF, UI_BRIGHTNESS_MAX, UI_EVENT_POWER)].commands & UI_CMD_RESTORE,
+              "Power turns the fan on");
+static_assert(ui_table.entries[ui_index(UI_MODE_HIGH, UI_BRIGHTNESS_MAX, UI_EVENT_POWER)].mode == UI_MODE_OFF,
+              "Power turns the fan off");
+// The mode button visits High, Low and Auto and comes back
+static_assert(ui_next_mode(ui_next_mode(ui_next_mode(UI_MODE_HIGH))) == UI_MODE_HIGH, "Mode cycle has three steps");
+
+// Unknown modes or events do nothing, brightness 0 counts as the lowest step
+inline ui_transition_t ui_fsm_step(ui_mode_t mode, uint8_t brightness, ui_event_t event) {
+    if (mode >= UI_MODE_COUNT || event >= UI_EVENT_COUNT) {
+        return { 0, mode, brightness };
+    }
+    if (brightness < UI_BRIGHTNESS_MIN) {
+        brightness = UI_BRIGHTNESS_MIN;
+    } else if (brightness > UI_BRIGHTNESS_MAX) {
+        brightness = UI_BRIGHTNESS_MAX;
+    }
+    return ui_table.entries[ui_index(mode, brightness, event)];
+}
@@ -0,0 +1,242 @@
+#include "wifi_fast.h"
+#include "app_console.h"
+#include "hw_conf.h"
+#include "trace.h"
+
+#include "freertos/FreeRTOS.h"
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <nvs.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define WIFI_FAST_NVS_NAMESPACE "wifi_fast"
+#define WIFI_FAST_NVS_KEY "ap"
+
+static const char *TAG = "wifi_fast";
+
+// Last AP the station associated with
+struct wifi_fast_ap_t {
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    // WIFI_PROTOCOL_* bitmap
+    uint8_t protocol;
+};
+
+static wifi_fast_ap_t cached_ap;
+static bool cached_valid;
+
+// A connection attempt is timed from station start or from losing the AP
+static int64_t attempt_start_us;
+static bool attempt_directed;
+static bool connected;
+
+static wifi_fast_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static void cache_load() {
+    nvs_handle_t handle;
+    size_t size = sizeof(cached_ap);
+
+    if (nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    cached_valid = nvs_get_blob(handle, WIFI_FAST_NVS_KEY, &cached_ap, &size) == ESP_OK
+        && size == sizeof(cached_ap);
+    nvs_close(handle);
+}
+
+static void cache_store(const wifi_fast_ap_t *ap) {
+    nvs_handle_t handle;
+
+    if (nvs_open(WIFI_FAST_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (ap != NULL) {
+        nvs_set_blob(handle, WIFI_FAST_NVS_KEY, ap, sizeof(*ap));
+    } else {
+        nvs_erase_key(handle, WIFI_FAST_NVS_KEY);
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+// Point the station config at the cached AP, or back to a plain SSID match
+static bool apply_directed(bool directed) {
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || config.sta.ssid[0] == '\0') {
+        return false;
+    }
+    // The device may have been commissioned to another network since
+    if (directed && (!cached_valid || memcmp(config.sta.ssid, cached_ap.ssid, sizeof(cached_ap.ssid)) != 0)) {
+        directed = false;
+    }
+    if (!directed && !config.sta.bssid_set && config.sta.channel == 0) {
+        return false;
+    }
+
+    if (directed) {
+        memcpy(config.sta.bssid, cached_ap.bssid, sizeof(cached_ap.bssid));
+        config.sta.bssid_set = true;
+        config.sta.channel = cached_ap.channel;
+        config.sta.scan_method = WIFI_FAST_SCAN;
+        esp_wifi_set_protocol(WIFI_IF_STA, cached_ap.protocol);
+    } else {
+        config.sta.bssid_set = false;
+        config.sta.channel = 0;
+        esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+    }
+    return esp_wifi_set_config(WIFI_IF_STA, &config) == ESP_OK && directed;
+}
+
+static void record_attempt(uint32_t elapsed_ms, bool directed) {
+    taskENTER_CRITICAL(&stats_lock);
+    if (directed) {
+        stats.fast_count++;
+        stats.fast_total_ms += elapsed_ms;
+        stats.fast_max_ms = elapsed_ms > stats.fast_max_ms ? elapsed_ms : stats.fast_max_ms;
+    } else {
+        stats.full_count++;
+        stats.full_total_ms += elapsed_ms;
+        stats.full_max_ms = elapsed_ms > stats.full_max_ms ? elapsed_ms : stats.full_max_ms;
+    }
+    stats.last_ms = elapsed_ms;
+    stats.last_fast = directed;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+static void on_connected() {
+    uint32_t elapsed_ms = (esp_timer_get_time() - attempt_start_us) / 1000;
+    connected = true;
+    record_attempt(elapsed_ms, attempt_directed);
+    TRACE(TRACE_WIFI_CONNECTED, elapsed_ms, attempt_directed);
+    ESP_LOGI(TAG, "Connected in %lu ms (%s)", (unsigned long)elapsed_ms, attempt_directed ? "directed" : "full scan");
+
+    wifi_config_t config;
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK || esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+
+    wifi_fast_ap_t ap = {};
+    memcpy(ap.ssid, config.sta.ssid, sizeof(ap.ssid));
+    memcpy(ap.bssid, ap_info.bssid, sizeof(ap.bssid));
+    ap.channel = ap_info.primary;
+    ap.protocol = (ap_info.phy_11b ? WIFI_PROTOCOL_11B : 0) | (ap_info.phy_11g ? WIFI_PROTOCOL_11G : 0)
+        | (ap_info.phy_11n ? WIFI_PROTOCOL_11N : 0);
+    if (ap.protocol == 0) {
+        ap.protocol = WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N;
+    }
+
+    // Only write flash when the AP changed
+    if (!cached_valid || memcmp(&ap, &cached_ap, sizeof(ap)) != 0) {
+        cached_ap = ap;
+        cached_valid = true;
+        cache_store(&cached_ap);
+        ESP_LOGI(TAG, "Cached AP " MACSTR " on channel %u", MAC2STR(ap.bssid), ap.channel);
+    }
+}
+
+static void on_disconnected(const wifi_event_sta_disconnected_t *event) {
+    if (connected) {
+        // Lost the AP, time the way back and try it directly first
+        connected = false;
+        attempt_start_us = esp_timer_get_time();
+        attempt_directed = apply_directed(true);
+        return;
+    }
+    if (attempt_directed) {
+        // The cached AP is gone or moved, let the next attempt scan everything
+        ESP_LOGW(TAG, "Directed connect failed (reason %u), falling back to a full scan", event->reason);
+        TRACE(TRACE_WIFI_FALLBACK, event->reason, 0);
+        attempt_directed = false;
+        apply_directed(false);
+        // Time the full scan on its own, the failed directed try would inflate its average
+        attempt_start_us = esp_timer_get_time();
+        taskENTER_CRITICAL(&stats_lock);
+        stats.fallbacks++;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+}
+
+static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+    switch (id) {
+        case WIFI_EVENT_STA_START:
+            connected = false;
+            attempt_start_us = esp_timer_get_time();
+            attempt_directed = apply_directed(true);
+            break;
+        case WIFI_EVENT_STA_CONNECTED:
+            on_connected();
+            break;
+        case WIFI_EVENT_STA_DISCONNECTED:
+            on_disconnected(static_cast<wifi_event_sta_disconnected_t *>(data));
+            break;
+        default:
+            break;
+    }
+}
+
+void wifi_fast_init() {
+#if WIFI_FAST_CONNECT
+    cache_load();
+
+    // The Matter stack creates the loop too and accepts that it already exists
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "No event loop: %s", esp_err_to_name(err));
+        return;
+    }
+    // Registered before the Matter stack, so the config is in place when it connects
+    esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL);
+#endif
+}
+
+void wifi_fast_get_stats(wifi_fast_stats_t *out) {
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+
+static esp_err_t wifi_reconnect_handler(int argc, char **argv) {
+    if (argc > 0 && strcmp(argv[0], "forget") == 0) {
+        cached_valid = false;
+        cache_store(NULL);
+        apply_directed(false);
+        printf("Cached AP removed\n");
+        return ESP_OK;
+    }
+
+    wifi_fast_stats_t s;
+    wifi_fast_get_stats(&s);
+    if (cached_valid) {
+        printf("cached AP: " MACSTR ", channel %u\n", MAC2STR(cached_ap.bssid), cached_ap.channel);
+    } else {
+        printf("cached AP: none\n");
+    }
+    printf("directed: %lu, avg %lu ms, max %lu ms\n", (unsigned long)s.fast_count,
+           (unsigned long)(s.fast_count ? s.fast_total_ms / s.fast_count : 0), (unsigned long)s.fast_max_ms);
+    printf("full scan: %lu, avg %lu ms, max %lu ms\n", (unsigned long)s.full_count,
+           (unsigned long)(s.full_count ? s.full_total_ms / s.full_count : 0), (unsigned long)s.full_max_ms);
+    printf("fallbacks: %lu, last: %lu ms (%s)\n", (unsigned long)s.fallbacks, (unsigned long)s.last_ms,
+           s.last_fast ? "directed" : "full scan");
+    return ESP_OK;
+}
+
+void wifi_fast_register_commands() {
+    static const esp_matter::console::command_t commands[] = {
+        {
+            .name = "wifi-reconnect",
+            .description = "Show Wi-Fi reconnect times, or drop the cached AP. Usage: wifi-reconnect [forget].",
+            .handler = wifi_reconnect_handler,
+        },
+    };
+    app_console_register(commands, sizeof(commands) / sizeof(commands[0]));
+}
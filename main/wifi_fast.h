@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Remembers the AP (BSSID, channel, PHY modes) of the last good
+// connection in NVS and points the station at it before the next connect,
+// so the stack does not scan every channel first. If the directed attempt
+// fails the plain configuration is restored and the stack falls back to a
+// full scan.
+
+// Register the event handlers, call before esp_matter::start()
+void wifi_fast_init();
+
+struct wifi_fast_stats_t {
+    uint32_t fast_count;
+    uint32_t fast_total_ms;
+    uint32_t fast_max_ms;
+    uint32_t full_count;
+    uint32_t full_total_ms;
+    uint32_t full_max_ms;
+    uint32_t fallbacks;
+    uint32_t last_ms;
+    bool last_fast;
+};
+
+void wifi_fast_get_stats(wifi_fast_stats_t *stats);
+
+void wifi_fast_register_commands();
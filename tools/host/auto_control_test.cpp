@@ -0,0 +1,72 @@
+// Predictive auto mode gap test
+//
+// Feeds the predictive controller a steady reading, a sensor outage of
+// unknown readings and a steady reading at a higher level, and checks that
+// the fan follows the plain staircase after the gap instead of a slope made
+// from readings on both sides of it. A steady rise is checked to still boost,
+// so the first check cannot pass with prediction broken. Exits 1 on a
+// failure. Registered with CTest, run "ctest" in the build directory.
+//
+// Usage: auto_control_test
+
+#include "auto_control.h"
+#include "hw_conf.h"
+
+#include <cstdint>
+#include <cstdio>
+
+// A power cycle backoff at its 15 min maximum
+#define GAP_S (15 * 60)
+
+static bool check_gap(void) {
+    auto_control_t control;
+    auto_control_init(&control, AUTO_STRATEGY_PREDICTIVE);
+
+    for (int i = 0; i < AUTO_TREND_WINDOW_S; i++) {
+        auto_control_update(&control, pm25_to_aq_level(20), 20);
+    }
+    for (int i = 0; i < GAP_S; i++) {
+        auto_control_update(&control, AQ_UNKNOWN, 0);
+    }
+
+    bool ok = true;
+    const uint16_t pm25 = 100;
+    const uint8_t expected = aq_level_to_percentage(pm25_to_aq_level(pm25));
+    for (int i = 0; i < 2 * AUTO_TREND_WINDOW_S; i++) {
+        uint8_t percentage = auto_control_update(&control, pm25_to_aq_level(pm25), pm25);
+        if (percentage != expected) {
+            fprintf(stderr, "gap: %d s after the outage: got %u%%, expected %u%%\n", i, percentage, expected);
+            ok = false;
+            break;
+        }
+    }
+    printf("gap    %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool check_rise(void) {
+    auto_control_t control;
+    auto_control_init(&control, AUTO_STRATEGY_PREDICTIVE);
+
+    // 1 ug/m3 per second, well outside the deadband
+    uint16_t pm25 = 40;
+    uint8_t percentage = 0;
+    for (int i = 0; i < AUTO_TREND_WINDOW_S; i++, pm25++) {
+        percentage = auto_control_update(&control, pm25_to_aq_level(pm25), pm25);
+    }
+    pm25--;
+
+    const uint8_t staircase = aq_level_to_percentage(pm25_to_aq_level(pm25));
+    bool ok = percentage > staircase;
+    if (!ok) {
+        fprintf(stderr, "rise: got %u%% at %u ug/m3, expected more than %u%%\n", percentage, pm25, staircase);
+    }
+    printf("rise   %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(void) {
+    bool ok = check_gap();
+    ok &= check_rise();
+    return ok ? 0 : 1;
+}
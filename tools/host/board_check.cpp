@@ -0,0 +1,60 @@
+// Board descriptor check
+//
+// Builds every board descriptor in main/board.h, so a pin or peripheral
+// mistake on any target fails at compile time, not only on the target that
+// happens to be built. Prints the pin map of each board for wiring checks.
+//
+// Usage: board_check
+
+#include "board.h"
+
+#include <cstdio>
+
+// One assert per board so the error names it. To see which rule fails,
+// disable the assert and run board_check.
+static_assert(board_check(board_esp32) == nullptr, "purifier-esp32 does not fit the ESP32");
+static_assert(board_check(board_esp32s3) == nullptr, "devkit-esp32s3 does not fit the ESP32-S3");
+static_assert(board_check(board_esp32c6) == nullptr, "devkit-esp32c6 does not fit the ESP32-C6");
+static_assert(sizeof(board_all) / sizeof(board_all[0]) == 3, "Add an assert for the new board above");
+
+static void print_pin(const char *name, int8_t pin) {
+    if (pin == BOARD_NC) {
+        printf("  %-16s -\n", name);
+    } else {
+        printf("  %-16s GPIO%d\n", name, pin);
+    }
+}
+
+int main() {
+    int failed = 0;
+    for (const board_t *b : board_all) {
+        const char *err = board_check(*b);
+        printf("%s (%s): %s\n", b->name, board_socs[b->target].name, err == nullptr ? "ok" : err);
+        failed += err != nullptr;
+
+        print_pin("led_green", b->led_green);
+        print_pin("led_orange", b->led_orange);
+        print_pin("led_red", b->led_red);
+        print_pin("buzzer", b->buzzer);
+        print_pin("btn_power", b->btn_power);
+        print_pin("btn_brightness", b->btn_brightness);
+        print_pin("btn_mode", b->btn_mode);
+        print_pin("led_sda", b->led_sda);
+        print_pin("led_scl", b->led_scl);
+        print_pin("eeprom_sda", b->eeprom_sda);
+        print_pin("eeprom_scl", b->eeprom_scl);
+        print_pin("motor_pwm", b->motor_pwm);
+        print_pin("motor_brk", b->motor_brk);
+        print_pin("motor_fg", b->motor_fg);
+        print_pin("motor_5v", b->motor_5v);
+        print_pin("pms_rx", b->pms_rx);
+        print_pin("pms_tx", b->pms_tx);
+        print_pin("pms_5v", b->pms_5v);
+        printf("  ledc %s speed, timers motor %u rgb %u buzzer %u, channels motor %u rgb %u/%u/%u buzzer %u\n",
+               b->ledc_high_speed ? "high" : "low", b->ledc_timer_motor, b->ledc_timer_rgb, b->ledc_timer_buzzer,
+               b->ledc_channel_motor, b->ledc_channel_green, b->ledc_channel_orange, b->ledc_channel_red,
+               b->ledc_channel_buzzer);
+        printf("  uart%u for the sensor, i2c%u for the LED controller\n", b->uart_pms, b->i2c_led);
+    }
+    return failed ? 1 : 0;
+}
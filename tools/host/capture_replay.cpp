@@ -0,0 +1,370 @@
+// Sensor and button capture replay
+//
+// Feeds a "purifier capture dump" (see main/capture.h) through the firmware
+// logic again: every recorded UART read goes through pms_frame, pm_filter and
+// the auto controller as in pms_task and auto_controller_task, and short
+// presses through the front panel state machine and the driver steps. The
+// run is deterministic and as fast as the CPU allows, or paced at --speed
+// times the recorded timing. The input can be a whole serial log, lines other
+// than the dump are skipped and the last dump in it is used.
+//
+// Prints how the fan behaved: frames by result, the longest sensor dropout,
+// speed changes and reversals (speed going up after going down or the other
+// way). With --max-reversals or --max-dropout it exits 1 when the replay
+// exceeds them, so a field capture turns into a regression check that
+// "git bisect run" can drive.
+//
+// Usage: capture_replay [--mode name] [--strategy staircase|predictive] [--board name] [--speed x]
+//                       [--csv file] [--max-reversals N] [--max-dropout s] [--verbose] capture.log
+
+#include "auto_control.h"
+#include "board.h"
+#include "capture_ring.h"
+#include "device_model.h"
+#include "hw_conf.h"
+#include "pm_filter.h"
+#include "pms_frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+struct replay_config_t {
+    ui_mode_t mode = UI_MODE_AUTO;
+    uint8_t strategy = AUTO_STRATEGY;
+    const board_t *board = &BOARD;
+    // Recorded seconds per real second, 0 runs unpaced
+    double speed = 0;
+    const char *csv = nullptr;
+    // Negative disables the limit
+    long max_reversals = -1;
+    double max_dropout_s = -1;
+    bool verbose = false;
+};
+
+struct replay_stats_t {
+    uint32_t frames[PMS_FRAME_CHECKSUM + 1];
+    uint32_t presses;
+    uint32_t long_presses;
+    uint32_t speed_changes;
+    uint32_t reversals;
+    uint32_t longest_dropout_ms;
+    uint32_t duration_ms;
+};
+
+// The last dump in the log: decoder start state and record bytes
+struct capture_t {
+    capture_state_t first;
+    std::vector<uint8_t> records;
+};
+
+static const char *frame_results[] = { "ok", "timeout", "bad", "checksum" };
+static_assert(sizeof(frame_results) / sizeof(frame_results[0]) == PMS_FRAME_CHECKSUM + 1, "One name per result");
+
+
+static bool parse_hex(const char *hex, std::vector<uint8_t> *out) {
+    size_t len = strlen(hex);
+    if (len % 2 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i += 2) {
+        char byte[3] = { hex[i], hex[i + 1], '\0' };
+        char *end;
+        unsigned long value = strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+        out->push_back(static_cast<uint8_t>(value));
+    }
+    return true;
+}
+
+static bool read_capture(const char *path, capture_t *capture) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    bool found = false;
+    bool ok = true;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "H ", 2) == 0) {
+            // A new dump, drop the previous one
+            char *end;
+            capture->first = {};
+            capture->records.clear();
+            capture->first.time_ms = strtoul(line + 2, &end, 10);
+            capture->first.len = static_cast<uint16_t>(strtoul(end, &end, 10));
+            std::vector<uint8_t> frame;
+            while (*end == ' ') {
+                end++;
+            }
+            ok = parse_hex(end, &frame) && frame.size() <= CAPTURE_UART_MAX;
+            if (ok) {
+                memcpy(capture->first.frame, frame.data(), frame.size());
+            }
+            found = true;
+        } else if (strncmp(line, "C ", 2) == 0 && found && ok) {
+            ok = parse_hex(line + 2, &capture->records);
+        }
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    if (!found || !ok) {
+        fprintf(stderr, "%s: %s\n", path, found ? "malformed capture dump" : "no capture dump (H line) found");
+        return false;
+    }
+    return true;
+}
+
+// Same mapping as app_driver_buttons_callback()
+static bool button_event(const board_t *board, uint8_t pin, ui_event_t *event) {
+    if (pin == board->btn_power) {
+        *event = UI_EVENT_POWER;
+    } else if (pin == board->btn_brightness) {
+        *event = UI_EVENT_BRIGHTNESS;
+    } else if (pin == board->btn_mode) {
+        *event = UI_EVENT_MODE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool replay(const replay_config_t &config, const capture_t &capture, replay_stats_t *stats) {
+    FILE *csv = nullptr;
+    if (config.csv != nullptr) {
+        csv = fopen(config.csv, "w");
+        if (csv == nullptr) {
+            perror(config.csv);
+            return false;
+        }
+        fprintf(csv, "time_ms,result,pm25_raw,pm25,air_quality,fan_mode,percent_current\n");
+    }
+
+    pm_filter_t filter;
+    const pm_filter_config_t filter_config = {
+        .outlier = PM_FILTER_OUTLIER,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = PM_FILTER_EMA_ALPHA_Q8,
+    };
+    pm_filter_init(&filter, &filter_config);
+    auto_control_t control;
+    auto_control_init(&control, config.strategy);
+    device_t device;
+    device_init(&device);
+    device_write_fan_mode(&device, config.mode);
+
+    capture_state_t state = capture.first;
+    const uint32_t start_ms = state.time_ms;
+    auto start = std::chrono::steady_clock::now();
+    uint16_t pm25 = 0;
+    uint8_t percentage = device.attrs.percent_current;
+    int direction = 0;
+    uint32_t last_ok_ms = start_ms;
+    bool in_dropout = false;
+
+    size_t pos = 0;
+    while (pos < capture.records.size()) {
+        capture_record_t record;
+        size_t n = capture_decode(&state, &capture.records[pos], capture.records.size() - pos, &record);
+        if (n == 0) {
+            fprintf(stderr, "Undecodable record at byte %zu, stopping there\n", pos);
+            break;
+        }
+        pos += n;
+        uint32_t time_ms = record.time_ms - start_ms;
+        stats->duration_ms = time_ms;
+        if (config.speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration<double, std::milli>(time_ms / config.speed));
+        }
+
+        if (record.type == CAPTURE_TYPE_BUTTON) {
+            ui_event_t event;
+            bool released = record.flags & CAPTURE_FLAG_RELEASED;
+            bool long_press = record.flags & CAPTURE_FLAG_LONG;
+            if (config.verbose) {
+                printf("%10.3f button pin=%u%s\n", time_ms / 1000.0, record.pin,
+                       released ? " released" : long_press ? " long" : "");
+            }
+            // Long presses start factory reset or motor calibration, nothing to replay
+            if (long_press) {
+                stats->long_presses++;
+            } else if (!released && button_event(config.board, record.pin, &event)) {
+                stats->presses++;
+                device_press(&device, event);
+            }
+        } else {
+            // pms_task, then auto_controller_task
+            pms_frame_result_t result = pms_frame_check(record.data, record.len);
+            stats->frames[result]++;
+            uint16_t pm25_raw = 0;
+            uint8_t air_quality = AQ_UNKNOWN;
+            if (result == PMS_FRAME_OK) {
+                pm25_raw = pms_frame_pm25(record.data);
+                pm25 = pm_filter_update(&filter, pm25_raw);
+                air_quality = pm25_to_aq_level(pm25);
+                if (in_dropout && config.verbose) {
+                    printf("%10.3f sensor back after %.1f s\n", time_ms / 1000.0, (record.time_ms - last_ok_ms) / 1000.0);
+                }
+                last_ok_ms = record.time_ms;
+                in_dropout = false;
+            } else {
+                in_dropout = true;
+                stats->longest_dropout_ms = std::max(stats->longest_dropout_ms, record.time_ms - last_ok_ms);
+            }
+            device.attrs.air_quality = air_quality;
+            if (air_quality != AQ_UNKNOWN) {
+                device.attrs.pm25 = pm25;
+            }
+            device_auto_update(&device, auto_control_update(&control, air_quality, pm25));
+            if (csv != nullptr) {
+                fprintf(csv, "%lu,%s,%u,%u,%u,%s,%u\n", (unsigned long)time_ms, frame_results[result], pm25_raw,
+                        pm25, air_quality, device_mode_names[device.attrs.fan_mode], device.attrs.percent_current);
+            }
+        }
+
+        if (device.attrs.percent_current != percentage) {
+            int new_direction = device.attrs.percent_current > percentage ? 1 : -1;
+            stats->speed_changes++;
+            if (direction != 0 && new_direction != direction) {
+                stats->reversals++;
+            }
+            if (config.verbose) {
+                printf("%10.3f fan %u%% -> %u%% (%s, pm25 %u)%s\n", time_ms / 1000.0, percentage,
+                       device.attrs.percent_current, device_mode_names[device.attrs.fan_mode], pm25,
+                       direction != 0 && new_direction != direction ? " reversal" : "");
+            }
+            direction = new_direction;
+            percentage = device.attrs.percent_current;
+        }
+    }
+
+    if (csv != nullptr) {
+        fclose(csv);
+    }
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [--mode name] [--strategy staircase|predictive] [--board name] [--speed x]\n"
+            "          [--csv file] [--max-reversals N] [--max-dropout s] [--verbose] capture.log\n", name);
+}
+
+int main(int argc, char **argv) {
+    replay_config_t config;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--verbose") == 0) {
+            config.verbose = true;
+            continue;
+        }
+        if (strncmp(arg, "--", 2) != 0) {
+            path = arg;
+            continue;
+        }
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (strcmp(arg, "--mode") == 0) {
+            int mode = -1;
+            for (int m = 0; m < UI_MODE_COUNT; m++) {
+                if (strcmp(value, device_mode_names[m]) == 0) {
+                    mode = m;
+                }
+            }
+            if (mode < 0) {
+                fprintf(stderr, "Unknown fan mode %s\n", value);
+                return 2;
+            }
+            config.mode = static_cast<ui_mode_t>(mode);
+        } else if (strcmp(arg, "--strategy") == 0) {
+            if (strcmp(value, "staircase") == 0) {
+                config.strategy = AUTO_STRATEGY_STAIRCASE;
+            } else if (strcmp(value, "predictive") == 0) {
+                config.strategy = AUTO_STRATEGY_PREDICTIVE;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(arg, "--board") == 0) {
+            config.board = nullptr;
+            for (const board_t *board : board_all) {
+                if (strcmp(value, board->name) == 0) {
+                    config.board = board;
+                }
+            }
+            if (config.board == nullptr) {
+                fprintf(stderr, "Unknown board %s\n", value);
+                return 2;
+            }
+        } else if (strcmp(arg, "--speed") == 0) {
+            config.speed = atof(value);
+        } else if (strcmp(arg, "--csv") == 0) {
+            config.csv = value;
+        } else if (strcmp(arg, "--max-reversals") == 0) {
+            config.max_reversals = atol(value);
+        } else if (strcmp(arg, "--max-dropout") == 0) {
+            config.max_dropout_s = atof(value);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (path == nullptr || config.speed < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    capture_t capture;
+    if (!read_capture(path, &capture)) {
+        return 2;
+    }
+    replay_stats_t stats = {};
+    auto start = std::chrono::steady_clock::now();
+    if (!replay(config, capture, &stats)) {
+        return 2;
+    }
+    double real_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t frames = 0;
+    for (uint32_t count : stats.frames) {
+        frames += count;
+    }
+    printf("replayed %.1f s of capture in %.3f s, %s, %s mode, %s\n", stats.duration_ms / 1000.0, real_s,
+           config.board->name, device_mode_names[config.mode],
+           config.strategy == AUTO_STRATEGY_PREDICTIVE ? "predictive" : "staircase");
+    printf("frames %lu:", (unsigned long)frames);
+    for (size_t i = 0; i < sizeof(stats.frames) / sizeof(stats.frames[0]); i++) {
+        printf(" %s %lu", frame_results[i], (unsigned long)stats.frames[i]);
+    }
+    printf("\nlongest dropout %.1f s\n", stats.longest_dropout_ms / 1000.0);
+    printf("presses %lu, long presses %lu\n", (unsigned long)stats.presses, (unsigned long)stats.long_presses);
+    printf("speed changes %lu, reversals %lu\n", (unsigned long)stats.speed_changes, (unsigned long)stats.reversals);
+
+    bool failed = false;
+    if (config.max_reversals >= 0 && stats.reversals > static_cast<unsigned long>(config.max_reversals)) {
+        printf("FAIL: %lu reversals, limit %ld\n", (unsigned long)stats.reversals, config.max_reversals);
+        failed = true;
+    }
+    if (config.max_dropout_s >= 0 && stats.longest_dropout_ms > config.max_dropout_s * 1000) {
+        printf("FAIL: %.1f s dropout, limit %.1f s\n", stats.longest_dropout_ms / 1000.0, config.max_dropout_s);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+#include "device_model.h"
+
+const char *const device_mode_names[UI_MODE_COUNT] = { "off", "low", "medium", "high", "on", "auto", "smart" };
+
+
+// Hardware and Matter DB side, app_driver_apply_fan() and app_driver_show_mode()
+static void device_apply_fan(device_t *device, const driver_fan_t &fan) {
+    device->fan_percentage = fan.percentage;
+    device->attrs.led_level = fan.mode == UI_MODE_OFF ? 0 : device->state.brightness;
+    if (fan.report_mode) {
+        device->attrs.fan_mode = fan.mode;
+    }
+    device->attrs.percent_current = fan.percentage;
+}
+
+void device_init(device_t *device) {
+    *device = {};
+    driver_state_init(&device->state);
+    device_apply_fan(device, driver_state_set_percentage(&device->state, 0));
+}
+
+void device_write_fan_mode(device_t *device, ui_mode_t mode) {
+    device->attrs.fan_mode = mode;
+    device_apply_fan(device, driver_state_set_mode(&device->state, mode));
+}
+
+void device_write_percent(device_t *device, uint8_t percentage) {
+    device->attrs.percent_setting = percentage;
+    device_apply_fan(device, driver_state_set_percentage(&device->state, percentage));
+}
+
+void device_press(device_t *device, ui_event_t event) {
+    ui_transition_t t = ui_fsm_step(device->attrs.fan_mode, device->state.brightness, event);
+    if (t.commands & UI_CMD_BEEP) {
+        device->beeps++;
+    }
+    if (t.commands & UI_CMD_SET_BRIGHTNESS) {
+        device->state.brightness = t.brightness;
+        device->attrs.led_level = device->state.brightness;
+    }
+    if (t.commands & UI_CMD_RESTORE) {
+        if (device->state.prev_percentage == 0) {
+            device_write_fan_mode(device, device->state.prev_mode);
+        } else {
+            device_write_percent(device, device->state.prev_percentage);
+        }
+    }
+    if (t.commands & UI_CMD_SET_MODE) {
+        device_write_fan_mode(device, t.mode);
+    }
+}
+
+void device_auto_update(device_t *device, uint8_t percentage) {
+    if (driver_state_auto_update(&device->state, percentage)) {
+        device->fan_percentage = percentage;
+        device->attrs.percent_current = percentage;
+    }
+}
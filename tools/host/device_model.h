@@ -0,0 +1,50 @@
+#pragma once
+
+#include "driver_state.h"
+#include "ui_fsm.h"
+
+#include <cstdint>
+
+// Device side of the host simulators: the Matter attributes the firmware
+// keeps, changed by the firmware's own driver_state.h steps on attribute
+// writes, button presses and auto controller updates, with the hardware and
+// Matter DB side of app_driver.cpp applied to the attributes. Not thread safe,
+// device_sim holds its device mutex around every call.
+
+// What the firmware keeps in the Matter data model
+struct device_attributes_t {
+    ui_mode_t fan_mode;
+    uint8_t percent_setting;
+    uint8_t percent_current;
+    uint8_t air_quality;
+    uint16_t pm25;
+    // led_set_brightness() level, 0 while the fan is off
+    uint8_t led_level;
+    uint32_t power_mw;
+    uint64_t energy_mwh;
+};
+
+// Attributes plus the driver state of app_driver.cpp
+struct device_t {
+    device_attributes_t attrs;
+    driver_state_t state;
+    // What fan_set_percentage() last got
+    uint8_t fan_percentage;
+    uint32_t beeps;
+};
+
+extern const char *const device_mode_names[UI_MODE_COUNT];
+
+// Boot like app_driver_set_defaults() with the default attribute values
+void device_init(device_t *device);
+
+// The attr_update_* write path: store, then the driver callback
+void device_write_fan_mode(device_t *device, ui_mode_t mode);
+
+void device_write_percent(device_t *device, uint8_t percentage);
+
+// Short press on the front panel
+void device_press(device_t *device, ui_event_t event);
+
+// New auto_control_update() result, the fan follows it in auto mode
+void device_auto_update(device_t *device, uint8_t percentage);
@@ -0,0 +1,818 @@
+// Purifier device simulation
+//
+// Runs the firmware's device logic on the host: sensor frames through
+// pms_frame and pm_filter, the auto controller, the front panel state
+// machine, fan mode handling and the power model. The sensor and controller
+// loops are threads like the firmware tasks and drive the simulated room from
+// room_sim, or replay a recorded sensor trace, in real time or faster.
+// Clients on a loopback TCP port read and write attributes, press buttons and
+// subscribe with Matter style min/max intervals, served by a report thread
+// standing in for the CHIP thread. Control behaviour and reporting load can be
+// exercised end to end (tools/sub_bench.py) and the CPU paths profiled with
+// perf without hardware. This is not the Matter stack: there is no
+// commissioning and the protocol is plain text lines, "help" lists the
+// commands. --metrics-port serves the firmware's OpenMetrics text over HTTP
+// (GET /metrics) for testing Prometheus scrapes.
+//
+// Usage: device_sim [--port N] [--speed x] [--frame-errors permille] [--seed N] [--trace file]
+//                   [--start-hour h] [--volume m3] [--ach 1/h] [--outdoor ug/m3] [--cadr m3/h]
+//                   [--metrics-port N]
+
+#include "auto_control.h"
+#include "device_model.h"
+#include "hw_conf.h"
+#include "metrics.h"
+#include "pm_filter.h"
+#include "pms_frame.h"
+#include "power_model.h"
+#include "report_policy.h"
+#include "room_model.h"
+#include "ui_fsm.h"
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DEFAULT_PORT 5541
+// Subscription intervals when "subscribe" is given none, seconds
+#define DEFAULT_MIN_INTERVAL 0
+#define DEFAULT_MAX_INTERVAL 60
+// Motor speed at 100 %, the calibrated fan table is linear in RPM
+#define FAN_RPM_MAX 1800
+
+using sim_clock = std::chrono::steady_clock;
+
+struct sim_config_t {
+    room_config_t room;
+    uint16_t port = DEFAULT_PORT;
+    // OpenMetrics over HTTP, 0 disables
+    uint16_t metrics_port = 0;
+    // Simulated seconds per real second
+    double speed = 1;
+    // Frames corrupted on the wire, per 1000
+    uint32_t frame_errors = 5;
+    uint32_t start_s = 0;
+    // PM2.5 per simulated second replacing the room's sensor, repeated
+    std::vector<uint16_t> trace;
+};
+
+enum attr_id_t {
+    ATTR_FAN_MODE,
+    ATTR_PERCENT_SETTING,
+    ATTR_PERCENT_CURRENT,
+    ATTR_AIR_QUALITY,
+    ATTR_PM25,
+    ATTR_LED_LEVEL,
+    ATTR_POWER_MW,
+    ATTR_ENERGY_MWH,
+    ATTR_COUNT,
+};
+
+#define ATTR_ALL ((1u << ATTR_COUNT) - 1)
+
+static const char *attr_names[] = {
+    "fan-mode", "percent-setting", "percent-current", "air-quality", "pm25", "led-level", "power-mw", "energy-mwh",
+};
+static_assert(sizeof(attr_names) / sizeof(attr_names[0]) == ATTR_COUNT, "One name per attribute");
+
+// One subscriber connection, reports follow the Matter rules: changes are
+// held until min_interval has passed since the last report, and an empty
+// report goes out after max_interval without changes
+struct subscription_t {
+    int fd;
+    uint32_t id;
+    sim_clock::duration min_interval;
+    sim_clock::duration max_interval;
+    // ATTR_* bits changed since the last report
+    uint32_t dirty;
+    // Oldest unreported change, sent along so clients can measure latency
+    sim_clock::time_point changed;
+    sim_clock::time_point last_report;
+    uint32_t seq;
+};
+
+struct sim_stats_t {
+    // Sensor thread, under queue_mutex, by pms_frame_result_t
+    uint32_t frames[PMS_FRAME_CHECKSUM + 1];
+    uint32_t queue_drops;
+    // Sampled once per sensor reading and on subscribe, also under queue_mutex
+    size_t heap_high_water;
+    size_t heap_free_low_water;
+    // Under device_mutex, changed values report_changes() passed on or held back
+    uint32_t reports_sent;
+    uint32_t reports_suppressed;
+    uint64_t latency_total_us;
+    uint32_t latency_max_us;
+    uint32_t latency_count;
+    // Report thread, under subscribers_mutex
+    uint32_t reports;
+    uint32_t empty_reports;
+    uint32_t attribute_reports;
+    uint32_t subscriptions_dropped;
+    uint64_t report_cpu_ns;
+};
+
+// One reading from the sensor thread, aq_queue_item_t in the firmware
+struct reading_t {
+    uint16_t pm25_raw;
+    uint16_t pm25;
+    uint8_t air_quality;
+    uint32_t time_s;
+    sim_clock::time_point queued;
+};
+
+static sim_config_t config;
+static sim_stats_t stats;
+
+// Guards the attributes and the driver state, state_mutex in the firmware
+static std::mutex device_mutex;
+static device_t device;
+// Latest reading the controller took, for the metrics
+static reading_t last_reading;
+static bool has_reading;
+// Values last handed to the report thread, power and energy only move past their report thresholds
+static device_attributes_t published;
+static report_policy_t energy_reported;
+static uint32_t sim_time_s;
+static double concentration;
+
+static std::mutex queue_mutex;
+static std::condition_variable queue_cv;
+static reading_t queue_item;
+static bool queue_full;
+
+// Lock order: device_mutex, then subscribers_mutex
+static std::mutex subscribers_mutex;
+static std::condition_variable report_cv;
+static std::vector<subscription_t> subscriptions;
+// Copy of published for the report thread
+static device_attributes_t report_values;
+static uint32_t next_subscription_id = 1;
+
+static uint64_t attr_value(const device_attributes_t &a, uint8_t id) {
+    switch (id) {
+        case ATTR_FAN_MODE:
+            return a.fan_mode;
+        case ATTR_PERCENT_SETTING:
+            return a.percent_setting;
+        case ATTR_PERCENT_CURRENT:
+            return a.percent_current;
+        case ATTR_AIR_QUALITY:
+            return a.air_quality;
+        case ATTR_PM25:
+            return a.pm25;
+        case ATTR_LED_LEVEL:
+            return a.led_level;
+        case ATTR_POWER_MW:
+            return a.power_mw;
+        case ATTR_ENERGY_MWH:
+            return a.energy_mwh;
+        default:
+            return 0;
+    }
+}
+
+static uint64_t to_us(sim_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+static bool send_line(int fd, const std::string &line) {
+    std::string out = line + "\n";
+    return send(fd, out.data(), out.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(out.size());
+}
+
+// Called with queue_mutex held
+static void sample_heap() {
+    struct mallinfo2 info = mallinfo2();
+    stats.heap_high_water = std::max(stats.heap_high_water, info.uordblks);
+    if (stats.heap_free_low_water == 0 || info.fordblks < stats.heap_free_low_water) {
+        stats.heap_free_low_water = info.fordblks;
+    }
+}
+
+// Hand what changed to the report thread, power and energy by the energy
+// module's report policy. Called with device_mutex held.
+static void report_changes() {
+    uint32_t changed = 0;
+    for (uint8_t id = 0; id < ATTR_COUNT; id++) {
+        if (id != ATTR_POWER_MW && id != ATTR_ENERGY_MWH
+                && attr_value(device.attrs, id) != attr_value(published, id)) {
+            changed |= 1u << id;
+        }
+    }
+    if (report_policy_power_due(&energy_reported, device.attrs.power_mw)) {
+        changed |= 1u << ATTR_POWER_MW;
+        report_policy_power_sent(&energy_reported, device.attrs.power_mw);
+    } else if (device.attrs.power_mw != energy_reported.power_mw) {
+        stats.reports_suppressed++;
+    }
+    if (report_policy_energy_due(&energy_reported, device.attrs.energy_mwh)) {
+        changed |= 1u << ATTR_ENERGY_MWH;
+        report_policy_energy_sent(&energy_reported, device.attrs.energy_mwh);
+    } else if (device.attrs.energy_mwh != energy_reported.energy_mwh) {
+        stats.reports_suppressed++;
+    }
+    stats.reports_sent += __builtin_popcount(changed);
+    if (changed == 0) {
+        return;
+    }
+
+    published = device.attrs;
+    published.power_mw = energy_reported.power_mw;
+    published.energy_mwh = energy_reported.energy_mwh;
+
+    sim_clock::time_point now = sim_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        report_values = published;
+        for (subscription_t &sub : subscriptions) {
+            if (sub.dirty == 0) {
+                sub.changed = now;
+            }
+            sub.dirty |= changed;
+        }
+    }
+    report_cv.notify_one();
+}
+
+// Reporting engine, the CHIP thread's part of the device. Sends every report
+// that is due and sleeps until the next one can be.
+static void report_thread() {
+    std::unique_lock<std::mutex> lock(subscribers_mutex);
+    while (true) {
+        sim_clock::time_point now = sim_clock::now();
+        sim_clock::time_point wake = now + std::chrono::seconds(DEFAULT_MAX_INTERVAL);
+        for (auto it = subscriptions.begin(); it != subscriptions.end();) {
+            subscription_t &sub = *it;
+            sim_clock::time_point due = sub.dirty ? sub.last_report + sub.min_interval
+                                                  : sub.last_report + sub.max_interval;
+            if (due > now) {
+                wake = std::min(wake, due);
+                ++it;
+                continue;
+            }
+
+            char line[512];
+            ssize_t len = snprintf(line, sizeof(line), "report %lu %lu %llu", (unsigned long)sub.id,
+                               (unsigned long)++sub.seq, (unsigned long long)(sub.dirty ? to_us(sub.changed) : 0));
+            for (uint8_t id = 0; id < ATTR_COUNT; id++) {
+                if (sub.dirty & (1u << id)) {
+                    len += snprintf(line + len, sizeof(line) - len, " %s=%llu", attr_names[id],
+                                    (unsigned long long)attr_value(report_values, id));
+                    stats.attribute_reports++;
+                }
+            }
+            stats.reports++;
+            if (sub.dirty == 0) {
+                stats.empty_reports++;
+            }
+            // A peer that stops reading loses its subscription instead of stalling everyone else
+            line[len++] = '\n';
+            if (send(sub.fd, line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len) {
+                stats.subscriptions_dropped++;
+                it = subscriptions.erase(it);
+                continue;
+            }
+            sub.dirty = 0;
+            sub.last_report = now;
+            wake = std::min(wake, now + sub.max_interval);
+            ++it;
+        }
+
+        timespec cpu;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        stats.report_cpu_ns = cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+        report_cv.wait_until(lock, wake);
+    }
+}
+
+
+// pms_task: one request/response per simulated second
+static void sensor_thread() {
+    rng_t rng = { config.room.seed };
+    pm_filter_t filter;
+    const pm_filter_config_t filter_config = {
+        .outlier = PM_FILTER_OUTLIER,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = PM_FILTER_EMA_ALPHA_Q8,
+    };
+    pm_filter_init(&filter, &filter_config);
+
+    auto period = std::chrono::duration_cast<sim_clock::duration>(std::chrono::duration<double>(1.0 / config.speed));
+    auto next = sim_clock::now();
+    uint16_t pm25_raw = 0;
+    uint16_t pm25 = 0;
+    size_t trace_pos = 0;
+
+    while (true) {
+        uint8_t fan_percentage;
+        uint32_t time_s;
+        {
+            std::lock_guard<std::mutex> lock(device_mutex);
+            fan_percentage = device.fan_percentage;
+            time_s = ++sim_time_s;
+        }
+        concentration = room_step(&config.room, concentration, time_s, fan_percentage, 1);
+
+        uint8_t frame[PMS_FRAME_SIZE];
+        if (config.trace.empty()) {
+            pms_frame_build(room_sensor_read(&rng, concentration), frame);
+        } else {
+            pms_frame_build(config.trace[trace_pos], frame);
+            trace_pos = (trace_pos + 1) % config.trace.size();
+        }
+        if (rng_next(&rng) % 1000 < config.frame_errors) {
+            frame[rng_next(&rng) % PMS_FRAME_SIZE] ^= 1 << (rng_next(&rng) % 8);
+        }
+
+        reading_t reading = {};
+        pms_frame_result_t result = pms_frame_check(frame, sizeof(frame));
+        if (result == PMS_FRAME_OK) {
+            pm25_raw = pms_frame_pm25(frame);
+            pm25 = pm_filter_update(&filter, pm25_raw);
+            reading.air_quality = pm25_to_aq_level(pm25);
+        } else {
+            reading.air_quality = AQ_UNKNOWN;
+        }
+        reading.pm25_raw = pm25_raw;
+        reading.pm25 = pm25;
+        reading.time_s = time_s;
+        reading.queued = sim_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stats.frames[result]++;
+            if (queue_full) {
+                stats.queue_drops++;
+            }
+            sample_heap();
+            queue_item = reading;
+            queue_full = true;
+        }
+        queue_cv.notify_one();
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// auto_controller_task
+static void controller_thread() {
+    auto_control_t control;
+    auto_control_init(&control, AUTO_STRATEGY);
+    const power_model_t model = {
+        .base_mw = POWER_MODEL_BASE_MW,
+        .fan_min_mw = POWER_MODEL_FAN_MIN_MW,
+        .fan_max_mw = POWER_MODEL_FAN_MAX_MW,
+        .led_mw = POWER_MODEL_LED_MW,
+    };
+    uint64_t energy_uj = 0;
+
+    while (true) {
+        reading_t reading;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [] { return queue_full; });
+            reading = queue_item;
+            queue_full = false;
+        }
+        uint32_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            sim_clock::now() - reading.queued).count();
+
+        std::lock_guard<std::mutex> lock(device_mutex);
+        stats.latency_total_us += latency_us;
+        stats.latency_count++;
+        stats.latency_max_us = std::max(stats.latency_max_us, latency_us);
+
+        last_reading = reading;
+        has_reading = true;
+        device.attrs.air_quality = reading.air_quality;
+        if (reading.air_quality != AQ_UNKNOWN) {
+            device.attrs.pm25 = reading.pm25;
+        }
+
+        // One simulated second at the operating point of the last second
+        device.attrs.power_mw = power_model_estimate(&model, device.fan_percentage, device.attrs.led_level);
+        energy_uj += device.attrs.power_mw * 1000ULL;
+        device.attrs.energy_mwh = energy_uj / 3600000;
+
+        device_auto_update(&device, auto_control_update(&control, reading.air_quality, reading.pm25));
+        report_changes();
+    }
+}
+
+
+static bool parse_mode(const char *arg, ui_mode_t *mode) {
+    for (uint8_t i = 0; i < UI_MODE_COUNT; i++) {
+        if (strcmp(arg, device_mode_names[i]) == 0) {
+            *mode = static_cast<ui_mode_t>(i);
+            return true;
+        }
+    }
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || value < 0 || value >= UI_MODE_COUNT) {
+        return false;
+    }
+    *mode = static_cast<ui_mode_t>(value);
+    return true;
+}
+
+static bool parse_interval(const char *arg, sim_clock::duration *interval) {
+    char *end;
+    double seconds = strtod(arg, &end);
+    if (end == arg || *end != '\0' || seconds < 0 || seconds > 3600) {
+        return false;
+    }
+    *interval = std::chrono::duration_cast<sim_clock::duration>(std::chrono::duration<double>(seconds));
+    return true;
+}
+
+static std::string format_time(uint32_t time_s) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "day %u %02u:%02u:%02u", time_s / 86400 + 1, time_s / 3600 % 24,
+             time_s / 60 % 60, time_s % 60);
+    return buf;
+}
+
+static void print_attributes(int fd) {
+    std::lock_guard<std::mutex> lock(device_mutex);
+    const device_attributes_t &a = device.attrs;
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "time %s\nfan-mode %u %s\npercent-setting %u\npercent-current %u\nair-quality %u\npm25 %u\n"
+             "led-level %u\npower-mw %lu\nenergy-mwh %llu\nroom-ug-m3 %.1f",
+             format_time(sim_time_s).c_str(), a.fan_mode, device_mode_names[a.fan_mode], a.percent_setting,
+             a.percent_current, a.air_quality, a.pm25, a.led_level, (unsigned long)a.power_mw,
+             (unsigned long long)a.energy_mwh, concentration);
+    send_line(fd, buf);
+}
+
+// One "name value" pair per line, tools/sub_bench.py reads them
+static void print_stats(int fd) {
+    sim_stats_t s;
+    uint32_t time_s;
+    uint32_t beeps;
+    size_t subscription_count;
+    {
+        std::lock_guard<std::mutex> device_lock(device_mutex);
+        std::lock_guard<std::mutex> subscribers_lock(subscribers_mutex);
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        s = stats;
+        time_s = sim_time_s;
+        beeps = device.beeps;
+        subscription_count = subscriptions.size();
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    uint64_t process_cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL
+        + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "sim-time-s %lu\nframes-ok %lu\nframes-bad %lu\nqueue-drops %lu\nbeeps %lu\n"
+             "controller-latency-avg-us %lu\ncontroller-latency-max-us %lu\n"
+             "subscriptions %zu\nsubscriptions-dropped %lu\nreports %lu\nempty-reports %lu\nattribute-reports %lu\n"
+             "report-cpu-us %llu\nprocess-cpu-us %llu\nheap-in-use %zu\nheap-high-water %zu",
+             (unsigned long)time_s, (unsigned long)s.frames[PMS_FRAME_OK],
+             (unsigned long)(s.frames[PMS_FRAME_TIMEOUT] + s.frames[PMS_FRAME_BAD] + s.frames[PMS_FRAME_CHECKSUM]),
+             (unsigned long)s.queue_drops, (unsigned long)beeps,
+             (unsigned long)(s.latency_count ? s.latency_total_us / s.latency_count : 0),
+             (unsigned long)s.latency_max_us, subscription_count, (unsigned long)s.subscriptions_dropped,
+             (unsigned long)s.reports, (unsigned long)s.empty_reports, (unsigned long)s.attribute_reports,
+             (unsigned long long)(s.report_cpu_ns / 1000), (unsigned long long)process_cpu_us,
+             mallinfo2().uordblks, s.heap_high_water);
+    send_line(fd, buf);
+}
+
+static const char *help_text =
+    "get                          all attributes and the simulated time\n"
+    "set fan-mode <off|low|high|auto|0..6>\n"
+    "set percent <0..100>\n"
+    "press <power|brightness|mode>  short press on the front panel\n"
+    "subscribe [min_s [max_s]]    replies \"ok <id>\", then pushes\n"
+    "                             \"report <id> <seq> <change_us> <attribute>=<value>...\",\n"
+    "                             change_us is steady clock time of the oldest change, 0 if empty\n"
+    "stats                        counters, CPU time and heap use\n"
+    "quit";
+
+static std::string handle_command(int fd, char *line) {
+    const char *argv[4] = {};
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\r"); tok != nullptr && argc < 4; tok = strtok(nullptr, " \t\r")) {
+        argv[argc++] = tok;
+    }
+    if (argc == 0) {
+        return "";
+    }
+
+    if (strcmp(argv[0], "help") == 0) {
+        send_line(fd, help_text);
+    } else if (strcmp(argv[0], "get") == 0) {
+        print_attributes(fd);
+    } else if (strcmp(argv[0], "stats") == 0) {
+        print_stats(fd);
+    } else if (strcmp(argv[0], "set") == 0 && argc == 3) {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        if (strcmp(argv[1], "fan-mode") == 0) {
+            ui_mode_t mode;
+            if (!parse_mode(argv[2], &mode)) {
+                return "error unknown fan mode";
+            }
+            device_write_fan_mode(&device, mode);
+        } else if (strcmp(argv[1], "percent") == 0) {
+            int percentage = atoi(argv[2]);
+            if (percentage < 0 || percentage > 100) {
+                return "error percent out of range";
+            }
+            device_write_percent(&device, static_cast<uint8_t>(percentage));
+        } else {
+            return "error unknown attribute";
+        }
+        report_changes();
+    } else if (strcmp(argv[0], "press") == 0 && argc == 2) {
+        static const char *events[] = { "power", "brightness", "mode" };
+        static_assert(sizeof(events) / sizeof(events[0]) == UI_EVENT_COUNT, "One name per button");
+        int event = -1;
+        for (int i = 0; i < UI_EVENT_COUNT; i++) {
+            if (strcmp(argv[1], events[i]) == 0) {
+                event = i;
+            }
+        }
+        if (event < 0) {
+            return "error unknown button";
+        }
+        std::lock_guard<std::mutex> lock(device_mutex);
+        device_press(&device, static_cast<ui_event_t>(event));
+        report_changes();
+    } else if (strcmp(argv[0], "subscribe") == 0) {
+        subscription_t sub = {};
+        sub.fd = fd;
+        sub.min_interval = std::chrono::seconds(DEFAULT_MIN_INTERVAL);
+        sub.max_interval = std::chrono::seconds(DEFAULT_MAX_INTERVAL);
+        if ((argc > 1 && !parse_interval(argv[1], &sub.min_interval))
+                || (argc > 2 && !parse_interval(argv[2], &sub.max_interval))
+                || sub.max_interval < sub.min_interval || sub.max_interval.count() == 0) {
+            return "error bad interval";
+        }
+        // The priming report carries everything and goes out right away
+        sub.dirty = ATTR_ALL;
+        sub.changed = sim_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex);
+            sub.id = next_subscription_id++;
+            // Reply before the report thread can send the priming report
+            send_line(fd, "ok " + std::to_string(sub.id));
+            subscriptions.push_back(sub);
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            sample_heap();
+        }
+        report_cv.notify_one();
+        return "";
+    } else {
+        return "error unknown command, try help";
+    }
+    return "ok";
+}
+
+// Same fields as metrics_collect() in the firmware. Simulated time is the
+// uptime, glibc's free arena bytes stand in for the free heap and its largest
+// block, and the threads have no stack watermarks.
+static void metrics_collect(metrics_snapshot_t *m) {
+    std::lock_guard<std::mutex> device_lock(device_mutex);
+    std::lock_guard<std::mutex> queue_lock(queue_mutex);
+    *m = {};
+    m->uptime_ms = (sim_time_s - config.start_s) * 1000ULL;
+    m->has_reading = has_reading;
+    m->pm25_raw = last_reading.pm25_raw;
+    m->pm25 = last_reading.pm25;
+    m->air_quality = last_reading.air_quality;
+    m->fan_mode = device.attrs.fan_mode;
+    m->fan_percent = device.fan_percentage;
+    m->fan_rpm = device.fan_percentage * FAN_RPM_MAX / 100;
+    m->reports_sent = stats.reports_sent;
+    m->reports_suppressed = stats.reports_suppressed;
+    m->frames_ok = stats.frames[PMS_FRAME_OK];
+    m->frames_timeout = stats.frames[PMS_FRAME_TIMEOUT];
+    m->frames_bad = stats.frames[PMS_FRAME_BAD];
+    m->frames_checksum = stats.frames[PMS_FRAME_CHECKSUM];
+    m->heap_free = mallinfo2().fordblks;
+    m->heap_min_free = stats.heap_free_low_water;
+    m->heap_largest_block = m->heap_free;
+}
+
+// One request per connection, answered from static buffers like the firmware's server task
+static void metrics_thread(int server) {
+    static metrics_snapshot_t snapshot;
+    static char body[METRICS_BUF_SIZE];
+    static char request[1024];
+    while (true) {
+        int fd = accept(server, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        size_t len = 0;
+        ssize_t n;
+        while (len < sizeof(request) - 1 && (n = recv(fd, request + len, sizeof(request) - 1 - len, 0)) > 0) {
+            len += n;
+            request[len] = '\0';
+            if (strstr(request, "\r\n\r\n") != nullptr) {
+                break;
+            }
+        }
+        request[len] = '\0';
+
+        char header[256];
+        size_t body_len = 0;
+        int header_len;
+        if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+            metrics_collect(&snapshot);
+            body_len = metrics_format(&snapshot, body, sizeof(body));
+        }
+        if (body_len > 0) {
+            header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                                  "Connection: close\r\n\r\n", METRICS_CONTENT_TYPE, body_len);
+        } else {
+            header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        }
+        send(fd, header, header_len, MSG_NOSIGNAL);
+        send(fd, body, body_len, MSG_NOSIGNAL);
+        close(fd);
+    }
+}
+
+static void client_thread(int fd) {
+    std::string pending;
+    char buf[256];
+    ssize_t n;
+    bool quit = false;
+    while (!quit && (n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        pending.append(buf, n);
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (line.rfind("quit", 0) == 0) {
+                quit = true;
+                break;
+            }
+            std::string reply = handle_command(fd, &line[0]);
+            if (!reply.empty()) {
+                send_line(fd, reply);
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        subscriptions.erase(std::remove_if(subscriptions.begin(), subscriptions.end(),
+                                           [fd](const subscription_t &sub) { return sub.fd == fd; }),
+                            subscriptions.end());
+    }
+    close(fd);
+}
+
+// One PM2.5 value in ug/m3 per line, '#' starts a comment
+static bool read_trace(const char *path, std::vector<uint16_t> *trace) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[64];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        char *end;
+        long value = strtol(line, &end, 10);
+        if (end != line && value >= 0 && value <= UINT16_MAX) {
+            trace->push_back(static_cast<uint16_t>(value));
+        }
+    }
+    fclose(f);
+    return !trace->empty();
+}
+
+static int listen_loopback(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [--port N] [--speed x] [--frame-errors permille] [--seed N] [--trace file]\n"
+            "          [--start-hour h] [--volume m3] [--ach 1/h] [--outdoor ug/m3] [--cadr m3/h]\n"
+            "          [--metrics-port N]\n", name);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(arg, "--port") == 0) {
+            config.port = static_cast<uint16_t>(atoi(value));
+        } else if (strcmp(arg, "--metrics-port") == 0) {
+            config.metrics_port = static_cast<uint16_t>(atoi(value));
+        } else if (strcmp(arg, "--speed") == 0) {
+            config.speed = atof(value);
+        } else if (strcmp(arg, "--frame-errors") == 0) {
+            config.frame_errors = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            config.room.seed = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--trace") == 0) {
+            if (!read_trace(value, &config.trace)) {
+                fprintf(stderr, "Cannot read the trace %s\n", value);
+                return 1;
+            }
+        } else if (strcmp(arg, "--start-hour") == 0) {
+            config.start_s = static_cast<uint32_t>(atof(value) * 3600);
+        } else if (strcmp(arg, "--volume") == 0) {
+            config.room.volume_m3 = atof(value);
+        } else if (strcmp(arg, "--ach") == 0) {
+            config.room.ach = atof(value);
+        } else if (strcmp(arg, "--outdoor") == 0) {
+            config.room.outdoor = atof(value);
+        } else if (strcmp(arg, "--cadr") == 0) {
+            config.room.cadr_max = atof(value);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (config.speed <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int server = listen_loopback(config.port);
+    int metrics_server = config.metrics_port != 0 ? listen_loopback(config.metrics_port) : -1;
+    if (server < 0 || (config.metrics_port != 0 && metrics_server < 0)) {
+        perror("listen");
+        return 1;
+    }
+
+    sim_time_s = config.start_s;
+    concentration = room_equilibrium(&config.room);
+    {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        device_init(&device);
+        published = device.attrs;
+        report_values = device.attrs;
+    }
+    std::thread(sensor_thread).detach();
+    std::thread(controller_thread).detach();
+    std::thread(report_thread).detach();
+    if (metrics_server >= 0) {
+        std::thread(metrics_thread, metrics_server).detach();
+    }
+
+    printf("device_sim listening on 127.0.0.1:%u, %.0fx real time, starting %s", config.port, config.speed,
+           format_time(config.start_s).c_str());
+    if (metrics_server >= 0) {
+        printf(", metrics on http://127.0.0.1:%u/metrics", config.metrics_port);
+    }
+    printf("\n");
+    fflush(stdout);
+    while (true) {
+        int fd = accept(server, nullptr, nullptr);
+        if (fd >= 0) {
+            std::thread(client_thread, fd).detach();
+        }
+    }
+}
@@ -0,0 +1,176 @@
+// PM2.5 filter trace test
+//
+// Runs a recorded PM2.5 trace through pm_filter with the firmware settings
+// from hw_conf.h, once per outlier stage (Hampel, median, none), and compares
+// every output with the expected columns of the trace file. The trace also
+// runs without outlier stage at EMA alpha 256, where every output must equal
+// its raw sample; CTest runs a second build with UBSan so that full scale
+// jumps at that alpha fail on signed overflow. Exits 1 on the first config
+// that differs and prints the samples where it does. Registered with CTest,
+// run "ctest" in the build directory.
+//
+// After an intended filter or setting change, --write prints the trace with
+// the expected columns recomputed; check the difference before committing it.
+//
+// Usage: filter_test [--write] trace.csv
+
+#include "hw_conf.h"
+#include "pm_filter.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct filter_column_t {
+    const char *name;
+    uint8_t outlier;
+};
+
+// Column order of the trace file after raw
+static const filter_column_t columns[] = {
+    { "hampel", PM_FILTER_HAMPEL },
+    { "median", PM_FILTER_MEDIAN },
+    { "none", PM_FILTER_NONE },
+};
+#define COLUMN_COUNT (sizeof(columns) / sizeof(columns[0]))
+
+struct trace_row_t {
+    uint16_t raw;
+    uint16_t expected[COLUMN_COUNT];
+};
+
+// Comment lines are kept for --write
+static bool load_trace(const char *path, std::vector<trace_row_t> *rows, std::string *comments) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    bool header = false;
+    int number = 0;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        number++;
+        if (line[0] == '#') {
+            comments->append(line);
+            continue;
+        }
+        if (!header) {
+            if (strcmp(line, "raw,hampel,median,none\n") != 0) {
+                fprintf(stderr, "%s:%d: expected the header raw,hampel,median,none\n", path, number);
+                fclose(f);
+                return false;
+            }
+            header = true;
+            continue;
+        }
+        trace_row_t row;
+        unsigned values[1 + COLUMN_COUNT];
+        if (sscanf(line, "%u,%u,%u,%u", &values[0], &values[1], &values[2], &values[3]) != 1 + COLUMN_COUNT) {
+            fprintf(stderr, "%s:%d: malformed row\n", path, number);
+            fclose(f);
+            return false;
+        }
+        row.raw = values[0];
+        for (size_t c = 0; c < COLUMN_COUNT; c++) {
+            row.expected[c] = values[1 + c];
+        }
+        rows->push_back(row);
+    }
+    fclose(f);
+    if (rows->empty()) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void filter_run(uint8_t outlier, uint16_t ema_alpha_q8, const std::vector<trace_row_t> &rows,
+                       std::vector<uint16_t> *out) {
+    pm_filter_t filter;
+    const pm_filter_config_t config = {
+        .outlier = outlier,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = ema_alpha_q8,
+    };
+    pm_filter_init(&filter, &config);
+    for (const trace_row_t &row : rows) {
+        out->push_back(pm_filter_update(&filter, row.raw));
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--write] trace.csv\n", name);
+}
+
+int main(int argc, char **argv) {
+    bool write = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--write") == 0) {
+            write = true;
+        } else if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<trace_row_t> rows;
+    std::string comments;
+    if (!load_trace(path, &rows, &comments)) {
+        return 2;
+    }
+
+    std::vector<uint16_t> outputs[COLUMN_COUNT];
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+        filter_run(columns[c].outlier, PM_FILTER_EMA_ALPHA_Q8, rows, &outputs[c]);
+    }
+
+    if (write) {
+        printf("%sraw,hampel,median,none\n", comments.c_str());
+        for (size_t i = 0; i < rows.size(); i++) {
+            printf("%u,%u,%u,%u\n", rows[i].raw, outputs[0][i], outputs[1][i], outputs[2][i]);
+        }
+        return 0;
+    }
+
+    bool failed = false;
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+        unsigned mismatches = 0;
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (outputs[c][i] == rows[i].expected[c]) {
+                continue;
+            }
+            if (mismatches++ < 10) {
+                fprintf(stderr, "%s: sample %zu raw %u: got %u, expected %u\n", columns[c].name, i, rows[i].raw,
+                        outputs[c][i], rows[i].expected[c]);
+            }
+        }
+        printf("%-6s %zu samples, %u differ\n", columns[c].name, rows.size(), mismatches);
+        failed |= mismatches > 0;
+    }
+
+    // Alpha 256 without outlier stage passes raw samples through unchanged
+    std::vector<uint16_t> passthrough;
+    filter_run(PM_FILTER_NONE, 256, rows, &passthrough);
+    unsigned mismatches = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (passthrough[i] != rows[i].raw && mismatches++ < 10) {
+            fprintf(stderr, "raw: sample %zu: got %u, expected %u\n", i, passthrough[i], rows[i].raw);
+        }
+    }
+    printf("%-6s %zu samples, %u differ\n", "raw", rows.size(), mismatches);
+    failed |= mismatches > 0;
+    return failed ? 1 : 0;
+}
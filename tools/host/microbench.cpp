@@ -0,0 +1,356 @@
+// Firmware hot path microbenchmarks
+//
+// Times the pure logic the firmware runs continuously: the sensor frame check
+// and PM2.5 extraction, the PM filter, air quality and auto speed mapping,
+// the auto controller, the indicator LED diffing and the fan's percentage to
+// frequency lookup. Prints ns per call and each function's code size from
+// the symbol table (nm), and compares both against a baseline file, failing
+// when either grew past its threshold. The baseline is recorded on the first
+// run. These are host numbers, only compare runs of one machine and compiler.
+//
+// Code sizes are the host build's unless --elf points at the firmware
+// (build/air-purifier.elf, with --nm xtensa-esp32-elf-nm). Timings on a
+// shared machine wander, --time-threshold 0 checks sizes only.
+//
+// Usage: microbench [--baseline file] [--update] [--time-threshold %] [--size-threshold %] [--min-time ms]
+//                   [--elf file] [--nm tool]
+
+#include "auto_control.h"
+#include "fan_lut.h"
+#include "hw_conf.h"
+#include "led_status.h"
+#include "pm_filter.h"
+#include "pms_frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include <unistd.h>
+
+// Allowed growth over the baseline, percent
+#define DEFAULT_TIME_THRESHOLD 25
+#define DEFAULT_SIZE_THRESHOLD 10
+// Timing differences below this are noise whatever the percentage
+#define TIME_NOISE_NS 0.5
+// Each measurement runs at least this long. The benchmarks take turns for
+// RUNS rounds, about a second and a half, and the best time counts. A
+// suspected regression gets RUNS more before it fails, a busy moment on a
+// shared machine should not.
+#define DEFAULT_MIN_TIME_MS 5
+#define RUNS 30
+
+#define INPUTS 256
+
+struct bench_t {
+    // Also the function whose size is reported
+    const char *name;
+    uint64_t (*run)(uint32_t iterations);
+};
+
+struct result_t {
+    double ns_per_op;
+    long size;
+};
+
+static uint8_t frames[INPUTS][PMS_FRAME_SIZE];
+static uint16_t pm_values[INPUTS];
+static uint8_t aq_levels[INPUTS];
+static uint16_t fan_lut[FAN_LUT_SIZE];
+static volatile uint64_t sink;
+
+// Deterministic spread of readings, mostly clean air with some spikes like a real day
+static void prepare_inputs() {
+    uint32_t x = 1;
+    for (int i = 0; i < INPUTS; i++) {
+        x = x * 1103515245 + 12345;
+        uint32_t r = x >> 16;
+        pm_values[i] = r % 8 == 0 ? r % 600 : 5 + r % 40;
+        aq_levels[i] = pm25_to_aq_level(pm_values[i]);
+        pms_frame_build(pm_values[i], frames[i]);
+    }
+    fan_lut_default(fan_lut);
+}
+
+static uint64_t bench_frame_check(uint32_t iterations) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += pms_frame_check(frames[i % INPUTS], PMS_FRAME_SIZE);
+    }
+    return sum;
+}
+
+static uint64_t bench_frame_pm25(uint32_t iterations) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += pms_frame_pm25(frames[i % INPUTS]);
+    }
+    return sum;
+}
+
+static uint64_t bench_pm_filter(uint32_t iterations) {
+    const pm_filter_config_t config = {
+        .outlier = PM_FILTER_OUTLIER,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = PM_FILTER_EMA_ALPHA_Q8,
+    };
+    pm_filter_t filter;
+    pm_filter_init(&filter, &config);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += pm_filter_update(&filter, pm_values[i % INPUTS]);
+    }
+    return sum;
+}
+
+static uint64_t bench_aq_level(uint32_t iterations) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += pm25_to_aq_level(pm_values[i % INPUTS]);
+    }
+    return sum;
+}
+
+static uint64_t bench_aq_percentage(uint32_t iterations) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += aq_level_to_percentage(aq_levels[i % INPUTS]);
+    }
+    return sum;
+}
+
+static uint64_t bench_auto_control(uint32_t iterations) {
+    auto_control_t control;
+    auto_control_init(&control, AUTO_STRATEGY);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += auto_control_update(&control, aq_levels[i % INPUTS], pm_values[i % INPUTS]);
+    }
+    return sum;
+}
+
+// The blink task's pattern: every other call toggles the phase, masks change now and then
+static uint64_t bench_led_status(uint32_t iterations) {
+    led_status_t status = {};
+    status.enabled = true;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        status.on_mask = pm_values[i % INPUTS] & 0x3F;
+        status.blink_mask = (i >> 6) & 0x03;
+        sum += led_status_update(&status, i & 1);
+    }
+    return sum + status.current;
+}
+
+static uint64_t bench_fan_frequency(uint32_t iterations) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += fan_lut_frequency(fan_lut, pm_values[i % INPUTS] % 101);
+    }
+    return sum;
+}
+
+static const bench_t benches[] = {
+    { "pms_frame_check", bench_frame_check },
+    { "pms_frame_pm25", bench_frame_pm25 },
+    { "pm_filter_update", bench_pm_filter },
+    { "pm25_to_aq_level", bench_aq_level },
+    { "aq_level_to_percentage", bench_aq_percentage },
+    { "auto_control_update", bench_auto_control },
+    { "led_status_update", bench_led_status },
+    { "fan_lut_frequency", bench_fan_frequency },
+};
+
+// Grow the iteration count until one run takes long enough to time
+static uint32_t calibrate(const bench_t &bench, double min_time_s) {
+    uint32_t iterations = 1024;
+    while (iterations < (1u << 30)) {
+        auto start = std::chrono::steady_clock::now();
+        sink = sink + bench.run(iterations);
+        if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= min_time_s) {
+            break;
+        }
+        iterations *= 2;
+    }
+    return iterations;
+}
+
+static double time_once(const bench_t &bench, uint32_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    sink = sink + bench.run(iterations);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / iterations;
+}
+
+// Function sizes from a symbol table, -1 when nm is missing or the function was inlined
+static std::map<std::string, long> symbol_sizes(const char *elf, const char *nm_tool) {
+    std::map<std::string, long> sizes;
+    std::string command = std::string(nm_tool) + " -S -C --defined-only '" + elf + "' 2>/dev/null";
+    FILE *nm = popen(command.c_str(), "r");
+    if (nm == nullptr) {
+        return sizes;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), nm) != nullptr) {
+        char size[32], type[4], name[900];
+        if (sscanf(line, "%*s %31s %3s %899[^(\n]", size, type, name) == 3 && (type[0] == 'T' || type[0] == 't')) {
+            sizes.emplace(name, strtol(size, nullptr, 16));
+        }
+    }
+    pclose(nm);
+    return sizes;
+}
+
+// "name ns_per_op size" per line, '#' starts a comment
+static bool read_baseline(const char *path, std::map<std::string, result_t> *baseline) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        char name[128];
+        result_t result;
+        if (line[0] != '#' && sscanf(line, "%127s %lf %ld", name, &result.ns_per_op, &result.size) == 3) {
+            (*baseline)[name] = result;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool write_baseline(const char *path, const std::map<std::string, result_t> &results) {
+    FILE *f = fopen(path, "w");
+    if (f == nullptr) {
+        return false;
+    }
+    fprintf(f, "# name ns_per_op size_bytes, written by microbench\n");
+    for (const bench_t &bench : benches) {
+        const result_t &result = results.at(bench.name);
+        fprintf(f, "%s %.3f %ld\n", bench.name, result.ns_per_op, result.size);
+    }
+    fclose(f);
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [--baseline file] [--update] [--time-threshold %%] [--size-threshold %%] [--min-time ms]\n"
+            "          [--elf file] [--nm tool]\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *baseline_path = nullptr;
+    bool update = false;
+    double time_threshold = DEFAULT_TIME_THRESHOLD;
+    double size_threshold = DEFAULT_SIZE_THRESHOLD;
+    double min_time_ms = DEFAULT_MIN_TIME_MS;
+    const char *elf = nullptr;
+    const char *nm_tool = "nm";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+            continue;
+        }
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--baseline") == 0) {
+            baseline_path = value;
+        } else if (strcmp(argv[i], "--time-threshold") == 0) {
+            time_threshold = atof(value);
+        } else if (strcmp(argv[i], "--size-threshold") == 0) {
+            size_threshold = atof(value);
+        } else if (strcmp(argv[i], "--min-time") == 0) {
+            min_time_ms = atof(value);
+        } else if (strcmp(argv[i], "--elf") == 0) {
+            elf = value;
+        } else if (strcmp(argv[i], "--nm") == 0) {
+            nm_tool = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    prepare_inputs();
+    char exe[512];
+    ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    exe[exe_len > 0 ? exe_len : 0] = '\0';
+    std::map<std::string, long> sizes = symbol_sizes(elf != nullptr ? elf : exe, nm_tool);
+    std::map<std::string, result_t> results;
+    std::map<std::string, uint32_t> iterations;
+    auto run_once = [&](const bench_t &bench) {
+        double ns = time_once(bench, iterations[bench.name]);
+        results[bench.name].ns_per_op = std::min(results[bench.name].ns_per_op, ns);
+    };
+    for (const bench_t &bench : benches) {
+        auto size = sizes.find(bench.name);
+        results[bench.name] = { 1e30, size != sizes.end() ? size->second : -1 };
+        iterations[bench.name] = calibrate(bench, min_time_ms / 1000);
+    }
+    for (int run = 0; run < RUNS; run++) {
+        for (const bench_t &bench : benches) {
+            run_once(bench);
+        }
+    }
+
+    std::map<std::string, result_t> baseline;
+    bool have_baseline = baseline_path != nullptr && read_baseline(baseline_path, &baseline);
+    auto slower = [&](const char *name) {
+        auto base = baseline.find(name);
+        if (base == baseline.end() || time_threshold <= 0) {
+            return false;
+        }
+        double now = results[name].ns_per_op, old = base->second.ns_per_op;
+        return now > old * (1 + time_threshold / 100) && now - old > TIME_NOISE_NS;
+    };
+    for (const bench_t &bench : benches) {
+        for (int run = 0; run < RUNS && slower(bench.name); run++) {
+            run_once(bench);
+        }
+    }
+
+    printf("%-24s %9s %9s %7s %7s\n", "function", "ns/op", "base", "bytes", "base");
+    int regressions = 0;
+    for (const bench_t &bench : benches) {
+        const result_t &result = results[bench.name];
+        printf("%-24s %9.2f", bench.name, result.ns_per_op);
+        auto base = baseline.find(bench.name);
+        if (base == baseline.end()) {
+            printf(" %9s %7ld %7s\n", "-", result.size, "-");
+            continue;
+        }
+        const result_t &old = base->second;
+        bool is_slower = slower(bench.name);
+        bool bigger = old.size > 0 && result.size > old.size * (1 + size_threshold / 100);
+        printf(" %9.2f %7ld %7ld%s%s\n", old.ns_per_op, result.size, old.size,
+               is_slower ? "  SLOWER" : "", bigger ? "  LARGER" : "");
+        regressions += is_slower || bigger;
+    }
+
+    if (baseline_path != nullptr && (!have_baseline || update)) {
+        if (!write_baseline(baseline_path, results)) {
+            fprintf(stderr, "Cannot write %s\n", baseline_path);
+            return 1;
+        }
+        printf("baseline %s %s\n", have_baseline ? "updated in" : "recorded in", baseline_path);
+        return 0;
+    }
+    if (regressions > 0) {
+        printf("%d regression%s past the thresholds (time %.0f %%, size %.0f %%)\n", regressions,
+               regressions == 1 ? "" : "s", time_threshold, size_threshold);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Apply an OTA payload the way the firmware does
+//
+// Feeds a payload (plain image or delta from tools/ota_delta.py, possibly
+// compressed by tools/ota_compress.py) through the
+// firmware's ota_stream in BDX sized blocks. The base image file stands in
+// for the running partition and the output file for the inactive one, both
+// limited to the partition size. Exits non-zero unless the result verifies.
+//
+// Usage: ota_apply <base.bin> <payload> <out.bin> [--partition-size bytes] [--block bytes]
+
+#include "ota_stream.h"
+#include "sha256.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// ota_0 and ota_1 in partitions.csv
+#define DEFAULT_PARTITION_SIZE 0x1E0000
+// Largest block the Matter OTA requestor asks for
+#define DEFAULT_BLOCK_SIZE 1024
+
+struct partition_files_t {
+    FILE *base;
+    long base_size;
+    FILE *out;
+    uint32_t out_size;
+    uint32_t partition_size;
+    uint64_t base_read;
+};
+
+static bool read_base(void *ctx, uint32_t offset, void *buf, size_t len) {
+    partition_files_t *files = static_cast<partition_files_t *>(ctx);
+    if (offset + len > files->partition_size) {
+        return false;
+    }
+    // Past the end of the file reads like erased flash
+    memset(buf, 0xFF, len);
+    if (offset < files->base_size) {
+        size_t n = files->base_size - offset < (long)len ? files->base_size - offset : len;
+        if (fseek(files->base, offset, SEEK_SET) != 0 || fread(buf, 1, n, files->base) != n) {
+            return false;
+        }
+    }
+    files->base_read += len;
+    return true;
+}
+
+static bool write_out(void *ctx, const void *buf, size_t len) {
+    partition_files_t *files = static_cast<partition_files_t *>(ctx);
+    if (files->out_size + len > files->partition_size) {
+        return false;
+    }
+    files->out_size += len;
+    return fwrite(buf, 1, len, files->out) == len;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s <base.bin> <payload> <out.bin> [--partition-size bytes] [--block bytes]\n", name);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    partition_files_t files = {};
+    files.partition_size = DEFAULT_PARTITION_SIZE;
+    size_t block_size = DEFAULT_BLOCK_SIZE;
+
+    for (int i = 4; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--partition-size") == 0) {
+            files.partition_size = strtoul(value, nullptr, 0);
+        } else if (strcmp(argv[i], "--block") == 0) {
+            block_size = strtoul(value, nullptr, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    files.base = fopen(argv[1], "rb");
+    FILE *payload = fopen(argv[2], "rb");
+    files.out = fopen(argv[3], "wb");
+    if (files.base == nullptr || payload == nullptr || files.out == nullptr || block_size == 0) {
+        fprintf(stderr, "Cannot open the input or output files\n");
+        return 1;
+    }
+    fseek(files.base, 0, SEEK_END);
+    files.base_size = ftell(files.base);
+
+    static ota_stream_t stream;
+    const ota_stream_io_t io = { read_base, write_out, &files };
+    ota_stream_init(&stream, &io);
+
+    std::vector<uint8_t> block(block_size);
+    auto start = std::chrono::steady_clock::now();
+    size_t n;
+    while ((n = fread(block.data(), 1, block.size(), payload)) > 0) {
+        if (ota_stream_feed(&stream, block.data(), n) != OTA_STREAM_OK) {
+            break;
+        }
+    }
+    ota_stream_err_t err = ota_stream_finish(&stream);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fclose(files.out);
+
+    const char *formats[] = { "unknown", "plain image", "delta" };
+    printf("%s%s payload: %lu bytes in, %lu bytes out, %llu base bytes read, %.3f s\n",
+           stream.compressed ? "compressed " : "", formats[stream.format],
+           (unsigned long)stream.received, (unsigned long)stream.written,
+           (unsigned long long)files.base_read, elapsed);
+    printf("decoder state: %zu bytes\n", sizeof(stream));
+    if (err != OTA_STREAM_OK) {
+        printf("FAILED: %s\n", ota_stream_err_name(err));
+        return 2;
+    }
+    printf("OK%s%s\n", stream.compressed ? ", SHA-256 of the decompressed stream matches" : "",
+           stream.format == OTA_FORMAT_DELTA ? ", SHA-256 of the output matches the delta" : "");
+    return 0;
+}
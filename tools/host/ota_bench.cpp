@@ -0,0 +1,159 @@
+// OTA payload decoding benchmark
+//
+// Runs the firmware's ota_stream over a payload held in memory, with memory
+// standing in for both partitions, and reports decoding throughput and the
+// RAM the decoder needs. Flash is left out on purpose, this measures the
+// decompressor, delta and hashing cost alone. Host numbers, an ESP32 at
+// 160 MHz is roughly 20-40 times slower.
+//
+// Usage: ota_bench <payload> [--base base.bin] [--runs N] [--block bytes]
+
+#include "ota_stream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Largest block the Matter OTA requestor asks for
+#define DEFAULT_BLOCK_SIZE 1024
+// ota_0 and ota_1 in partitions.csv
+#define PARTITION_SIZE 0x1E0000
+
+struct bench_io_t {
+    const std::vector<uint8_t> *base;
+    std::vector<uint8_t> out;
+    // Lowest stack address seen in the flash callbacks
+    uintptr_t stack_low;
+};
+
+static void note_stack(bench_io_t *io) {
+    volatile uint8_t marker = 0;
+    uintptr_t here = reinterpret_cast<uintptr_t>(&marker);
+    if (io->stack_low == 0 || here < io->stack_low) {
+        io->stack_low = here;
+    }
+}
+
+static bool read_base(void *ctx, uint32_t offset, void *buf, size_t len) {
+    bench_io_t *io = static_cast<bench_io_t *>(ctx);
+    note_stack(io);
+    if (offset + len > PARTITION_SIZE) {
+        return false;
+    }
+    memset(buf, 0xFF, len);
+    if (offset < io->base->size()) {
+        size_t n = io->base->size() - offset < len ? io->base->size() - offset : len;
+        memcpy(buf, io->base->data() + offset, n);
+    }
+    return true;
+}
+
+static bool write_out(void *ctx, const void *buf, size_t len) {
+    bench_io_t *io = static_cast<bench_io_t *>(ctx);
+    note_stack(io);
+    if (io->out.size() + len > PARTITION_SIZE) {
+        return false;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(buf);
+    io->out.insert(io->out.end(), bytes, bytes + len);
+    return true;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> *data) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s <payload> [--base base.bin] [--runs N] [--block bytes]\n", name);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *base_path = nullptr;
+    int runs = 10;
+    size_t block_size = DEFAULT_BLOCK_SIZE;
+
+    for (int i = 2; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--base") == 0) {
+            base_path = value;
+        } else if (strcmp(argv[i], "--runs") == 0) {
+            runs = atoi(value);
+        } else if (strcmp(argv[i], "--block") == 0) {
+            block_size = strtoul(value, nullptr, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    std::vector<uint8_t> payload, base;
+    if (!read_file(argv[1], &payload) || (base_path != nullptr && !read_file(base_path, &base))
+            || runs < 1 || block_size == 0) {
+        fprintf(stderr, "Cannot read the payload or base\n");
+        return 1;
+    }
+
+    static ota_stream_t stream;
+    bench_io_t io = {};
+    io.base = &base;
+    io.out.reserve(PARTITION_SIZE);
+    const ota_stream_io_t stream_io = { read_base, write_out, &io };
+
+    volatile uint8_t stack_top = 0;
+    double best = 0;
+    ota_stream_err_t err = OTA_STREAM_OK;
+    for (int run = 0; run < runs && err == OTA_STREAM_OK; run++) {
+        io.out.clear();
+        auto start = std::chrono::steady_clock::now();
+        ota_stream_init(&stream, &stream_io);
+        for (size_t offset = 0; offset < payload.size(); offset += block_size) {
+            size_t n = payload.size() - offset < block_size ? payload.size() - offset : block_size;
+            if (ota_stream_feed(&stream, &payload[offset], n) != OTA_STREAM_OK) {
+                break;
+            }
+        }
+        err = ota_stream_finish(&stream);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    if (err != OTA_STREAM_OK) {
+        printf("FAILED: %s\n", ota_stream_err_name(err));
+        return 2;
+    }
+
+    const char *formats[] = { "unknown", "plain image", "delta" };
+    printf("%s%s: %zu bytes in, %lu bytes out\n", stream.compressed ? "compressed " : "",
+           formats[stream.format], payload.size(), (unsigned long)stream.written);
+    printf("best of %d: %.2f ms, %.1f MB/s in, %.1f MB/s out\n", runs, best * 1e3,
+           payload.size() / best / 1e6, stream.written / best / 1e6);
+    // The decoder allocates nothing, its state and the call depth are all it needs
+    printf("decoder state: %zu bytes (LZSS window %d, chunk buffer %d)\n", sizeof(stream),
+           LZSS_WINDOW_SIZE, OTA_STREAM_CHUNK);
+    printf("stack below the caller: %lu bytes (host build, indicative only)\n",
+           (unsigned long)(reinterpret_cast<uintptr_t>(&stack_top) - io.stack_low));
+    return 0;
+}
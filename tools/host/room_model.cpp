@@ -0,0 +1,59 @@
+#include "room_model.h"
+
+static const event_t events[] = {
+    { "breakfast", 7 * 3600 + 30 * 60, 10 * 60, 300 },
+    { "lunch", 12 * 3600 + 30 * 60, 20 * 60, 400 },
+    { "dinner", 19 * 3600, 40 * 60, 600 },
+    { "candle", 21 * 3600, 60 * 60, 60 },
+};
+
+uint32_t rng_next(rng_t *rng) {
+    rng->state = rng->state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<uint32_t>(rng->state >> 33);
+}
+
+double rng_uniform(rng_t *rng) {
+    return rng_next(rng) / 2147483648.0;
+}
+
+uint16_t room_sensor_read(rng_t *rng, double concentration) {
+    double noise = (rng_uniform(rng) * 2 - 1) * (2 + 0.05 * concentration);
+    double value = concentration + noise;
+    if (rng_next(rng) % 2000 == 0) {
+        value *= 5;
+    }
+    if (value < 0) {
+        value = 0;
+    }
+    return static_cast<uint16_t>(value + 0.5);
+}
+
+double room_fan_cadr(const room_config_t *room, uint8_t percentage) {
+    return room->cadr_max * percentage / 100.0;
+}
+
+double room_emission_rate(uint32_t time_s) {
+    uint32_t day_s = time_s % 86400;
+    double rate = 0;
+    for (const event_t &event : events) {
+        if (day_s >= event.start_s && day_s < event.start_s + event.duration_s) {
+            rate += event.rate;
+        }
+    }
+    // ug per minute to ug per hour
+    return rate * 60;
+}
+
+double room_equilibrium(const room_config_t *room) {
+    return room->outdoor * room->ach / (room->ach + room->deposition);
+}
+
+double room_step(const room_config_t *room, double concentration, uint32_t time_s, uint8_t percentage, double dt_s) {
+    // Explicit Euler, fine for steps up to a few seconds
+    double dt_h = dt_s / 3600;
+    double source = room_emission_rate(time_s) / room->volume_m3;
+    double infiltration = room->ach * (room->outdoor - concentration);
+    double removal = (room->deposition + room_fan_cadr(room, percentage) / room->volume_m3) * concentration;
+    concentration += (source + infiltration - removal) * dt_h;
+    return concentration < 0 ? 0 : concentration;
+}
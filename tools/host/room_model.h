@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// Well mixed room shared by the host simulators: infiltration, deposition,
+// scheduled pollution events, a noisy sensor and a fan with airflow
+// proportional to its speed.
+
+struct room_config_t {
+    double days = 7;
+    double volume_m3 = 30;
+    // Air changes per hour through infiltration
+    double ach = 0.5;
+    // Particle deposition rate on surfaces, 1/h
+    double deposition = 0.2;
+    double outdoor = 15;
+    // Clean air delivery rate at 100 %
+    double cadr_max = 380;
+    double fan_power_max_w = 38;
+    // Electronics and motor driver overhead while the fan runs
+    double fan_power_min_w = 1.5;
+    uint32_t seed = 1;
+    // Below this concentration the room counts as clean
+    double clean_threshold = 35;
+};
+
+// Pollution source active every day
+struct event_t {
+    const char *name;
+    uint32_t start_s;
+    uint32_t duration_s;
+    // Emission rate in ug per minute
+    double rate;
+};
+
+// Deterministic noise, identical for every run with the same seed
+struct rng_t {
+    uint64_t state;
+};
+
+uint32_t rng_next(rng_t *rng);
+
+double rng_uniform(rng_t *rng);
+
+// Mock sensor: proportional and absolute noise, rare misread spikes
+uint16_t room_sensor_read(rng_t *rng, double concentration);
+
+// Mock fan: airflow proportional to percentage
+double room_fan_cadr(const room_config_t *room, uint8_t percentage);
+
+// Emission of the events active at this time of day, ug per hour
+double room_emission_rate(uint32_t time_s);
+
+// Concentration with no source and the fan off
+double room_equilibrium(const room_config_t *room);
+
+// Advance the concentration by dt_s seconds at time_s
+double room_step(const room_config_t *room, double concentration, uint32_t time_s, uint8_t percentage, double dt_s);
@@ -0,0 +1,234 @@
+// Room air cleaning simulator
+//
+// Models a single well mixed room with infiltration, deposition and
+// scheduled pollution events, and runs the firmware's PM filter and auto
+// controller against it with a mock sensor and a mock fan. Each strategy
+// sees the same room, events and sensor noise.
+//
+// Usage: room_sim [--days N] [--volume m3] [--ach 1/h] [--outdoor ug/m3]
+//                 [--cadr m3/h] [--fan-power W] [--seed N]
+//                 [--staircase good,fair,moderate,poor,vpoor,xpoor]
+//                 [--csv file] [--csv-interval s]
+
+#include "auto_control.h"
+#include "pm_filter.h"
+#include "power_model.h"
+#include "hw_conf.h"
+#include "room_model.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define STRATEGY_AUTO_STAIRCASE  0
+#define STRATEGY_AUTO_PREDICTIVE 1
+#define STRATEGY_FIXED           2
+
+struct strategy_t {
+    const char *name;
+    uint8_t kind;
+    uint8_t fixed_percentage;
+};
+
+static const strategy_t strategies[] = {
+    { "staircase", STRATEGY_AUTO_STAIRCASE, 0 },
+    { "predictive", STRATEGY_AUTO_PREDICTIVE, 0 },
+    { "fixed-low", STRATEGY_FIXED, AUTO_GOOD_PERCENT },
+    { "fixed-max", STRATEGY_FIXED, 100 },
+};
+
+struct result_t {
+    // Integral of concentration over time
+    double exposure_ug_h_m3;
+    double energy_wh;
+    double peak;
+    uint32_t speed_changes;
+    double time_to_clean_s;
+    uint32_t cleaned_events;
+};
+
+// Same model the firmware reports over Matter, motor only
+static double fan_power(const room_config_t *room, uint8_t percentage) {
+    power_model_t model = {};
+    model.fan_min_mw = static_cast<uint32_t>(room->fan_power_min_w * 1000);
+    model.fan_max_mw = static_cast<uint32_t>(room->fan_power_max_w * 1000);
+    return power_model_fan_mw(&model, percentage) / 1000.0;
+}
+
+static void simulate(const room_config_t *room, const strategy_t *strategy,
+                     const uint8_t *staircase, FILE *csv, uint32_t csv_interval, result_t *result) {
+    rng_t rng = { room->seed };
+    memset(result, 0, sizeof(*result));
+
+    // Same pipeline as pms_task and auto_controller_task
+    pm_filter_t filter;
+    const pm_filter_config_t filter_config = {
+        .outlier = PM_FILTER_OUTLIER,
+        .window = PM_FILTER_WINDOW,
+        .hampel_k_q8 = PM_FILTER_HAMPEL_K_Q8,
+        .hampel_min_dev = PM_FILTER_HAMPEL_MIN_DEV,
+        .ema_alpha_q8 = PM_FILTER_EMA_ALPHA_Q8,
+    };
+    pm_filter_init(&filter, &filter_config);
+
+    auto_control_t control;
+    auto_control_init(&control, strategy->kind == STRATEGY_AUTO_PREDICTIVE
+        ? AUTO_STRATEGY_PREDICTIVE : AUTO_STRATEGY_STAIRCASE);
+    if (staircase != nullptr) {
+        memcpy(&control.level_percentage[AQ_GOOD], staircase, AQ_EXTREMELY_POOR);
+    }
+
+    const double dt_h = 1.0 / 3600;
+    const uint32_t duration_s = static_cast<uint32_t>(room->days * 86400);
+
+    double concentration = room_equilibrium(room);
+    uint8_t percentage = strategy->kind == STRATEGY_FIXED ? strategy->fixed_percentage : AUTO_UNKNOWN_PERCENT;
+
+    bool dirty = false;
+    uint32_t dirty_since = 0;
+
+    for (uint32_t t = 0; t < duration_s; t++) {
+        uint16_t raw = room_sensor_read(&rng, concentration);
+        uint16_t filtered = pm_filter_update(&filter, raw);
+
+        uint8_t next = percentage;
+        if (strategy->kind == STRATEGY_FIXED) {
+            next = strategy->fixed_percentage;
+        } else {
+            next = auto_control_update(&control, pm25_to_aq_level(filtered), filtered);
+        }
+        if (next != percentage) {
+            result->speed_changes++;
+            percentage = next;
+        }
+
+        concentration = room_step(room, concentration, t, percentage, 1);
+
+        result->exposure_ug_h_m3 += concentration * dt_h;
+        result->energy_wh += fan_power(room, percentage) * dt_h;
+        if (concentration > result->peak) {
+            result->peak = concentration;
+        }
+
+        // Time from the room getting dirty until it is clean again
+        if (!dirty && concentration >= room->clean_threshold) {
+            dirty = true;
+            dirty_since = t;
+        } else if (dirty && concentration < room->clean_threshold && room_emission_rate(t) == 0) {
+            dirty = false;
+            result->time_to_clean_s += t - dirty_since;
+            result->cleaned_events++;
+        }
+
+        if (csv != nullptr && t % csv_interval == 0) {
+            fprintf(csv, "%s,%u,%.1f,%u,%u,%u\n", strategy->name, t, concentration, raw, filtered, percentage);
+        }
+    }
+}
+
+static bool parse_staircase(const char *arg, uint8_t *staircase) {
+    char *end;
+    for (int i = 0; i < AQ_EXTREMELY_POOR; i++) {
+        long value = strtol(arg, &end, 10);
+        if (end == arg || value < 0 || value > 100) {
+            return false;
+        }
+        staircase[i] = static_cast<uint8_t>(value);
+        if (i < AQ_EXTREMELY_POOR - 1) {
+            if (*end != ',') {
+                return false;
+            }
+            arg = end + 1;
+        }
+    }
+    return *end == '\0';
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [--days N] [--volume m3] [--ach 1/h] [--outdoor ug/m3] [--cadr m3/h]\n"
+            "          [--fan-power W] [--seed N] [--staircase good,fair,moderate,poor,vpoor,xpoor]\n"
+            "          [--csv file] [--csv-interval s]\n", name);
+}
+
+int main(int argc, char **argv) {
+    room_config_t room;
+    uint8_t staircase_values[AQ_EXTREMELY_POOR];
+    const uint8_t *staircase = nullptr;
+    const char *csv_path = nullptr;
+    uint32_t csv_interval = 60;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(arg, "--days") == 0) {
+            room.days = atof(value);
+        } else if (strcmp(arg, "--volume") == 0) {
+            room.volume_m3 = atof(value);
+        } else if (strcmp(arg, "--ach") == 0) {
+            room.ach = atof(value);
+        } else if (strcmp(arg, "--outdoor") == 0) {
+            room.outdoor = atof(value);
+        } else if (strcmp(arg, "--cadr") == 0) {
+            room.cadr_max = atof(value);
+        } else if (strcmp(arg, "--fan-power") == 0) {
+            room.fan_power_max_w = atof(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            room.seed = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--staircase") == 0) {
+            if (!parse_staircase(value, staircase_values)) {
+                fprintf(stderr, "--staircase needs 6 comma separated percentages\n");
+                return 1;
+            }
+            staircase = staircase_values;
+        } else if (strcmp(arg, "--csv") == 0) {
+            csv_path = value;
+        } else if (strcmp(arg, "--csv-interval") == 0) {
+            csv_interval = strtoul(value, nullptr, 10);
+            if (csv_interval == 0) {
+                csv_interval = 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    FILE *csv = nullptr;
+    if (csv_path != nullptr) {
+        csv = fopen(csv_path, "w");
+        if (csv == nullptr) {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "strategy,time_s,concentration,sensor_raw,sensor_filtered,fan_percentage\n");
+    }
+
+    printf("room %.0f m3, %.2f ACH, outdoor %.0f ug/m3, CADR %.0f m3/h, %.1f days\n",
+           room.volume_m3, room.ach, room.outdoor, room.cadr_max, room.days);
+    printf("%-12s %16s %10s %10s %8s %14s\n",
+           "strategy", "exposure ug*h/m3", "energy Wh", "peak", "changes", "time-to-clean");
+
+    for (const strategy_t &strategy : strategies) {
+        result_t result;
+        simulate(&room, &strategy, staircase, csv, csv_interval, &result);
+
+        double time_to_clean_min = result.cleaned_events > 0
+            ? result.time_to_clean_s / result.cleaned_events / 60 : 0;
+        printf("%-12s %16.0f %10.1f %10.0f %8u %11.1f min\n",
+               strategy.name, result.exposure_ug_h_m3, result.energy_wh, result.peak,
+               result.speed_changes, time_to_clean_min);
+    }
+
+    if (csv != nullptr) {
+        fclose(csv);
+    }
+    return 0;
+}
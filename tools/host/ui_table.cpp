@@ -0,0 +1,81 @@
+// Front panel transition table
+//
+// Prints every (fan mode, brightness, button) entry of the firmware's UI
+// state machine with the commands it emits, for review after a rule change.
+// The invariants themselves are static_asserts in ui_fsm.h, this only builds
+// if they hold. --bench times ui_fsm_step() over all entries.
+//
+// Usage: ui_table [--bench]
+
+#include "ui_fsm.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+static const char *mode_names[] = { "off", "low", "medium", "high", "on", "auto", "smart" };
+static const char *event_names[] = { "power", "brightness", "mode" };
+static_assert(sizeof(mode_names) / sizeof(mode_names[0]) == UI_MODE_COUNT, "One name per mode");
+static_assert(sizeof(event_names) / sizeof(event_names[0]) == UI_EVENT_COUNT, "One name per event");
+
+static void print_commands(const ui_transition_t &t) {
+    if (t.commands == 0) {
+        printf("-");
+    }
+    const char *sep = "";
+    if (t.commands & UI_CMD_BEEP) {
+        printf("%sbeep", sep);
+        sep = " ";
+    }
+    if (t.commands & UI_CMD_SET_BRIGHTNESS) {
+        printf("%sbrightness=%u", sep, t.brightness);
+        sep = " ";
+    }
+    if (t.commands & UI_CMD_RESTORE) {
+        printf("%srestore", sep);
+        sep = " ";
+    }
+    if (t.commands & UI_CMD_SET_MODE) {
+        printf("%smode=%s", sep, mode_names[t.mode]);
+    }
+    printf("\n");
+}
+
+static void bench() {
+    const int rounds = 1000000;
+    volatile uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (uint8_t mode = 0; mode < UI_MODE_COUNT; mode++) {
+            for (uint8_t brightness = UI_BRIGHTNESS_MIN; brightness <= UI_BRIGHTNESS_MAX; brightness++) {
+                for (uint8_t event = 0; event < UI_EVENT_COUNT; event++) {
+                    ui_transition_t t = ui_fsm_step(static_cast<ui_mode_t>(mode), brightness,
+                                                    static_cast<ui_event_t>(event));
+                    sink = sink + t.commands + t.mode + t.brightness;
+                }
+            }
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%.2f ns per transition (%d lookups)\n", elapsed * 1e9 / (rounds * (double)UI_TABLE_SIZE),
+           rounds * UI_TABLE_SIZE);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        bench();
+        return 0;
+    }
+    printf("%zu entries, %zu bytes\n", (size_t)UI_TABLE_SIZE, sizeof(ui_table));
+    printf("%-7s %-10s %-11s %s\n", "mode", "brightness", "button", "commands");
+    for (uint8_t mode = 0; mode < UI_MODE_COUNT; mode++) {
+        for (uint8_t brightness = UI_BRIGHTNESS_MIN; brightness <= UI_BRIGHTNESS_MAX; brightness++) {
+            for (uint8_t event = 0; event < UI_EVENT_COUNT; event++) {
+                printf("%-7s %-10u %-11s ", mode_names[mode], brightness, event_names[event]);
+                print_commands(ui_fsm_step(static_cast<ui_mode_t>(mode), brightness, static_cast<ui_event_t>(event)));
+            }
+        }
+    }
+    return 0;
+}
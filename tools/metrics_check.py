@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Scrape the OpenMetrics endpoint and check the exposition.
+
+Fetches /metrics from a device with METRICS_HTTP_ENABLE or from
+tools/host/device_sim --metrics-port, the way Prometheus would, and checks
+the text against the OpenMetrics rules Prometheus enforces: content type,
+TYPE before samples, sample names matching their family (_total on
+counters), UNIT as the name suffix, numeric values, no family twice and the
+closing "# EOF". Prints the samples of the last scrape and the scrape times.
+When prometheus_client is installed its parser checks the text as well.
+
+  device_sim --metrics-port 9100 &
+  metrics_check.py --count 5 --interval 1
+
+Usage: metrics_check.py [--url url] [--count N] [--interval s] [--quiet]
+"""
+
+import argparse
+import re
+import sys
+import time
+import urllib.request
+
+CONTENT_TYPE = "application/openmetrics-text"
+SAMPLE = re.compile(r'^([a-zA-Z_:][a-zA-Z0-9_:]*)(\{[^}]*\})? (\S+)$')
+LABELS = re.compile(r'^[a-zA-Z_][a-zA-Z0-9_]*="(?:[^"\\]|\\.)*"$')
+SUFFIXES = {
+    "counter": ("_total", "_created"),
+    "gauge": ("",),
+    "info": ("_info",),
+    "stateset": ("",),
+    "unknown": ("",),
+}
+
+
+def check(text):
+    """Returns (samples, errors), samples as (name, labels, value)."""
+    errors = []
+    samples = []
+    families = {}
+    family = None
+    lines = text.split("\n")
+    if lines[-1] != "":
+        errors.append("no newline after the last line")
+    lines = lines[:-1]
+    if not lines or lines[-1] != "# EOF":
+        errors.append("missing # EOF")
+    for number, line in enumerate(lines, 1):
+        if line == "# EOF":
+            if number != len(lines):
+                errors.append(f"line {number}: # EOF before the end")
+            continue
+        if line.startswith("#"):
+            parts = line.split(" ", 3)
+            if len(parts) < 4 or parts[1] not in ("TYPE", "HELP", "UNIT"):
+                errors.append(f"line {number}: bad metadata: {line}")
+                continue
+            _, kind, name, value = parts
+            if kind == "TYPE":
+                if name in families:
+                    errors.append(f"line {number}: family {name} appears twice")
+                if value not in SUFFIXES:
+                    errors.append(f"line {number}: unsupported type {value}")
+                families[name] = value
+                family = name
+            elif name != family:
+                errors.append(f"line {number}: {kind} for {name} outside its family")
+            elif kind == "UNIT" and not name.endswith("_" + value):
+                errors.append(f"line {number}: {name} does not end in its unit {value}")
+            continue
+
+        match = SAMPLE.match(line)
+        if match is None:
+            errors.append(f"line {number}: bad sample: {line}")
+            continue
+        name, labels, value = match.groups()
+        if family is None or not any(name == family + suffix for suffix in SUFFIXES[families[family]]):
+            errors.append(f"line {number}: sample {name} outside its family {family}")
+        if labels:
+            for label in re.findall(r'[a-zA-Z_][a-zA-Z0-9_]*="(?:[^"\\]|\\.)*"|[^,{}]+', labels[1:-1]):
+                if not LABELS.match(label):
+                    errors.append(f"line {number}: bad label {label}")
+        try:
+            float(value)
+        except ValueError:
+            errors.append(f"line {number}: bad value {value}")
+            continue
+        samples.append((name, labels or "", value))
+    return samples, errors
+
+
+def check_with_client(text):
+    try:
+        from prometheus_client.openmetrics.parser import text_string_to_metric_families
+    except ImportError:
+        return None
+    try:
+        list(text_string_to_metric_families(text))
+    except Exception as e:
+        return str(e)
+    return ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--url", default="http://127.0.0.1:9100/metrics")
+    parser.add_argument("--count", type=int, default=1, help="number of scrapes")
+    parser.add_argument("--interval", type=float, default=1, help="seconds between scrapes")
+    parser.add_argument("--quiet", action="store_true", help="only print problems and the summary")
+    args = parser.parse_args()
+
+    durations = []
+    failed = False
+    samples = []
+    for i in range(args.count):
+        if i > 0:
+            time.sleep(args.interval)
+        start = time.monotonic()
+        request = urllib.request.Request(args.url, headers={"Accept": CONTENT_TYPE + "; version=1.0.0"})
+        with urllib.request.urlopen(request, timeout=10) as response:
+            content_type = response.headers.get("Content-Type", "")
+            text = response.read().decode("utf-8")
+        durations.append(time.monotonic() - start)
+
+        samples, errors = check(text)
+        if not content_type.startswith(CONTENT_TYPE):
+            errors.append(f"content type {content_type}")
+        client_error = check_with_client(text)
+        if client_error:
+            errors.append(f"prometheus_client: {client_error}")
+        for error in errors:
+            print(f"scrape {i + 1}: {error}", file=sys.stderr)
+        failed |= bool(errors)
+
+    if not args.quiet:
+        for name, labels, value in samples:
+            print(f"{name}{labels} {value}")
+    durations.sort()
+    print(f"# {args.count} scrapes, {len(samples)} samples, {len(text)} bytes, "
+          f"scrape time median {durations[len(durations) // 2] * 1000:.1f} ms, max {durations[-1] * 1000:.1f} ms, "
+          f"{'FAILED' if failed else 'ok'}"
+          f"{'' if check_with_client('') is not None else ' (prometheus_client not installed)'}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Compress an OTA payload for the firmware's streaming LZSS decoder.
+
+The input is a plain application image or a delta from ota_delta.py, the
+output takes its place inside the Matter OTA file (format in main/lzss.h and
+main/ota_stream.h). The device decompresses it straight into the update
+partition with a 4 KB window:
+
+  ota_compress.py build/air-purifier.bin -o image.lzs
+  ota_image_tool.py create -v <vid> -p <pid> -vn <version> -vs <string> \\
+      -da sha256 image.lzs purifier.ota
+
+Usage: ota_compress.py input -o out [--chain N]
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"LZS1"
+WINDOW = 1 << 12
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+
+
+def compress(data, chain_limit):
+    out = bytearray()
+    # Most recent positions of every 3 byte prefix, newest last
+    chains = {}
+    flags_pos = 0
+    flag_bit = 8
+    i = 0
+    n = len(data)
+    while i < n:
+        if flag_bit == 8:
+            flags_pos = len(out)
+            out.append(0)
+            flag_bit = 0
+
+        best_len, best_pos = 0, 0
+        if i + MIN_MATCH <= n:
+            limit = min(MAX_MATCH, n - i)
+            key = data[i:i + MIN_MATCH]
+            for pos in reversed(chains.get(key, ())[-chain_limit:]):
+                if i - pos > WINDOW:
+                    break
+                # Only a longer match helps, check the byte that would make it longer first
+                if best_len and data[pos + best_len] != data[i + best_len]:
+                    continue
+                length = MIN_MATCH
+                while length < limit and data[pos + length] == data[i + length]:
+                    length += 1
+                if length > best_len:
+                    best_len, best_pos = length, pos
+                    if length == limit:
+                        break
+
+        if best_len >= MIN_MATCH:
+            distance = i - best_pos - 1
+            out.append(distance & 0xFF)
+            out.append((distance >> 8) << 4 | (best_len - MIN_MATCH))
+            step = best_len
+        else:
+            out[flags_pos] |= 1 << flag_bit
+            out.append(data[i])
+            step = 1
+        flag_bit += 1
+
+        for pos in range(i, min(i + step, n - MIN_MATCH + 1)):
+            chain = chains.setdefault(data[pos:pos + MIN_MATCH], [])
+            chain.append(pos)
+            if len(chain) > 2 * chain_limit:
+                del chain[:chain_limit]
+        i += step
+    return bytes(out)
+
+
+def decompress(stream, size):
+    out = bytearray()
+    i = 0
+    while len(out) < size:
+        flags = stream[i]
+        i += 1
+        for bit in range(8):
+            if len(out) >= size:
+                break
+            if flags >> bit & 1:
+                out.append(stream[i])
+                i += 1
+            else:
+                lo, hi = stream[i], stream[i + 1]
+                i += 2
+                start = len(out) - ((lo | (hi >> 4) << 8) + 1)
+                for k in range((hi & 0x0F) + MIN_MATCH):
+                    out.append(out[start + k])
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress an OTA payload")
+    parser.add_argument("input", help="application image or delta")
+    parser.add_argument("-o", "--output", required=True)
+    parser.add_argument("--chain", type=int, default=32,
+                        help="match candidates tried per position (default %(default)s)")
+    args = parser.parse_args()
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    if data[:len(MAGIC)] == MAGIC:
+        sys.exit("%s is already compressed" % args.input)
+
+    stream = compress(data, max(args.chain, 1))
+    if decompress(stream, len(data)) != data:
+        sys.exit("internal error: compressed stream does not reproduce the input")
+    with open(args.output, "wb") as f:
+        f.write(MAGIC + struct.pack("<I", len(data)) + hashlib.sha256(data).digest() + stream)
+
+    size = len(stream) + len(MAGIC) + 4 + 32
+    print("%d bytes -> %d bytes (%.1f %%)" % (len(data), size, 100.0 * size / max(len(data), 1)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Make a delta OTA payload that turns the running image into a new one.
+
+The delta takes the place of the application image inside the Matter OTA
+file. The device rebuilds the new image from its running partition while the
+delta streams in (format in main/ota_stream.h). Wrap it like a full image:
+
+  ota_delta.py build/old.bin build/new.bin -o delta.bin
+  ota_image_tool.py create -v <vid> -p <pid> -vn <version> -vs <string> \\
+      -da sha256 delta.bin purifier-delta.ota
+
+The base must be exactly the image the device runs, the device refuses the
+delta otherwise and the provider has to serve a full image.
+
+Usage: ota_delta.py base new -o out [--min-match N]
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"PDL1"
+OP_END = 0
+OP_COPY = 1
+OP_INSERT = 2
+
+# Base positions are indexed every STEP bytes by the KEY bytes starting there.
+# Every new position is looked up, so any match of KEY + STEP - 1 bytes is found.
+KEY = 16
+STEP = 4
+
+
+def match_length(base, base_pos, new, new_pos):
+    limit = min(len(base) - base_pos, len(new) - new_pos)
+    n = 0
+    while n < limit:
+        size = min(256, limit - n)
+        if base[base_pos + n:base_pos + n + size] == new[new_pos + n:new_pos + n + size]:
+            n += size
+            continue
+        for j in range(size):
+            if base[base_pos + n + j] != new[new_pos + n + j]:
+                return n + j
+    return n
+
+
+def make_ops(base, new, min_match):
+    index = {}
+    for pos in range(0, len(base) - KEY + 1, STEP):
+        index.setdefault(base[pos:pos + KEY], pos)
+
+    ops = []
+    literal_start = 0
+    # Offset between base and new of the last copy, code after a change usually continues there
+    shift = None
+    i = 0
+    while i + KEY <= len(new):
+        candidates = []
+        if shift is not None and 0 <= i + shift <= len(base) - KEY:
+            candidates.append(i + shift)
+        found = index.get(new[i:i + KEY])
+        if found is not None:
+            candidates.append(found)
+
+        best_pos, best_len = 0, 0
+        for pos in candidates:
+            length = match_length(base, pos, new, i)
+            if length > best_len:
+                best_pos, best_len = pos, length
+
+        if best_len < min_match:
+            i += 1
+            continue
+
+        # Grow the match back into the pending literal
+        while i > literal_start and best_pos > 0 and base[best_pos - 1] == new[i - 1]:
+            i -= 1
+            best_pos -= 1
+            best_len += 1
+
+        if i > literal_start:
+            ops.append((OP_INSERT, new[literal_start:i]))
+        ops.append((OP_COPY, best_pos, best_len))
+        shift = best_pos - i
+        i += best_len
+        literal_start = i
+
+    if literal_start < len(new):
+        ops.append((OP_INSERT, new[literal_start:]))
+    return ops
+
+
+def encode(base, new, ops):
+    out = bytearray(MAGIC)
+    out += struct.pack("<I", len(base)) + hashlib.sha256(base).digest()
+    out += struct.pack("<I", len(new)) + hashlib.sha256(new).digest()
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(op[1])) + op[1]
+    out += struct.pack("<B", OP_END)
+    return bytes(out)
+
+
+def apply(base, ops):
+    out = bytearray()
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += base[op[1]:op[1] + op[2]]
+        else:
+            out += op[1]
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Make a delta OTA payload")
+    parser.add_argument("base", help="image the devices run now")
+    parser.add_argument("new", help="image to update to")
+    parser.add_argument("-o", "--output", required=True)
+    parser.add_argument("--min-match", type=int, default=KEY + STEP,
+                        help="shortest run copied from the base (default %(default)s)")
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    ops = make_ops(base, new, max(args.min_match, KEY))
+    if apply(base, ops) != new:
+        sys.exit("internal error: delta does not reproduce the new image")
+    delta = encode(base, new, ops)
+    with open(args.output, "wb") as f:
+        f.write(delta)
+
+    copied = sum(op[2] for op in ops if op[0] == OP_COPY)
+    print("base %d bytes, new %d bytes, delta %d bytes (%.1f %% of new)"
+          % (len(base), len(new), len(delta), 100.0 * len(delta) / max(len(new), 1)))
+    print("%d copies (%d bytes), %d inserts (%d bytes)"
+          % (sum(1 for op in ops if op[0] == OP_COPY), copied,
+             sum(1 for op in ops if op[0] == OP_INSERT), len(new) - copied))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Round trip of every OTA payload kind through the firmware's decoder.
+
+Makes a base and a new application image, builds the payloads with
+ota_delta.py and ota_compress.py and applies each of them to the base with
+tools/host/ota_apply: the plain image, the compressed image, the delta and
+the compressed delta must all reproduce the new image byte for byte, and the
+delta applied to a different base must be refused. Registered with CTest in
+tools/host, run "ctest" in the build directory.
+
+Usage: ota_test.py [--apply path] [--size bytes] [--seed N]
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_APPLY = os.path.join(TOOLS_DIR, "..", "build-host", "ota_apply")
+
+# First byte of an ESP-IDF application image, ota_stream detects plain images by it
+IMAGE_MAGIC = 0xE9
+
+
+def make_base(rng, size):
+    """Code-like content: a small vocabulary of instruction sized words, so
+    both the delta matcher and LZSS find something to work with."""
+    words = [rng.randbytes(4) for _ in range(512)]
+    image = bytearray([IMAGE_MAGIC]) + rng.randbytes(23)
+    while len(image) < size:
+        image += words[int(rng.expovariate(1 / 64)) % len(words)]
+    return bytes(image[:size])
+
+
+def make_new(rng, base):
+    """A rebuild: a few functions changed, code inserted and removed, so
+    everything after the first change moves."""
+    new = bytearray(base)
+    for _ in range(8):
+        pos = rng.randrange(64, len(new) - 4096)
+        kind = rng.randrange(3)
+        if kind == 0:
+            new[pos:pos + 256] = rng.randbytes(256)
+        elif kind == 1:
+            new[pos:pos] = rng.randbytes(rng.randrange(16, 1024))
+        else:
+            del new[pos:pos + rng.randrange(16, 1024)]
+    return bytes(new)
+
+
+def run(args):
+    return subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+
+
+def tool(name, *args):
+    result = run([sys.executable, os.path.join(TOOLS_DIR, name)] + list(args))
+    if result.returncode != 0:
+        sys.exit("%s failed:\n%s" % (name, result.stdout))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="OTA payload round trip test")
+    parser.add_argument("--apply", default=DEFAULT_APPLY, help="ota_apply binary (default %(default)s)")
+    parser.add_argument("--size", type=int, default=256 * 1024, help="base image size (default %(default)s)")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    base = make_base(rng, args.size)
+    new = make_new(rng, base)
+    # Same length, one byte off: only the base hash tells it apart
+    wrong = bytearray(base)
+    wrong[len(wrong) // 2] ^= 0xFF
+
+    failed = False
+    with tempfile.TemporaryDirectory() as work:
+        def path(name):
+            return os.path.join(work, name)
+
+        for name, data in (("base.bin", base), ("new.bin", new), ("wrong.bin", bytes(wrong))):
+            with open(path(name), "wb") as f:
+                f.write(data)
+
+        tool("ota_delta.py", path("base.bin"), path("new.bin"), "-o", path("delta.bin"))
+        tool("ota_compress.py", path("new.bin"), "-o", path("new.lzs"))
+        tool("ota_compress.py", path("delta.bin"), "-o", path("delta.lzs"))
+
+        # Payload, base, whether the output must match the new image
+        cases = (
+            ("new.bin", "base.bin", True),
+            ("new.lzs", "base.bin", True),
+            ("delta.bin", "base.bin", True),
+            ("delta.lzs", "base.bin", True),
+            ("delta.bin", "wrong.bin", False),
+            ("delta.lzs", "wrong.bin", False),
+        )
+        for payload, base_name, expect_ok in cases:
+            result = run([args.apply, path(base_name), path(payload), path("out.bin")])
+            with open(path("out.bin"), "rb") as f:
+                out = f.read()
+            if expect_ok:
+                ok = result.returncode == 0 and out == new
+            else:
+                ok = result.returncode != 0
+            print("%-9s on %-9s %s" % (payload, base_name, "ok" if ok else "FAILED"))
+            if not ok:
+                print(result.stdout, end="")
+                failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
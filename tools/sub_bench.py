@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Subscription load benchmark against the host device simulator.
+
+Starts tools/host/device_sim, puts it in auto mode, opens subscriptions with
+the given min/max intervals (one per controller, e.g. Home, Home Assistant and
+Google on separate fabrics) and lets a sensor trace drive the controller for a
+while. Prints JSON with report rate and latency per subscription and the
+simulator's report thread CPU time and heap high-water, to be kept alongside
+release notes and compared across releases:
+
+  sub_bench.py --subs 0:60,1:30,5:300 --duration 30 --speed 10 -o bench.json
+
+Latency is measured from the attribute change to the report arriving, so it
+includes the min interval hold. Numbers are for the simulator's report
+engine, not the CHIP stack, and only comparable between runs on one machine.
+
+Usage: sub_bench.py [--sim path] [--subs min:max,...] [--count N] [--duration s]
+                    [--speed x] [--trace file] [--port N] [-o out.json]
+"""
+
+import argparse
+import json
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+DEFAULT_SIM = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "build-host", "device_sim")
+
+
+def synthetic_trace():
+    """Two minutes of PM2.5 at one value per second: clean air, a cooking
+    spike and its decay, so air quality, PM2.5 and the fan speed all move."""
+    trace = []
+    for t in range(120):
+        if t < 20:
+            trace.append(8 + t % 3)
+        elif t < 35:
+            trace.append(8 + (t - 20) * 12)
+        else:
+            trace.append(max(8, int(188 * 0.94 ** (t - 35))))
+    return trace
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class Subscriber(threading.Thread):
+    def __init__(self, port, min_s, max_s):
+        super().__init__(daemon=True)
+        self.min_s = min_s
+        self.max_s = max_s
+        self.sock = socket.create_connection(("127.0.0.1", port))
+        self.file = self.sock.makefile("r")
+        self.sock.sendall(f"subscribe {min_s} {max_s}\n".encode())
+        reply = self.file.readline().split()
+        if len(reply) != 2 or reply[0] != "ok":
+            raise RuntimeError(f"subscribe {min_s} {max_s} failed: {' '.join(reply)}")
+        self.id = int(reply[1])
+        self.reports = 0
+        self.empty = 0
+        self.attributes = 0
+        self.gaps = 0
+        self.latencies_us = []
+        self.counting = False
+
+    def run(self):
+        seq = 0
+        for line in self.file:
+            now_us = time.monotonic_ns() // 1000
+            fields = line.split()
+            if len(fields) < 4 or fields[0] != "report":
+                continue
+            if int(fields[2]) != seq + 1:
+                self.gaps += 1
+            seq = int(fields[2])
+            # The priming report lands before the measurement starts
+            if not self.counting:
+                continue
+            self.reports += 1
+            changed_us = int(fields[3])
+            if changed_us == 0:
+                self.empty += 1
+            else:
+                self.attributes += len(fields) - 4
+                self.latencies_us.append(now_us - changed_us)
+
+    def result(self, duration):
+        return {
+            "id": self.id,
+            "min_interval_s": self.min_s,
+            "max_interval_s": self.max_s,
+            "reports": self.reports,
+            "reports_per_s": round(self.reports / duration, 2),
+            "empty_reports": self.empty,
+            "attributes": self.attributes,
+            "sequence_gaps": self.gaps,
+            "latency_us": {
+                "p50": percentile(self.latencies_us, 50),
+                "p95": percentile(self.latencies_us, 95),
+                "max": max(self.latencies_us) if self.latencies_us else None,
+            },
+        }
+
+
+def command(port, line):
+    with socket.create_connection(("127.0.0.1", port)) as sock:
+        sock.sendall(f"{line}\nquit\n".encode())
+        lines = sock.makefile("r").read().splitlines()
+    if not lines or lines[-1].startswith("error"):
+        raise RuntimeError(f"{line}: {lines[-1] if lines else 'no reply'}")
+    return lines
+
+
+def stats(port):
+    values = {}
+    for line in command(port, "stats"):
+        name, _, value = line.partition(" ")
+        if value.isdigit():
+            values[name] = int(value)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--sim", default=DEFAULT_SIM, help="device_sim binary")
+    parser.add_argument("--subs", default="0:60,1:30,5:300",
+                        help="comma separated min:max intervals in seconds, one per subscription")
+    parser.add_argument("--count", type=int, default=0,
+                        help="number of subscriptions, cycling through --subs (default: one each)")
+    parser.add_argument("--duration", type=float, default=30, help="measured time in seconds")
+    parser.add_argument("--speed", type=float, default=10, help="simulated seconds per second")
+    parser.add_argument("--trace", help="PM2.5 trace, one value per line (default: synthetic)")
+    parser.add_argument("--port", type=int, default=5542)
+    parser.add_argument("-o", "--output", help="write JSON here instead of stdout")
+    args = parser.parse_args()
+
+    intervals = [tuple(float(v) for v in spec.split(":")) for spec in args.subs.split(",")]
+    count = args.count or len(intervals)
+
+    trace_path = args.trace
+    if trace_path is None:
+        with tempfile.NamedTemporaryFile("w", suffix=".trace", delete=False) as f:
+            f.write("\n".join(str(v) for v in synthetic_trace()) + "\n")
+            trace_path = f.name
+
+    sim = subprocess.Popen([args.sim, "--port", str(args.port), "--speed", str(args.speed),
+                            "--trace", trace_path, "--frame-errors", "0"],
+                           stdout=subprocess.PIPE, text=True)
+    try:
+        if "listening" not in sim.stdout.readline():
+            print("device_sim did not start", file=sys.stderr)
+            return 1
+        command(args.port, "set fan-mode auto")
+        subscribers = [Subscriber(args.port, *intervals[i % len(intervals)]) for i in range(count)]
+        for sub in subscribers:
+            sub.start()
+
+        # Let the priming reports go out, then measure from a clean baseline
+        time.sleep(0.5)
+        before = stats(args.port)
+        for sub in subscribers:
+            sub.counting = True
+        start = time.monotonic()
+        time.sleep(args.duration)
+        for sub in subscribers:
+            sub.counting = False
+        duration = time.monotonic() - start
+        after = stats(args.port)
+    finally:
+        sim.terminate()
+        sim.wait()
+        if args.trace is None:
+            os.unlink(trace_path)
+
+    latencies = [v for sub in subscribers for v in sub.latencies_us]
+    reports = sum(sub.reports for sub in subscribers)
+    report_cpu_us = after["report-cpu-us"] - before["report-cpu-us"]
+    result = {
+        "config": {
+            "subscriptions": count,
+            "intervals": args.subs,
+            "duration_s": round(duration, 3),
+            "speed": args.speed,
+            "trace": args.trace or "synthetic",
+        },
+        "total": {
+            "reports": reports,
+            "reports_per_s": round(reports / duration, 2),
+            "latency_us": {
+                "p50": percentile(latencies, 50),
+                "p95": percentile(latencies, 95),
+                "max": max(latencies) if latencies else None,
+            },
+            "report_cpu_us": report_cpu_us,
+            "report_cpu_us_per_report": round(report_cpu_us / reports, 2) if reports else None,
+            "process_cpu_us": after["process-cpu-us"] - before["process-cpu-us"],
+            "heap_high_water": after["heap-high-water"],
+            "subscriptions_dropped": after["subscriptions-dropped"],
+            "sensor_readings": after["frames-ok"] - before["frames-ok"],
+            "controller_queue_drops": after["queue-drops"] - before["queue-drops"],
+        },
+        "subscriptions": [sub.result(duration) for sub in subscribers],
+    }
+
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
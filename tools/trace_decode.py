@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Decode the binary event trace printed by "matter esp purifier trace-dump".
+
+Reads a console log (file or stdin), picks the "T <hex>" record lines and
+prints one event per line. Event names and formats come from main/trace.h.
+
+Usage: trace_decode.py [log] [--header main/trace.h] [--csv]
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+RECORD = struct.Struct("<IHBBII")
+FLAG_ISR = 0x01
+FLAG_CORE = 0x02
+
+EVENT_RE = re.compile(r'^\s*X\((\w+),\s*"(.*)"\)')
+FIELD_RE = re.compile(r"\{([^{}:]+)(:[^{}]*)?\}")
+
+
+def load_events(header):
+    events = []
+    with open(header) as f:
+        for line in f:
+            m = EVENT_RE.match(line)
+            if m:
+                events.append((m.group(1), m.group(2)))
+    return events
+
+
+def format_args(fmt, a0, a1):
+    def field(m):
+        try:
+            value = eval(m.group(1), {}, {"a0": a0, "a1": a1})
+        except (IndexError, KeyError, TypeError):
+            return "?"
+        spec = m.group(2)[1:] if m.group(2) else ""
+        return format(value, spec)
+    return FIELD_RE.sub(field, fmt)
+
+
+def read_records(stream):
+    for line in stream:
+        line = line.strip()
+        if not line.startswith("T "):
+            continue
+        data = bytes.fromhex(line[2:])
+        if len(data) != RECORD.size:
+            continue
+        yield RECORD.unpack(data)
+
+
+def main():
+    default_header = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "main", "trace.h")
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="console log, stdin if omitted")
+    parser.add_argument("--header", default=default_header, help="trace.h with the event list")
+    parser.add_argument("--csv", action="store_true", help="print time_us,event,a0,a1 instead")
+    args = parser.parse_args()
+
+    events = load_events(args.header)
+    stream = open(args.log) if args.log else sys.stdin
+
+    # Timestamps are 32-bit microseconds, unwrap them. Records from another
+    # core or an ISR can be a few microseconds out of order, only a jump back
+    # by more than half the range is a wrap.
+    offset = 0
+    prev = None
+    first = None
+    if args.csv:
+        print("time_us,event,context,a0,a1")
+    for time_us, _seq, event, flags, a0, a1 in read_records(stream):
+        if prev is not None and prev - time_us > 1 << 31:
+            offset += 1 << 32
+        prev = time_us
+        t = time_us + offset
+        if first is None:
+            first = t
+
+        name, fmt = events[event] if event < len(events) else ("EVENT_%u" % event, "a0={a0} a1={a1}")
+        context = ("isr" if flags & FLAG_ISR else "task") + ("/1" if flags & FLAG_CORE else "/0")
+        if args.csv:
+            print("%d,%s,%s,%d,%d" % (t, name, context, a0, a1))
+        else:
+            print("%12.6f  +%9.3f ms  %-8s %-22s %s" % (
+                t / 1e6, (t - first) / 1e3, context, name, format_args(fmt, a0, a1)))
+
+
+if __name__ == "__main__":
+    main()